@@ -40,6 +40,8 @@ class Ec_arch final : private Ec
         template <typename T>
         Ec_arch (Space_obj *, Space_hst *, Fpu *, T *, unsigned, unsigned long, bool);
 
+        ~Ec_arch();
+
         static void handle_irq_kern() asm ("handle_irq_kern");
 
         [[noreturn]]
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include "compiler.hpp"
 #include "coresight.hpp"
 #include "intid.hpp"
 #include "memory.hpp"
@@ -52,6 +53,8 @@ class Gicr final : private Coresight, private Intid
             PENDBASER   =  0x00078, // -- v3 rw LPI Pending Table Base Address Register
             INVLPIR     =  0x000a0, // -- v3 wo Invalidate LPI Register
             INVALLR     =  0x000b0, // -- v3 wo Invalidate All Register
+            VPROPBASER  =  0x20070, // -- v4 rw vLPI Configuration Table Base Address Register
+            VPENDBASER  =  0x20078, // -- v4 rw vLPI Pending Table Base Address Register
         };
 
         enum class Array32 : unsigned
@@ -60,8 +63,19 @@ class Gicr final : private Coresight, private Intid
             ICFGR       =  0x10c00, // -- v3 rw SGI/PPI Configuration Registers
         };
 
+        static constexpr uint64 attr { BIT (10) | BIT_RANGE (9, 7) };  // Inner Shareable, RaWaWb
+
+        static constexpr unsigned lpi_bits { 14 };                      // Number of LPI INTID bits
+
         static inline uint64 phys   { Board::gic[1].mmio };
 
+        static uint64   rd_phys     CPULOCAL;   // Physical address of the redistributor
+        static uint64   rd_type     CPULOCAL;   // Type register of the redistributor
+        static uint64   resident    CPULOCAL;   // VPT of the resident vPE
+        static void *   lpend       CPULOCAL;   // LPI Pending Table
+
+        static inline void * lprop  { nullptr };    // LPI Configuration Table, shared by all redistributors
+
         static inline auto read  (Register32 r)             { return *reinterpret_cast<uint32 volatile *>(MMAP_CPU_GICR + std::to_underlying (r)); }
         static inline auto read  (Register64 r)             { return *reinterpret_cast<uint64 volatile *>(MMAP_CPU_GICR + std::to_underlying (r)); }
         static inline auto read  (Array32 r, unsigned n)    { return *reinterpret_cast<uint32 volatile *>(MMAP_CPU_GICR + std::to_underlying (r) + n * sizeof (uint32)); }
@@ -74,11 +88,47 @@ class Gicr final : private Coresight, private Intid
         static void init_mmio();
         static void wait_rwp();
 
+        static bool init_lpi();
+
+        static bool set_vpt (uint64);
+
     public:
+        static inline bool lpi { true };        // Physical LPIs, which serve as vPE doorbells, in all redistributors
+
         static void init();
 
         static bool get_act (unsigned);
         static void set_act (unsigned, bool);
 
         static void conf (unsigned, bool, bool = false);
+
+        static uint64 rdbase (unsigned, bool);
+
+        static bool evict (uint64, unsigned);
+
+        /*
+         * Make a vPE resident on this redistributor
+         *
+         * @param vpt   Physical address of the virtual pending table of the vPE
+         */
+        ALWAYS_INLINE
+        static inline void schedule (uint64 vpt)
+        {
+            if (EXPECT_FALSE (resident != vpt))
+                set_vpt (vpt);
+        }
+
+        /*
+         * Make a vPE non-resident on this redistributor
+         *
+         * The ITS rings the doorbells of a non-resident vPE for vLPIs that become pending.
+         *
+         * @param vpt   Physical address of the virtual pending table of the vPE
+         * @return      true if vLPIs of the vPE were pending already, false otherwise
+         */
+        ALWAYS_INLINE
+        static inline bool deschedule (uint64 vpt)
+        {
+            return resident == vpt && set_vpt (0);
+        }
 };
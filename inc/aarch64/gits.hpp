@@ -0,0 +1,115 @@
+/*
+ * Generic Interrupt Controller: Interrupt Translation Service (GITS)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "coresight.hpp"
+#include "memory.hpp"
+#include "spinlock.hpp"
+#include "status.hpp"
+#include "types.hpp"
+
+class Gits final : private Coresight
+{
+    friend class Acpi_table_madt;
+
+    private:
+        enum class Register32 : unsigned
+        {
+            CTLR        = 0x0000,   // -- v3 rw Control Register
+            IIDR        = 0x0004,   // -- v3 ro Implementer Identification Register
+        };
+
+        enum class Register64 : unsigned
+        {
+            TYPER       = 0x0008,   // -- v3 ro Type Register
+            CBASER      = 0x0080,   // -- v3 rw Command Queue Descriptor
+            CWRITER     = 0x0088,   // -- v3 rw Command Queue Write Register
+            CREADR      = 0x0090,   // -- v3 ro Command Queue Read Register
+        };
+
+        enum class Array64 : unsigned
+        {
+            BASER       = 0x0100,   // -- v3 rw Translation Table Descriptors
+        };
+
+        enum class Command : uint8
+        {
+            SYNC        = 0x05,     // Wait for physical commands
+            MAPD        = 0x08,     // Map DeviceID to ITT
+            DISCARD     = 0x0f,     // Remove EventID mapping
+            VSYNC       = 0x25,     // Wait for virtual commands
+            VMAPP       = 0x29,     // Map vPEID to redistributor
+            VMAPTI      = 0x2a,     // Map EventID to vLPI
+        };
+
+        enum class Table : unsigned
+        {
+            DEV         = 1,        // Device Table
+            VPE         = 2,        // vPE Table
+        };
+
+        struct Device
+        {
+            void *      itt;        // Interrupt Translation Table
+            uint16      rid;        // DeviceID
+        };
+
+        static constexpr uint64   attr      { BIT64_RANGE (61, 59) | BIT (10) };    // RaWaWb, Inner Shareable
+        static constexpr unsigned cmdq_ord  { 4 };      // 64K command queue
+        static constexpr unsigned cmdq_num  { BIT (cmdq_ord + PAGE_BITS) / 32 };
+        static constexpr unsigned itt_ord   { 2 };      // 16K ITT: 1024 ITEs of up to 16 bytes
+        static constexpr unsigned evt_bits  { 10 };     // EventID bits
+
+        static inline uint64    phys            { 0 };
+        static inline uint64 *  cmdq            { nullptr };
+        static inline unsigned  cwr             { 0 };
+        static inline unsigned  dev_bits        { 0 };
+        static inline unsigned  dev_num         { 0 };
+        static inline bool      pta             { false };
+        static inline bool      nc              { false };
+        static inline void *    table[8];
+        static inline Device    device[64];
+        static inline Spinlock  lock;
+
+        static inline auto read  (Register32 r)             { return *reinterpret_cast<uint32 volatile *>(MMAP_GLB_GITS + std::to_underlying (r)); }
+        static inline auto read  (Register64 r)             { return *reinterpret_cast<uint64 volatile *>(MMAP_GLB_GITS + std::to_underlying (r)); }
+        static inline auto read  (Array64 r, unsigned n)    { return *reinterpret_cast<uint64 volatile *>(MMAP_GLB_GITS + std::to_underlying (r) + n * sizeof (uint64)); }
+
+        static inline void write (Register32 r,          uint32 v) { *reinterpret_cast<uint32 volatile *>(MMAP_GLB_GITS + std::to_underlying (r)) = v; }
+        static inline void write (Register64 r,          uint64 v) { *reinterpret_cast<uint64 volatile *>(MMAP_GLB_GITS + std::to_underlying (r)) = v; }
+        static inline void write (Array64 r, unsigned n, uint64 v) { *reinterpret_cast<uint64 volatile *>(MMAP_GLB_GITS + std::to_underlying (r) + n * sizeof (uint64)) = v; }
+
+        static bool mmap_mmio();
+        static bool init_mmio();
+        static unsigned init_table (unsigned, unsigned);
+
+        static bool command (Command, uint64, uint64, uint64, uint64);
+        static bool map_dev (uint16);
+
+    public:
+        static inline bool      vlpi            { true };
+        static inline uint64    translater      { 0 };
+        static inline void *    vprop           { nullptr };
+
+        static void init();
+
+        static bool map_vpe (uint16, unsigned, uint64, bool);
+
+        static Status assign (uint16, uint32, uint16, uint32, uint32);
+        static void discard (uint16, uint32, uint16);
+};
@@ -21,8 +21,11 @@
 #include "event.hpp"
 #include "intid.hpp"
 #include "macros.hpp"
+#include "status.hpp"
+#include "timeout_interrupt.hpp"
 #include "types.hpp"
 
+class Ec;
 class Sm;
 
 class Interrupt final : private Intid
@@ -33,6 +36,7 @@ class Interrupt final : private Intid
         static Event::Selector handle_sgi (uint32, bool);
         static Event::Selector handle_ppi (uint32, bool);
         static Event::Selector handle_spi (uint32, bool);
+        static Event::Selector handle_lpi (uint32, bool);
 
     public:
         class Config final
@@ -44,6 +48,7 @@ class Interrupt final : private Intid
                 inline auto cpu() const { return static_cast<uint16>(val >> 48 & BIT_RANGE (15, 0)); }
                 inline auto rid() const { return static_cast<uint16>(val >> 32 & BIT_RANGE (15, 0)); }
                 inline bool gst() const { return val & BIT (3); }
+                inline bool pst() const { return val & BIT (3); }     // Shares the bit with gst, but applies to MSIs
                 inline bool pol() const { return val & BIT (2); }
                 inline bool trg() const { return val & BIT (1); }
                 inline bool msk() const { return val & BIT (0); }
@@ -60,11 +65,15 @@ class Interrupt final : private Intid
 
         Sm *            sm      { nullptr };
         Atomic<Config>  config  { Config (0, 0, BIT (0)) };
+        Timeout_interrupt mod;
+        Atomic<Ec *>    vcpu    { nullptr };    // vCPU the interrupt is posted into
 
         static Interrupt int_table[NUM_SPI];
 
         static unsigned num_pin();
-        static unsigned num_msi() { return 0; }
+        static unsigned num_msi();
+
+        static bool postable (unsigned);
 
         static void init();
 
@@ -77,10 +86,13 @@ class Interrupt final : private Intid
         static void conf_ppi (unsigned, bool, bool);
         static void conf_spi (unsigned, bool, bool, unsigned);
 
-        static void configure (unsigned, Config, uint32 &, uint16 &);
+        static Status configure (unsigned, Config, uint64, Ec *, uint16, uint64 &, uint16 &);
 
         static void deactivate (unsigned);
 
         static void send_cpu (Request, unsigned);
         static void send_exc (Request);
+
+    private:
+        static Status configure_msi (unsigned, Config, Ec *, uint16, uint64 &, uint16 &);
 };
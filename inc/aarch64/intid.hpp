@@ -24,6 +24,7 @@ class Intid
         static constexpr unsigned BASE_PPI {   16 };
         static constexpr unsigned BASE_SPI {   32 };
         static constexpr unsigned BASE_RSV { 1020 };
+        static constexpr unsigned BASE_LPI { 8192 };
 
     public:
         static constexpr unsigned NUM_SGI { BASE_PPI - BASE_SGI };
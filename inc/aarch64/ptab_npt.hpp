@@ -18,7 +18,6 @@
 #pragma once
 
 #include "ptab.hpp"
-#include "vmid.hpp"
 
 class Npt final : public Pagetable<Npt, uint64, uint64, 3, 3, true>::Entry
 {
@@ -33,6 +32,7 @@ class Npt final : public Pagetable<Npt, uint64, uint64, 3, 3, true>::Entry
             ATTR_nX0    = BIT64 (53),   // Not Executable
             ATTR_nX1    = BIT64 (54),   // Not Executable
             ATTR_K      = BIT64 (55),   // Kernel Memory
+            ATTR_L      = BIT64 (56),   // Write-Protected for Dirty Logging (Software)
         };
 
     public:
@@ -64,13 +64,14 @@ class Npt final : public Pagetable<Npt, uint64, uint64, 3, 3, true>::Entry
                      std::to_underlying (sh) << 8 | Memattr::s2_attr (ca) << 2 | !l * ATTR_nL | ATTR_A | ATTR_P;
         }
 
+        // A leaf PTE that is write-protected for dirty logging remains writable
         Paging::Permissions page_pm() const
         {
             return Paging::Permissions (!val ? 0 :
                                       !!(val & ATTR_K)                        * Paging::K  |
                                      !(!(val & ATTR_nX1) ^ !(val & ATTR_nX0)) * Paging::XS |
                                        !(val & ATTR_nX1)                      * Paging::XU |
-                                      !!(val & ATTR_W)                        * Paging::W  |
+                                      !!(val & (ATTR_W | ATTR_L))             * Paging::W  |
                                       !!(val & ATTR_R)                        * Paging::R);
         }
 
@@ -78,6 +79,19 @@ class Npt final : public Pagetable<Npt, uint64, uint64, 3, 3, true>::Entry
 
         Memattr::Shareability page_sh() const { return Memattr::Shareability (val >> 8 & BIT_RANGE (1, 0)); }
 
+        // Dirty logging write-protects clean leaf PTEs
+        bool  is_dirty()     const { return val & ATTR_W; }
+        Entry clean()        const { return (val & ~ATTR_W) | ATTR_L; }
+        Entry dirty()        const { return (val & ~ATTR_L) | ATTR_W; }
+
+        bool  is_protected() const { return val & ATTR_L; }
+        Entry unprotect()    const { return (val & ~ATTR_L) | ATTR_W; }
+
+        // Working-set estimation clears the access flag, whose absence faults upon the next access
+        bool  is_accessed()  const { return val & ATTR_A; }
+        Entry unaccessed()   const { return val & ~ATTR_A; }
+        Entry accessed()     const { return val | ATTR_A; }
+
         // Needed by gcc version < 10
         ALWAYS_INLINE inline Npt() : Entry() {}
         ALWAYS_INLINE inline Npt (Entry x) : Entry (x) {}
@@ -93,8 +107,11 @@ class Nptp final : public Pagetable<Npt, uint64, uint64, 3, 3, true>
         ALWAYS_INLINE
         inline explicit Nptp (OAddr v = 0) : Pagetable (Npt (v)) {}
 
+        bool unprotect (uint64);
+        bool touch (uint64);
+
         ALWAYS_INLINE
-        inline void make_current (Vmid vmid) const
+        inline void make_current (uint16 vmid) const
         {
             uint64 vttbr = static_cast<uint64>(vmid) << 48 | root_addr();
 
@@ -103,7 +120,7 @@ class Nptp final : public Pagetable<Npt, uint64, uint64, 3, 3, true>
         }
 
         ALWAYS_INLINE
-        inline void invalidate (Vmid vmid) const
+        inline void invalidate (uint16 vmid) const
         {
             make_current (vmid);
 
@@ -114,6 +131,29 @@ class Nptp final : public Pagetable<Npt, uint64, uint64, 3, 3, true>
                           : : : "memory");
         }
 
+        // Ranges up to this size are invalidated page by page, larger ranges are flushed entirely
+        static constexpr uint64 max_inv { 32 * PAGE_SIZE };
+
+        ALWAYS_INLINE
+        inline void invalidate (uint16 vmid, uint64 addr, uint64 size) const
+        {
+            if (size > max_inv)
+                return invalidate (vmid);
+
+            make_current (vmid);
+
+            asm volatile ("dsb  ishst" : : : "memory");    // Ensure PTE writes have completed
+
+            for (auto a { addr }; a < addr + size; a += PAGE_SIZE)
+                asm volatile ("tlbi ipas2e1is, %x0" : : "rZ" (a >> PAGE_BITS) : "memory");  // Invalidate stage-2 TLB entries by IPA
+
+            asm volatile ("dsb  ish             ;"  // Ensure stage-2 TLB invalidation completed
+                          "tlbi vmalle1is       ;"  // Invalidate combined stage-1/stage-2 TLB entries
+                          "dsb  ish             ;"  // Ensure TLB invalidation completed
+                          "isb                  ;"  // Ensure subsequent instructions use new PTEs
+                          : : : "memory");
+        }
+
         ALWAYS_INLINE
         static inline void init() { current = 0; }  // Reset at resume time
 };
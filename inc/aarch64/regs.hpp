@@ -27,6 +27,7 @@ class Space_hst;
 class Space_obj;
 class Space_pio;
 class Vmcb;
+class Vpe;
 
 struct Sys_regs
 {
@@ -71,6 +72,7 @@ struct alignas (16) Cpu_regs final
     Space_obj *   const obj;
     Space_hst *   const hst;
     Space_gst *         gst     { nullptr };
+    Vpe *               vpe     { nullptr };
     Hazard              hazard  { 0 };
 
     inline Cpu_regs (Space_obj *o, Space_hst *h, Space_pio * = nullptr) : vmcb (nullptr), obj (o), hst (h) {}
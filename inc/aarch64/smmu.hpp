@@ -18,11 +18,11 @@
 #pragma once
 
 #include "list.hpp"
+#include "mcslock.hpp"
 #include "memory.hpp"
 #include "ptab_hpt.hpp"
 #include "sdid.hpp"
 #include "slab.hpp"
-#include "spinlock.hpp"
 #include "std.hpp"
 #include "types.hpp"
 
@@ -163,7 +163,7 @@ class Smmu final : public List<Smmu>
         Mode                mode            { 0 };              // SMMU Mode
         Config *            config          { nullptr };        // Configuration Table Pointer
         Board::Smmu const & board;                              // SMMU Board Setup
-        Spinlock            lock;                               // SMMU Lock
+        Mcslock             lock;                               // SMMU Lock
 
         static Slab_cache       cache;                          // SMMU Slab Cache
         static inline Smmu *    list        { nullptr };        // SMMU List
@@ -19,6 +19,7 @@
 
 #include "ptab_npt.hpp"
 #include "space_mem.hpp"
+#include "vmid.hpp"
 
 class Space_gst final : public Space_mem<Space_gst>
 {
@@ -28,7 +29,11 @@ class Space_gst final : public Space_mem<Space_gst>
 
         inline Space_gst (Pd *p) : Space_mem (Kobject::Subtype::GST, p) {}
 
+        inline ~Space_gst() { nptp.root_fini(); }
+
     public:
+        typedef Nptp::Cursor Cursor;
+
         static constexpr auto num { BIT64 (Nptp::lev * Nptp::bpl) };
 
         [[nodiscard]] static inline Space_gst *create (Status &s, Slab_cache &cache, Pd *pd)
@@ -48,11 +53,73 @@ class Space_gst final : public Space_mem<Space_gst>
             return nullptr;
         }
 
-        inline void destroy (Slab_cache &cache) { operator delete (this, cache); }
+        inline void destroy (Slab_cache &cache) { this->~Space_gst(); operator delete (this, cache); }
+
+        static void free (Rcu_elem *e) { auto const o { static_cast<Space_gst *>(e) }; o->get_pd()->reclaim (o); }
+
+        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh, Cursor *c = nullptr) { return nptp.update (v, p, o, pm, ca, sh, false, c); }
+
+        inline void sync (uint64 v, uint64 s) { nptp.invalidate (vmid.get(), v, s); }
+
+        inline void make_current() { nptp.make_current (vmid.get()); }
 
-        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh) { return nptp.update (v, p, o, pm, ca, sh); }
+        /*
+         * Harvest the dirty state of a range
+         *
+         * @param v     Guest page number of the range
+         * @param o     Page order of the range
+         * @param bmp   Dirty bitmap of the range (one bit per page)
+         * @return      SUCCESS
+         */
+        inline Status harvest (uint64 v, unsigned o, uint64 *bmp)
+        {
+            auto const s { v << PAGE_BITS }, e { s + BITN (o + PAGE_BITS) };
+
+            uint64 lo { e }, hi { s };
+
+            nptp.harvest (s, e, bmp, lo, hi);
 
-        inline void sync() { nptp.invalidate (vmid); }
+            // Only the write-protected part of the range needs a TLB invalidation
+            if (lo < hi)
+                sync (lo, hi - lo);
 
-        inline void make_current() { nptp.make_current (vmid); }
+            return Status::SUCCESS;
+        }
+
+        /*
+         * Sample and clear the accessed state of a range
+         *
+         * @param v     Guest page number of the range
+         * @param o     Page order of the range
+         * @param bmp   Accessed bitmap of the range (one bit per page)
+         * @return      SUCCESS
+         */
+        inline Status age (uint64 v, unsigned o, uint64 *bmp)
+        {
+            auto const s { v << PAGE_BITS }, e { s + BITN (o + PAGE_BITS) };
+
+            uint64 lo { e }, hi { s };
+
+            nptp.age (s, e, bmp, lo, hi);
+
+            // One invalidation for the cleared part of the range, so that subsequent accesses fault again
+            if (lo < hi)
+                sync (lo, hi - lo);
+
+            return Status::SUCCESS;
+        }
+
+        // The TLB does not hold translations without the access flag, so setting it requires no invalidation
+        inline bool touch (uint64 v) { return nptp.touch (v); }
+
+        inline bool unprotect (uint64 v)
+        {
+            if (!nptp.unprotect (v))
+                return false;
+
+            // The TLB may still hold the write-protected translation
+            sync (v & ~OFFS_MASK, PAGE_SIZE);
+
+            return true;
+        }
 };
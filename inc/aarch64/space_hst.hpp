@@ -19,6 +19,7 @@
 
 #include "ptab_npt.hpp"
 #include "space_mem.hpp"
+#include "vmid.hpp"
 
 class Space_hst final : public Space_mem<Space_hst>
 {
@@ -30,9 +31,13 @@ class Space_hst final : public Space_mem<Space_hst>
 
         inline Space_hst (Pd *p) : Space_mem (Kobject::Subtype::HST, p) {}
 
+        inline ~Space_hst() { nptp.root_fini(); }
+
     public:
         static Space_hst nova;
 
+        typedef Nptp::Cursor Cursor;
+
         static constexpr auto num { BIT64 (Nptp::lev * Nptp::bpl) };
 
         [[nodiscard]] static inline Space_hst *create (Status &s, Slab_cache &cache, Pd *pd)
@@ -52,15 +57,43 @@ class Space_hst final : public Space_mem<Space_hst>
             return nullptr;
         }
 
-        inline void destroy (Slab_cache &cache) { operator delete (this, cache); }
+        inline void destroy (Slab_cache &cache) { this->~Space_hst(); operator delete (this, cache); }
+
+        static void free (Rcu_elem *e) { auto const o { static_cast<Space_hst *>(e) }; o->get_pd()->reclaim (o); }
 
-        inline auto lookup (uint64 v, uint64 &p, unsigned &o, Memattr::Cacheability &ca, Memattr::Shareability &sh) const { return nptp.lookup (v, p, o, ca, sh); }
+        inline auto lookup (uint64 v, uint64 &p, unsigned &o, Memattr::Cacheability &ca, Memattr::Shareability &sh, Cursor *c = nullptr) const { return nptp.lookup (v, p, o, ca, sh, c); }
 
-        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh) { return nptp.update (v, p, o, pm, ca, sh); }
+        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh, Cursor *c = nullptr) { return nptp.update (v, p, o, pm, ca, sh, false, c); }
 
-        inline void sync() { nptp.invalidate (vmid); }
+        inline void sync (uint64 v, uint64 s) { nptp.invalidate (vmid.get(), v, s); }
+
+        inline void make_current() { nptp.make_current (vmid.get()); }
+
+        /*
+         * Sample and clear the accessed state of a range
+         *
+         * @param v     Page number of the range
+         * @param o     Page order of the range
+         * @param bmp   Accessed bitmap of the range (one bit per page)
+         * @return      SUCCESS
+         */
+        inline Status age (uint64 v, unsigned o, uint64 *bmp)
+        {
+            auto const s { v << PAGE_BITS }, e { s + BITN (o + PAGE_BITS) };
+
+            uint64 lo { e }, hi { s };
+
+            nptp.age (s, e, bmp, lo, hi);
+
+            // One invalidation for the cleared part of the range, so that subsequent accesses fault again
+            if (lo < hi)
+                sync (lo, hi - lo);
+
+            return Status::SUCCESS;
+        }
 
-        inline void make_current() { nptp.make_current (vmid); }
+        // The TLB does not hold translations without the access flag, so setting it requires no invalidation
+        inline bool touch (uint64 v) { return nptp.touch (v); }
 
         static void user_access (uint64 addr, size_t size, bool a) { Space_mem::user_access (nova, addr, size, a, Memattr::Cacheability::DEV, Memattr::Shareability::NONE); }
 };
@@ -18,24 +18,54 @@
 #pragma once
 
 #include "atomic.hpp"
+#include "compiler.hpp"
 #include "macros.hpp"
+#include "spinlock.hpp"
 #include "types.hpp"
 
+/*
+ * VMIDs are shared by all CPUs, because broadcast TLB maintenance operations target a VMID in the
+ * entire inner-shareable domain. Once all VMIDs of a generation are used up, a new generation starts
+ * with a single broadcast TLB flush. The VMIDs that CPUs use at that point remain reserved, because
+ * these CPUs keep running with them until they switch to another space.
+ */
 class Vmid final
 {
     private:
-        uint16 const val;
+        Atomic<uint64> tag { 0 };                       // Generation and VMID of the space
 
-        static inline Atomic<uint16> allocator { 0 };
+        static constexpr auto bits { 8 };
 
-        // FIXME: Handle overflow
-        static inline auto alloc()
-        {
-            return allocator++;
-        }
+        static Atomic<uint64>   active      CPULOCAL;   // Tag that the CPU uses, or 0 after a rollover
+        static uint64           reserved    CPULOCAL;   // Tag that the CPU used during the last rollover
+
+        static Atomic<uint64>   generation;
+        static uint64           map[BIT (bits) / 64];
+        static unsigned         next;
+        static Spinlock         lock;
+
+        static bool reserve (uint64, uint64);
+        static void rollover();
+
+        uint64 alloc();
+        uint16 assign();
 
     public:
-        inline Vmid() : val (alloc()) {}
+        /*
+         * Determine the VMID of the space and record it as being in use on the current CPU
+         *
+         * @return  VMID
+         */
+        ALWAYS_INLINE
+        inline uint16 get()
+        {
+            auto t { tag.load() };
+            auto o { active.load() };
 
-        inline operator auto() const { return val & BIT_RANGE (7, 0); }
+            // The cmpxchg fails if a concurrent rollover has reset the active tag of this CPU
+            if (EXPECT_TRUE (o && !((t ^ generation) >> bits) && active.compare_exchange (o, t)))
+                return static_cast<uint16>(t & BIT_RANGE (bits - 1, 0));
+
+            return assign();
+        }
 };
@@ -0,0 +1,90 @@
+/*
+ * Virtual Processing Element (GICv4)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "gicr.hpp"
+#include "kmem.hpp"
+#include "slab.hpp"
+#include "spinlock.hpp"
+#include "types.hpp"
+
+/*
+ * A vPE is the GICv4 representation of a vCPU. The ITS translates MSIs into
+ * vLPIs of a vPE and sets them pending in its virtual pending table (VPT).
+ * While the vPE is resident on a redistributor, pending vLPIs are signaled
+ * to the virtual CPU interface without involving the hypervisor. Otherwise
+ * the ITS rings the doorbell of the MSI, which is a physical LPI.
+ */
+class Vpe final
+{
+    public:
+        static constexpr unsigned num  { 256 };     // Number of vPEs
+        static constexpr unsigned bits {  14 };     // Number of vINTID bits
+        static constexpr unsigned base { 8192 };    // First vLPI INTID
+
+    private:
+        void *      const vpt;                      // Virtual Pending Table
+        uint16      const vid;                      // vPEID
+        unsigned    const cpu;                      // CPU the vPE is mapped to
+
+        static Slab_cache   cache;
+        static Spinlock     lock;
+        static uint64       map[num / 64];
+
+        Vpe (void *, uint16, unsigned);
+
+    public:
+        [[nodiscard]] static Vpe *create (unsigned);
+
+        ~Vpe();
+
+        inline auto id() const { return vid; }
+
+        static inline bool valid (uint32 v) { return v >= base && v < BIT (bits); }
+
+        /*
+         * Make the vPE resident on the current CPU
+         */
+        ALWAYS_INLINE
+        inline void schedule() const
+        {
+            Gicr::schedule (Kmem::ptr_to_phys (vpt));
+        }
+
+        /*
+         * Make the vPE non-resident on the current CPU
+         *
+         * @return      true if vLPIs of the vPE are pending, false otherwise
+         */
+        ALWAYS_INLINE
+        inline bool deschedule() const
+        {
+            return Gicr::deschedule (Kmem::ptr_to_phys (vpt));
+        }
+
+        [[nodiscard]] static inline void *operator new (size_t) noexcept
+        {
+            return cache.alloc();
+        }
+
+        static inline void operator delete (void *ptr)
+        {
+            if (EXPECT_TRUE (ptr))
+                cache.free (ptr);
+        }
+};
@@ -26,6 +26,7 @@
 #include "kmem.hpp"
 #include "kobject.hpp"
 #include "lock_guard.hpp"
+#include "mcslock.hpp"
 #include "pd.hpp"
 #include "queue.hpp"
 #include "regs.hpp"
@@ -38,6 +39,8 @@ class Utcb;
 class Ec : public Kobject, private Queue<Sc>, public Queue<Ec>::Element
 {
     friend class Ec_arch;
+    friend class Interrupt;
+    friend class Sm;
     friend class Tlb;
 
     private:
@@ -51,8 +54,9 @@ class Ec : public Kobject, private Queue<Sc>, public Queue<Ec>::Element
         Ec *                callee      { nullptr };
         Ec *                caller      { nullptr };
         Atomic<cont_t>      cont        { nullptr };
+        Atomic<Sm *>        blk         { nullptr };        // Semaphore the EC is blocked on
         Timeout_hypercall   timeout     { this };
-        Spinlock            lock;
+        Mcslock             lock;
 
         static Atomic<Ec *> current asm ("current") CPULOCAL;
         static Ec *         fpowner                 CPULOCAL;
@@ -172,14 +176,21 @@ class Ec : public Kobject, private Queue<Sc>, public Queue<Ec>::Element
         void sys_finish_status (Status);
 
         // Constructor: Kernel Thread
-        Ec (Space_hst *h, unsigned c, cont_t x) : Kobject (Kobject::Type::EC, Kobject::Subtype::EC_GLOBAL), regs (nullptr, h), evt (0), cpu (c), fpu (nullptr), utcb (nullptr), cont (x) {}
+        Ec (Space_hst *h, unsigned c, cont_t x) : Kobject (Kobject::Type::EC, free, Kobject::Subtype::EC_GLOBAL), regs (nullptr, h), evt (0), cpu (c), fpu (nullptr), utcb (nullptr), cont (x) {}
 
         // Constructor: User Thread
-        Ec (Space_obj *o, Space_hst *h, Space_pio *p, Fpu *f, Utcb *u, unsigned c, unsigned long e, bool t, cont_t x) : Kobject (Kobject::Type::EC, t ? Kobject::Subtype::EC_GLOBAL : Kobject::Subtype::EC_LOCAL), regs (o, h, p), evt (e), cpu (c), fpu (f), utcb (u), cont (x) {}
+        Ec (Space_obj *o, Space_hst *h, Space_pio *p, Fpu *f, Utcb *u, unsigned c, unsigned long e, bool t, cont_t x) : Kobject (Kobject::Type::EC, free, t ? Kobject::Subtype::EC_GLOBAL : Kobject::Subtype::EC_LOCAL), regs (o, h, p), evt (e), cpu (c), fpu (f), utcb (u), cont (x) {}
 
         // Constructor: Virtual CPU
         template <typename T>
-        Ec (Space_obj *o, Space_hst *h, Fpu *f, T *v, unsigned c, unsigned long e, bool t, cont_t x) : Kobject (Kobject::Type::EC, t ? Kobject::Subtype::EC_VCPU_OFFS : Kobject::Subtype::EC_VCPU_REAL), regs (o, h, v), evt (e), cpu (c), fpu (f), utcb (nullptr), cont (x) {}
+        Ec (Space_obj *o, Space_hst *h, Fpu *f, T *v, unsigned c, unsigned long e, bool t, cont_t x) : Kobject (Kobject::Type::EC, free, t ? Kobject::Subtype::EC_VCPU_OFFS : Kobject::Subtype::EC_VCPU_REAL), regs (o, h, v), evt (e), cpu (c), fpu (f), utcb (nullptr), cont (x) {}
+
+        ~Ec();
+
+        [[nodiscard]] static bool acquire_spaces (Space_obj *, Space_hst *, Space_pio *);
+        static void release_spaces (Space_obj *, Space_hst *, Space_pio *);
+
+        static void free (Rcu_elem *);
 
     public:
         // Factory: Kernel Thread
@@ -189,9 +200,9 @@ class Ec : public Kobject, private Queue<Sc>, public Queue<Ec>::Element
         [[nodiscard]] static Ec *create (Status &s, Pd *, bool, unsigned, unsigned long, bool, uintptr_t, uintptr_t);
 
         // Factory: Virtual CPU
-        [[nodiscard]] static Ec *create (Status &s, Pd *, bool, unsigned, unsigned long, bool);
+        [[nodiscard]] static Ec *create (Status &s, Pd *, bool, unsigned, unsigned long, bool, uintptr_t);
 
-        inline void destroy() { operator delete (this, cache); }
+        void destroy();
 
         static void create_idle();
         static void create_root();
@@ -205,20 +216,22 @@ class Ec : public Kobject, private Queue<Sc>, public Queue<Ec>::Element
         }
 
         /*
-         * Mark the EC as blocked using a sentinel continuation
+         * Mark the EC as blocked on a semaphore using a sentinel continuation
          *
+         * Must be called with the lock of the semaphore held.
          * Ordering: RELAXED because on the same CPU as blocked()
          */
         ALWAYS_INLINE
-        inline void block() { cont.store (blocking, __ATOMIC_RELAXED); }
+        inline void block (Sm *s) { blk = s; cont.store (blocking, __ATOMIC_RELAXED); }
 
         /*
          * Mark the EC as unblocked using a non-sentinel continuation
          *
+         * Must be called with the lock of the semaphore held.
          * Ordering: RELEASE to synchronize with a concurrent blocked() on a different CPU, RELAXED if on the same CPU as blocked()
          */
         ALWAYS_INLINE
-        inline void unblock (cont_t c, bool same_cpu) { cont.store (c, same_cpu ? __ATOMIC_RELAXED : __ATOMIC_RELEASE); }
+        inline void unblock (cont_t c, bool same_cpu) { blk = nullptr; cont.store (c, same_cpu ? __ATOMIC_RELAXED : __ATOMIC_RELEASE); }
 
         /*
          * Determine if the EC is blocked
@@ -242,7 +255,7 @@ class Ec : public Kobject, private Queue<Sc>, public Queue<Ec>::Element
         [[nodiscard]]
         bool block_sc()
         {
-            {   Lock_guard <Spinlock> guard (lock);
+            {   Lock_guard <Mcslock> guard (lock);
 
                 // If C already happened, then don't block the SC
                 if (!blocked())
@@ -258,15 +271,15 @@ class Ec : public Kobject, private Queue<Sc>, public Queue<Ec>::Element
         ALWAYS_INLINE
         void unblock_sc()
         {
-            Lock_guard <Spinlock> guard (lock);
+            Lock_guard <Mcslock> guard (lock);
 
             for (Sc *sc; (sc = dequeue_head()); Scheduler::unblock (sc)) ;
         }
 
         ALWAYS_INLINE
-        inline void set_timeout (uint64 t, Sm *s)
+        inline void set_timeout (uint64 t, uint64 l, Sm *s)
         {
-            timeout.enqueue (t, s);
+            timeout.enqueue (t, l, s);
         }
 
         ALWAYS_INLINE
@@ -39,6 +39,7 @@ class Hazard final
             RCU         = BIT  (2),
             BOOT_HST    = BIT  (8),
             BOOT_GST    = BIT  (9),
+            MSR         = BIT (14),     // x86 only
             TR          = BIT (15),     // x86 only
             FPU         = BIT (16),
             TSC         = BIT (29),     // x86 only
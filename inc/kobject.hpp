@@ -21,11 +21,13 @@
 
 #pragma once
 
+#include "atomic.hpp"
 #include "macros.hpp"
+#include "rcu.hpp"
 #include "slab.hpp"
 #include "types.hpp"
 
-class Kobject
+class Kobject : public Rcu_elem
 {
     friend class Capability;
 
@@ -59,11 +61,19 @@ class Kobject
             MSR             = 6,
         };
 
+    private:
+        Atomic<uint32>  refcnt  { 1 };
+
     protected:
         Type    const   type;
         Subtype const   subtype;
 
-        inline explicit Kobject (Type t, Subtype s = Subtype::NONE) : type (t), subtype (s) {}
+        /*
+         * The initial reference is owned by the capability that is created for the object.
+         * When the last reference is dropped, the object is reclaimed by the specified
+         * function once all CPUs have passed through a quiescent state.
+         */
+        inline explicit Kobject (Type t, void (*f)(Rcu_elem *), Subtype s = Subtype::NONE) : Rcu_elem (f), type (t), subtype (s) {}
 
         [[nodiscard]] static inline void *operator new (size_t, Slab_cache &cache) noexcept
         {
@@ -75,4 +85,28 @@ class Kobject
             if (EXPECT_TRUE (ptr))
                 cache.free (ptr);
         }
+
+    public:
+        /*
+         * Acquire a reference
+         *
+         * @return      true if successful, false if the object is already being reclaimed
+         */
+        [[nodiscard]] inline bool add_ref()
+        {
+            for (uint32 o { refcnt }, n; o; )
+                if (refcnt.compare_exchange (o, n = o + 1))
+                    return true;
+
+            return false;
+        }
+
+        /*
+         * Release a reference
+         */
+        inline void del_ref()
+        {
+            if (!--refcnt)
+                Rcu::call (this);
+        }
 };
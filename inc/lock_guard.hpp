@@ -21,6 +21,7 @@
 #pragma once
 
 #include "compiler.hpp"
+#include "lockprof.hpp"
 
 template <typename T>
 class Lock_guard final
@@ -28,12 +29,42 @@ class Lock_guard final
     private:
         T &lock;
 
+#ifdef DEBUG
+        Lockprof::Site *const site;
+        uint64 tacq;
+
+    public:
+        ALWAYS_INLINE
+        inline Lock_guard (T &l, char const *f = __builtin_FILE(), unsigned n = __builtin_LINE()) : lock (l), site (Lockprof::lookup (f, n))
+        {
+            auto const t { Lockprof::time() };
+
+            lock.lock();
+
+            tacq = Lockprof::time();
+
+            if (site)
+                site->acquired (tacq - t);
+        }
+
+        ALWAYS_INLINE
+        inline ~Lock_guard()
+        {
+            auto const t { Lockprof::time() };
+
+            lock.unlock();
+
+            if (site)
+                site->released (t - tacq);
+        }
+#else
     public:
         ALWAYS_INLINE
         inline Lock_guard (T &l) : lock (l) { lock.lock(); }
 
         ALWAYS_INLINE
         inline ~Lock_guard() { lock.unlock(); }
+#endif
 
         Lock_guard            (Lock_guard const &) = delete;
         Lock_guard& operator= (Lock_guard const &) = delete;
@@ -0,0 +1,77 @@
+/*
+ * Lock Contention Profiler
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "atomic.hpp"
+#include "status.hpp"
+#include "types.hpp"
+
+/*
+ * Per-site lock statistics, recorded by Lock_guard in DEBUG builds. A site
+ * is identified by the source file and line of the Lock_guard declaration.
+ */
+class Lockprof final
+{
+#ifdef DEBUG
+    public:
+        class Histogram final
+        {
+            private:
+                static constexpr unsigned buckets { 16 };
+
+                Atomic<uint32> cnt[buckets] { 0 };
+
+            public:
+                void add (uint64);
+                void dump (char const *, unsigned, char const *) const;
+        };
+
+        class Site final
+        {
+            friend class Lockprof;
+
+            private:
+                Atomic<uint64>  key     { 0 };      // file[63:16] line[15:0]
+                char const *    file    { nullptr };
+                unsigned        line    { 0 };
+                Atomic<uint64>  count   { 0 };      // Number of acquisitions
+                Atomic<uint64>  spin    { 0 };      // Accumulated spin time
+                Atomic<uint64>  hold    { 0 };      // Maximum hold time
+                Histogram       hist_wait;          // Wait times
+                Histogram       hist_hold;          // Hold times
+
+            public:
+                void acquired (uint64);
+                void released (uint64);
+        };
+
+        static Site *lookup (char const *, unsigned);
+
+        static uint64 time();
+
+        static Status dump();
+
+    private:
+        static constexpr unsigned sites { 256 };
+
+        static Site site[sites];
+#else
+    public:
+        static inline auto dump() { return Status::BAD_FTR; }
+#endif
+};
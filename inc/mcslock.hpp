@@ -0,0 +1,73 @@
+/*
+ * Queued (MCS) Spinlock
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "atomic.hpp"
+#include "macros.hpp"
+#include "types.hpp"
+
+/*
+ * The uncontended case acquires the lock with a single CAS on the lock word.
+ * Contending CPUs queue up behind the tail and each spins on its own per-CPU
+ * queue node, so that only the head of the queue polls the lock word. The
+ * per-CPU queue nodes must be mapped, so locks that are taken before a CPU
+ * is initialized must remain ticket spinlocks.
+ */
+class Mcslock final
+{
+    private:
+        uint32 val { 0 };       // cpu+1[31:10] idx[9:8] locked[7:0]
+
+        static constexpr uint32 locked  { BIT (0) };
+        static constexpr uint32 tail    { BIT_RANGE (31, 8) };
+
+        struct Node
+        {
+            Atomic<Node *>  next    { nullptr };
+            Atomic<bool>    wait    { false };
+        };
+
+        static constexpr unsigned nodes { 4 };      // Maximum nesting depth
+
+        static Node     node[nodes] CPULOCAL;
+        static unsigned depth       CPULOCAL;
+
+        void contended();
+
+    public:
+        ALWAYS_INLINE
+        inline void lock()
+        {
+            uint32 o { 0 };
+
+            if (EXPECT_FALSE (!__atomic_compare_exchange_n (&val, &o, locked, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)))
+                contended();
+        }
+
+        ALWAYS_INLINE
+        inline void unlock()
+        {
+            // Only the owner writes the locked byte, so a plain release store suffices
+            __atomic_store_n (reinterpret_cast<uint8 *>(&val), 0, __ATOMIC_RELEASE);
+        }
+
+        Mcslock() = default;
+
+        Mcslock            (Mcslock const &) = delete;
+        Mcslock& operator= (Mcslock const &) = delete;
+};
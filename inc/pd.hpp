@@ -58,6 +58,9 @@ class Pd final : public Kobject
         inline auto attach (Kobject::Subtype s) { return !spaces.test_and_set (BIT (std::to_underlying (s))); }
         inline void detach (Kobject::Subtype s) { spaces &= ~BIT (std::to_underlying (s)); }
 
+        template <typename T> bool retire (Atomic<T *> &, T *, Kobject::Subtype);
+        template <typename T> void release (T *, Slab_cache &);
+
         static Slab_cache cache;
 
     public:
@@ -77,10 +80,19 @@ class Pd final : public Kobject
 
         inline void destroy() { operator delete (this, cache); }
 
+        static void free (Rcu_elem *e) { static_cast<Pd *>(e)->destroy(); }
+
         inline Space_obj *get_obj() const { return space_obj; }
         inline Space_hst *get_hst() const { return space_hst; }
         inline Space_pio *get_pio() const { return space_pio; }
 
+        void reclaim (Space_dma *);
+        void reclaim (Space_gst *);
+        void reclaim (Space_hst *);
+        void reclaim (Space_msr *);
+        void reclaim (Space_obj *);
+        void reclaim (Space_pio *);
+
         Space_dma *create_dma (Status &, Space_obj *, unsigned long);
         Space_gst *create_gst (Status &, Space_obj *, unsigned long);
         Space_hst *create_hst (Status &, Space_obj *, unsigned long);
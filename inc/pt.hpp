@@ -41,18 +41,12 @@ class Pt final : public Kobject
 
         Pt (Ec *, uintptr_t);
 
-    public:
-        [[nodiscard]] static inline Pt *create (Status &s, Ec *e, uintptr_t i)
-        {
-            auto const pt { new (cache) Pt (e, i) };
-
-            if (EXPECT_FALSE (!pt))
-                s = Status::INS_MEM;
+        static void free (Rcu_elem *e) { static_cast<Pt *>(e)->destroy(); }
 
-            return pt;
-        }
+    public:
+        [[nodiscard]] static Pt *create (Status &, Ec *, uintptr_t);
 
-        inline void destroy() { operator delete (this, cache); }
+        void destroy();
 
         ALWAYS_INLINE
         inline uintptr_t get_id() const { return id; }
@@ -34,6 +34,9 @@
 template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
 class Pagetable
 {
+    private:
+        struct Table;
+
     public:
         typedef I IAddr;
         typedef O OAddr;
@@ -58,6 +61,20 @@ class Pagetable
                 ALWAYS_INLINE inline auto operator->() const { return static_cast<Table *>(Kmem::phys_to_ptr (addr())); }
                 ALWAYS_INLINE inline bool operator== (Entry const &x) const { return val == x.val; }
 
+                // Dirty logging and working-set estimation, which formats with such state override
+                static bool dirty_summary()    { return false; }    // Table PTEs summarize the dirty leaf PTEs below
+                static bool accessed_summary() { return false; }    // Table PTEs summarize the accessed PTEs below
+
+                bool  is_dirty()       const { return true; }
+                Entry clean()          const { return *this; }
+                Entry dirty()          const { return *this; }
+
+                bool  is_summary()     const { return true; }
+                Entry summary (bool)   const { return *this; }
+
+                bool  is_accessed()    const { return true; }
+                Entry unaccessed()     const { return *this; }
+
                 ALWAYS_INLINE inline Entry() = default;
                 ALWAYS_INLINE inline Entry (OAddr v) : val (v) {}
 
@@ -65,9 +82,41 @@ class Pagetable
                 OAddr val;
         };
 
-        Paging::Permissions lookup (IAddr, OAddr &, unsigned &, Memattr::Cacheability &, Memattr::Shareability &) const;
+        /*
+         * Walk Cursor
+         *
+         * Remembers the page tables along previous walks, so that walks for nearby addresses can resume
+         * at the deepest page table covering them instead of starting at the root. A cursor must only be
+         * used for the duration of a single operation on a single page table.
+         *
+         * A cursor can also enable promotion of fully populated page tables to large pages. This is only
+         * safe for page tables whose lower levels are not shared with other page tables (e.g., the kernel
+         * mappings in the master page table) and therefore must be requested explicitly.
+         */
+        class Cursor
+        {
+            friend class Pagetable;
+
+            private:
+                Table * tbl[L] { nullptr };     // Page table holding the PTEs of a level
+                IAddr   tag[L] { 0 };           // Address bits above that page table
+                bool    const promote;          // Promote fully populated page tables
+
+                static constexpr auto shft (unsigned l) { return (l + 1) * bpl + PAGE_BITS; }
+
+                ALWAYS_INLINE inline bool hit (unsigned l, IAddr v) const { return tbl[l] && tag[l] == v >> shft (l); }
+
+                ALWAYS_INLINE inline void set (unsigned l, IAddr v, Table *t) { tbl[l] = t; tag[l] = v >> shft (l); }
+
+                ALWAYS_INLINE inline void invalidate (unsigned l) { for (unsigned i = 0; i < l; i++) tbl[i] = nullptr; }
+
+            public:
+                ALWAYS_INLINE inline explicit Cursor (bool p = false) : promote (p) {}
+        };
+
+        Paging::Permissions lookup (IAddr, OAddr &, unsigned &, Memattr::Cacheability &, Memattr::Shareability &, Cursor * = nullptr) const;
 
-        Status update (IAddr, OAddr, unsigned, Paging::Permissions, Memattr::Cacheability, Memattr::Shareability, bool = false);
+        Status update (IAddr, OAddr, unsigned, Paging::Permissions, Memattr::Cacheability, Memattr::Shareability, bool = false, Cursor * = nullptr);
 
         [[nodiscard]]
         inline auto root_init (bool nc, unsigned l = L - 1) { return walk (0, l, true, nc); }
@@ -80,6 +129,12 @@ class Pagetable
             return val;
         }
 
+        void root_fini();
+        void root_fini (IAddr, unsigned);
+
+        void harvest (IAddr, IAddr, uint64 *, IAddr &, IAddr &);
+        void age (IAddr, IAddr, uint64 *, IAddr &, IAddr &);
+
         // Maximum leaf page size: 4 (512GB), 3 (1GB), 2 (2MB), 1 (4KB)
         static inline void set_leaf_max (unsigned l) { lim = min (lim, l * bpl); }
 
@@ -91,9 +146,28 @@ class Pagetable
         inline Pagetable (Entry r) : root (r) {}
 
         [[nodiscard]]
-        PTE *walk (IAddr, unsigned, bool, bool = false);
+        PTE *walk (IAddr, unsigned, bool, bool = false, Cursor * = nullptr);
+
+        void promote (IAddr, unsigned, unsigned, bool, Cursor *);
+
+        static void summarize (PTE *, unsigned);
+
+        // Slots of the page table that a PTE refers to
+        ALWAYS_INLINE
+        static inline PTE *slots (T pte) { return pte->slot; }
 
     private:
+        void scan (PTE *, unsigned, IAddr, IAddr, IAddr, uint64 *, IAddr &, IAddr &);
+        void sample (PTE *, unsigned, IAddr, IAddr, IAddr, uint64 *, IAddr &, IAddr &);
+
+        // Set the bits of pages s to e (exclusive) in a bitmap
+        ALWAYS_INLINE
+        static inline void set_bits (uint64 *bmp, IAddr s, IAddr e)
+        {
+            for (auto i { s }; i < e; i++)
+                bmp[i / 64] |= BIT64 (i % 64);
+        }
+
         struct Table
         {
             static constexpr auto entries { BIT (bpl) };
@@ -110,7 +184,24 @@ class Pagetable
                     Cache::data_clean (this, PAGE_SIZE);
             }
 
-            void deallocate (unsigned);
+            void deallocate (unsigned, bool = true);
+
+            /*
+             * Determine if all PTEs continue the frame range of the first PTE with identical attributes
+             *
+             * @param f     First PTE
+             * @param s     Page size of the PTEs
+             * @return      True if the PTEs are contiguous, false otherwise
+             */
+            ALWAYS_INLINE
+            inline bool contiguous (Entry f, OAddr s) const
+            {
+                for (unsigned i = 1; i < entries; i++)
+                    if (static_cast<Entry>(slot[i]).val != f.val + i * s)
+                        return false;
+
+                return true;
+            }
 
             [[nodiscard]] ALWAYS_INLINE
             static inline void *operator new (size_t) noexcept
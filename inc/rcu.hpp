@@ -0,0 +1,169 @@
+/*
+ * Read-Copy Update (RCU)
+ *
+ * Copyright (C) 2009-2011 Udo Steinberg <udo@hypervisor.org>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "atomic.hpp"
+#include "compiler.hpp"
+#include "mcslock.hpp"
+#include "types.hpp"
+
+class Rcu_elem
+{
+    public:
+        Rcu_elem *rcu_next;
+        void (*rcu_func)(Rcu_elem *);
+
+        ALWAYS_INLINE
+        explicit Rcu_elem (void (*f)(Rcu_elem *)) : rcu_next (nullptr), rcu_func (f) {}
+};
+
+class Rcu_list
+{
+    public:
+        Rcu_elem *  head;
+        Rcu_elem ** tail;
+
+        ALWAYS_INLINE
+        explicit Rcu_list() { clear(); }
+
+        ALWAYS_INLINE
+        inline void clear() { head = nullptr; tail = &head; }
+
+        ALWAYS_INLINE
+        inline void append (Rcu_list *l)
+        {
+           *tail = l->head;
+            tail = l->tail;
+            l->clear();
+        }
+
+        ALWAYS_INLINE
+        inline void enqueue (Rcu_elem *e)
+        {
+            e->rcu_next = nullptr;
+           *tail = e;
+            tail = &e->rcu_next;
+        }
+};
+
+class Rcu
+{
+    private:
+        static mword count;
+        static mword state;
+
+        static Atomic<mword> xpd;                       // Last batch of an expedited grace period
+
+        static mword l_batch    CPULOCAL;
+        static mword c_batch    CPULOCAL;
+
+        static Atomic<mword> q_batch CPULOCAL;          // Last batch for which a quiescent state was reported
+        static Atomic<unsigned> eqs  CPULOCAL;          // Extended quiescent state
+        static unsigned qlen    CPULOCAL;               // Number of callbacks enqueued since the last batch
+
+        static Rcu_list next    CPULOCAL;
+        static Rcu_list curr    CPULOCAL;
+        static Rcu_list done    CPULOCAL;
+
+        // Callbacks enqueued by other CPUs
+        struct Remote
+        {
+            Rcu_list    list;
+            Mcslock     lock;
+        };
+
+        static Remote remote    CPULOCAL;
+
+        enum State
+        {
+            RCU_CMP = 1UL << 0,
+            RCU_PND = 1UL << 1,
+        };
+
+        enum Eqs
+        {
+            EQS_NONE = 0,                               // Not quiescent
+            EQS_IDLE = 1,                               // Quiescent without callbacks
+            EQS_CBS  = 2,                               // Quiescent with callbacks, must be woken when a batch completes
+        };
+
+        // Number of callbacks after which a CPU expedites the grace period
+        static constexpr unsigned qmax { 1024 };
+
+        ALWAYS_INLINE
+        static inline mword batch() { return state >> 2; }
+
+        ALWAYS_INLINE
+        static inline bool complete (mword b) { return static_cast<signed long>((state & ~RCU_PND) - (b << 2)) > 0; }
+
+        ALWAYS_INLINE
+        static inline bool expedited() { return static_cast<signed long>(xpd - batch()) >= 0; }
+
+        static void start_batch (State, mword);
+        static void invoke_batch();
+
+        static void report();
+        static void report (unsigned);
+        static void kick (bool);
+
+    public:
+        ALWAYS_INLINE
+        static inline void call (Rcu_elem *e)
+        {
+            next.enqueue (e);
+
+            if (EXPECT_FALSE (++qlen == qmax))
+                expedite();
+        }
+
+        static void call (Rcu_elem *, unsigned);
+
+        /*
+         * Enter an extended quiescent state, in which the CPU holds no references to RCU-protected
+         * objects, such as when idling or running a vCPU in guest mode
+         *
+         * Either a batch that starts concurrently sees the CPU as quiescent or the CPU sees the batch.
+         */
+        ALWAYS_INLINE
+        static inline void eqs_enter()
+        {
+            eqs.store (curr.head || next.head ? EQS_CBS : EQS_IDLE, __ATOMIC_RELAXED);
+
+            __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+            if (EXPECT_FALSE (q_batch != batch()))
+                report();
+        }
+
+        /*
+         * Leave the extended quiescent state before accessing any RCU-protected object
+         */
+        ALWAYS_INLINE
+        static inline void eqs_exit()
+        {
+            if (EXPECT_FALSE (eqs.load (__ATOMIC_RELAXED))) {
+                eqs.store (EQS_NONE, __ATOMIC_RELAXED);
+                __atomic_thread_fence (__ATOMIC_SEQ_CST);
+            }
+        }
+
+        static void expedite();
+        static void quiet();
+        static void update();
+};
@@ -42,23 +42,19 @@ class Sc final : public Kobject, public Queue<Sc>::Element
         Atomic<uint64>          used                { 0 };
         uint64                  left                { 0 };
         uint64                  last                { 0 };
+        Atomic<bool>            dead                { false };
 
         static Slab_cache       cache;
 
         Sc (unsigned, Ec *, uint16, uint8, uint16);
 
-    public:
-        [[nodiscard]] static inline Sc *create (Status &s, unsigned n, Ec *e, uint16 b, uint8 p, uint16 c)
-        {
-            auto const sc { new (cache) Sc (n, e, b, p, c) };
+        // The SC is reclaimed by the scheduler of its CPU the next time it would become ready
+        static void free (Rcu_elem *e) { static_cast<Sc *>(e)->dead = true; }
 
-            if (EXPECT_FALSE (!sc))
-                s = Status::INS_MEM;
-
-            return sc;
-        }
+    public:
+        [[nodiscard]] static Sc *create (Status &, unsigned, Ec *, uint16, uint8, uint16);
 
-        inline void destroy() { operator delete (this, cache); }
+        void destroy();
 
         ALWAYS_INLINE
         inline auto get_ec() const { return ec; }
@@ -91,10 +87,12 @@ class Scheduler final
             private:
                 Queue<Sc>   queue[priorities];
                 unsigned    prio_top { 0 };
+                Queue<Sc>   zombie;
 
             public:
                 inline void enqueue (Sc *, uint64);
                 inline auto dequeue (uint64);
+                inline void reap();
         };
 
         // Release queue
@@ -22,7 +22,7 @@
 #pragma once
 
 #include "initprio.hpp"
-#include "spinlock.hpp"
+#include "mcslock.hpp"
 
 class Slab_cache final
 {
@@ -33,7 +33,7 @@ class Slab_cache final
         uint16 const    bps;                    // Buffers per Slab
         Slab *          curr    { nullptr };    // Current (Partial) Slab
         Slab *          head    { nullptr };    // Head of Slab List
-        Spinlock        lock;                   // Allocator Spinlock
+        Mcslock         lock;                   // Allocator Spinlock
 
     public:
         [[nodiscard]]
@@ -23,21 +23,86 @@
 #pragma once
 
 #include "ec.hpp"
+#include "util.hpp"
 
 class Sm final : public Kobject, private Queue<Ec>
 {
     private:
-        uint64          counter { 0 };
+        Atomic<int64_t> counter { 0 };          // Count if >= 0, otherwise -(number of committed waiters)
+        uint64          pending { 0 };          // Wakeups for waiters that have not enqueued yet
         unsigned const  id      { 0 };
-        Spinlock        lock;
+        Mcslock         lock;
 
         static Slab_cache cache;
 
         Sm (uint64, unsigned);
 
+        static void free (Rcu_elem *);
+        static void drop (Rcu_elem *);
+
+        /*
+         * Withdraw a blocked EC from waiting
+         *
+         * Must be called on the CPU of the EC.
+         *
+         * The EC withdraws only if some committed waiter is still
+         * unclaimed. Otherwise all waiters, including this EC, are
+         * claimed by up() operations that are about to wake them.
+         *
+         * @param ec    Blocked EC
+         * @param c     Continuation that completes the down operation
+         */
+        ALWAYS_INLINE NONNULL
+        inline void withdraw (Ec *const ec, void (*c)(Ec *))
+        {
+            {   Lock_guard <Mcslock> guard (lock);
+
+                if (!ec->blocked() || ec->blk != this)
+                    return;
+
+                int64_t o { counter.load() }, n;
+
+                do
+                    if (o >= 0)
+                        return;
+                while (!counter.compare_exchange (o, n = o + 1));
+
+                dequeue (ec);
+
+                // The EC can now be activated again
+                ec->unblock (c, true);
+            }
+
+            ec->unblock_sc();
+        }
+
+        ALWAYS_INLINE
+        inline void wake()
+        {
+            Ec *ec;
+
+            {   Lock_guard <Mcslock> guard (lock);
+
+                if (!(ec = dequeue_head())) {
+                    pending++;
+                    return;
+                }
+
+                // The EC can now be activated again
+                ec->unblock (Ec::sys_finish<Status::SUCCESS, true>, false);
+            }
+
+            ec->unblock_sc();
+        }
+
     public:
         [[nodiscard]] static inline Sm *create (Status &s, uint64 c, unsigned i)
         {
+            if (EXPECT_FALSE (c > static_cast<uint64>(__INT64_MAX__))) {
+                s = Status::BAD_PAR;
+                return nullptr;
+            }
+
             auto const sm { new (cache) Sm (c, i) };
 
             if (EXPECT_FALSE (!sm))
@@ -51,18 +116,32 @@ class Sm final : public Kobject, private Queue<Ec>
         ALWAYS_INLINE
         inline auto get_id() const { return id; }
 
+        /*
+         * Down operation
+         *
+         * The counter is decremented with a single atomic operation. If it
+         * was not positive, the EC has committed to waiting and enqueues
+         * itself under the lock, unless an up() has already left a wakeup.
+         */
         ALWAYS_INLINE
-        inline void dn (Ec *const self, bool zero, uint64 t)
+        inline void dn (Ec *const self, bool zero, uint64 t, uint64 l)
         {
-            {   Lock_guard <Spinlock> guard (lock);
+            int64_t o { counter.load() }, n;
 
-                if (counter) {
-                    counter = zero ? 0 : counter - 1;
+            while (!counter.compare_exchange (o, n = o > 0 && zero ? 0 : o - 1)) ;
+
+            if (n >= 0)
+                return;
+
+            {   Lock_guard <Mcslock> guard (lock);
+
+                if (pending) {
+                    pending--;
                     return;
                 }
 
                 // The EC can no longer be activated
-                self->block();
+                self->block (this);
 
                 enqueue_tail (self);
             }
@@ -72,52 +151,50 @@ class Sm final : public Kobject, private Queue<Ec>
             if (self->block_sc()) {
 
                 if (t)
-                    self->set_timeout (t, this);
+                    self->set_timeout (t, l, this);
 
                 Scheduler::schedule (true);
             }
         }
 
+        /*
+         * Up operation
+         *
+         * Without waiters this is a single atomic operation. Otherwise each
+         * of the n units claims one committed waiter, if any, and wakes the
+         * oldest queued EC or leaves a wakeup for a waiter that has not
+         * enqueued yet.
+         *
+         * @param c     Number of units to add to the counter
+         * @return      true if successful, false on counter overflow
+         */
         ALWAYS_INLINE
-        inline bool up()
+        inline bool up (uint64 c = 1)
         {
-            Ec *ec;
+            auto const m { static_cast<int64_t>(c) };
 
-            {   Lock_guard <Spinlock> guard (lock);
+            int64_t o { counter.load() }, n;
 
-                if (!(ec = dequeue_head())) {
-
-                    if (counter == ~0ULL)
-                        return false;
+            do {
+                if (EXPECT_FALSE (o > __INT64_MAX__ - m))
+                    return false;
+            } while (!counter.compare_exchange (o, n = o + m));
 
-                    counter++;
-
-                    return true;
-                }
-
-                // The EC can now be activated again
-                ec->unblock (Ec::sys_finish<Status::SUCCESS, true>, false);
-            }
-
-            ec->unblock_sc();
+            for (auto w { o < 0 ? min (-o, m) : 0 }; w; w--)
+                wake();
 
             return true;
         }
 
+        /*
+         * Timeout of a blocked EC
+         */
         ALWAYS_INLINE NONNULL
-        inline void timeout (Ec *const ec)
-        {
-            {   Lock_guard <Spinlock> guard (lock);
-
-                if (!ec->blocked())
-                    return;
-
-                dequeue (ec);
-
-                // The EC can now be activated again
-                ec->unblock (Ec::sys_finish<Status::TIMEOUT>, true);
-            }
+        inline void timeout (Ec *const ec) { withdraw (ec, Ec::sys_finish<Status::TIMEOUT>); }
 
-            ec->unblock_sc();
-        }
+        /*
+         * Abort the down operation of a blocked EC whose last reference is gone
+         */
+        ALWAYS_INLINE NONNULL
+        inline void abort (Ec *const ec) { withdraw (ec, Ec::sys_finish<Status::ABORTED>); }
 };
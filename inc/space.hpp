@@ -29,7 +29,7 @@ class Space : public Kobject
         Pd *const pd;
 
     protected:
-        inline Space (Kobject::Subtype s, Pd *p) : Kobject (Kobject::Type::PD, s), pd (p) {}
+        inline Space (Kobject::Subtype s, Pd *p, void (*f)(Rcu_elem *)) : Kobject (Kobject::Type::PD, f, s), pd (p) {}
 
     public:
         inline auto get_pd() const { return pd; }
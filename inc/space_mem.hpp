@@ -28,12 +28,14 @@ template <typename T>
 class Space_mem : public Space
 {
     protected:
-        inline Space_mem (Kobject::Subtype s, Pd *p) : Space (s, p) {}
+        inline Space_mem (Kobject::Subtype s, Pd *p) : Space (s, p, T::free) {}
 
         static inline void user_access (T &mem, uint64 addr, size_t size, bool a, Memattr::Cacheability ca, Memattr::Shareability sh)
         {
+            typename T::Cursor c;
+
             for (unsigned o; size; size -= BITN (o), addr += BITN (o))
-                mem.update (addr, addr, (o = static_cast<unsigned>(max_order (addr, size))) - PAGE_BITS, a ? Paging::Permissions (Paging::U | Paging::API) : Paging::NONE, ca, sh);
+                mem.update (addr, addr, (o = static_cast<unsigned>(max_order (addr, size))) - PAGE_BITS, a ? Paging::Permissions (Paging::U | Paging::API) : Paging::NONE, ca, sh, &c);
         }
 
     public:
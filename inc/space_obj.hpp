@@ -30,22 +30,24 @@ class Space_obj final : public Space
 {
     private:
         struct Captable;
+        struct Node;
 
         Atomic<Captable *> root { nullptr };
 
         static constexpr auto lev { 2 };
         static constexpr auto bpl { bit_scan_reverse (PAGE_SIZE / sizeof (Captable *)) };
 
-        inline Space_obj() : Space (Kobject::Subtype::OBJ, nullptr)
+        inline Space_obj() : Space (Kobject::Subtype::OBJ, nullptr, free)
         {
             insert (Selector::NOVA_OBJ, Capability (this, std::to_underlying (Capability::Perm_sp::TAKE)));
         }
 
-        inline Space_obj (Pd *p) : Space (Kobject::Subtype::OBJ, p) {}
+        inline Space_obj (Pd *p) : Space (Kobject::Subtype::OBJ, p, free) {}
 
         ~Space_obj();
 
         Atomic<Capability> *walk (unsigned long, bool);
+        Atomic<Capability> *find (unsigned long) const;
 
     public:
         static Space_obj nova;
@@ -76,11 +78,13 @@ class Space_obj final : public Space
             return obj;
         }
 
-        inline void destroy (Slab_cache &cache) { operator delete (this, cache); }
+        inline void destroy (Slab_cache &cache) { this->~Space_obj(); operator delete (this, cache); }
+
+        static void free (Rcu_elem *e) { auto const o { static_cast<Space_obj *>(e) }; o->get_pd()->reclaim (o); }
 
         Capability lookup (unsigned long) const;
-        Status     update (unsigned long, Capability, Capability &);
         Status     insert (unsigned long, Capability);
 
         Status delegate (Space_obj const *, unsigned long, unsigned long, unsigned, unsigned);
+        Status revoke (unsigned long, unsigned, bool);
 };
@@ -58,6 +58,19 @@ class Stc
             return freq * ms / 1000;
         }
 
+        /*
+         * Convert relative wall clock time to relative system time
+         *
+         * @param us    Relative wall clock time in us
+         * @return      Relative system time in STC ticks
+         */
+        ALWAYS_INLINE
+        static inline auto us_to_ticks (uint32 us)
+        {
+            // Will not overflow if us is at most 32 (4.2 GHz), 31 (8.5 GHz), 30 (17.1 GHz) bits wide
+            return freq * us / 1000000;
+        }
+
         /*
          * Timer interrupt handler
          */
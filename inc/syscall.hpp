@@ -122,6 +122,14 @@ struct Sys_ctrl_pd final : private Sys_abi
 {
     inline Sys_ctrl_pd (Sys_regs &r) : Sys_abi (r) {}
 
+    inline bool revoke() const { return flags() & BIT (0); }
+
+    inline bool self() const { return flags() & BIT (1); }
+
+    inline bool dirty() const { return flags() & BIT (2); }
+
+    inline bool accessed() const { return flags() & BIT (3); }
+
     inline unsigned long src() const { return p0() >> 8; }
 
     inline unsigned long dst() const { return p1(); }
@@ -179,6 +187,8 @@ struct Sys_ctrl_sm final : private Sys_abi
     inline unsigned long sm() const { return p0() >> 8; }
 
     inline uint64 time_ticks() const { return p1(); }
+
+    inline uint64 slack_ticks() const { return flags() & BIT (2) ? p2() : 0; }
 };
 
 struct Sys_ctrl_hw final : private Sys_abi
@@ -202,7 +212,13 @@ struct Sys_assign_int final : private Sys_abi
 
     inline auto dev() const { return static_cast<uint16> (p2()); }
 
-    inline void set_msi_addr (uint32 val) { p1() = val; }
+    inline uint64 mod() const { return p3(); }
+
+    inline unsigned long ec() const { return p4() >> 16; }
+
+    inline auto vec() const { return static_cast<uint16>(p4()); }
+
+    inline void set_msi_addr (uint64 val) { p1() = val; }
 
     inline void set_msi_data (uint16 val) { p2() = val; }
 };
@@ -24,11 +24,16 @@
 class Timeout
 {
     private:
-        uint64              time            { 0 };
-        Timeout *           prev            { nullptr };
-        Timeout *           next            { nullptr };
+        uint64              time            { 0 };              // Deadline
+        uint64              late            { 0 };              // Deadline plus slack
+        Timeout *           prev            { nullptr };    // Parent or left sibling
+        Timeout *           next            { nullptr };    // Right sibling
+        Timeout *           child           { nullptr };    // Leftmost child
 
-        static Timeout *    list            CPULOCAL;
+        static Timeout *    list            CPULOCAL;       // Pairing heap, rooted at the earliest late deadline
+
+        static Timeout *meld (Timeout *, Timeout *);
+        static Timeout *merge (Timeout *);
 
         virtual void trigger() = 0;
 
@@ -37,7 +42,7 @@ class Timeout
         ALWAYS_INLINE
         inline Timeout() {}
 
-        void enqueue (uint64);
+        void enqueue (uint64, uint64 = 0);
         uint64 dequeue();
 
         static void check();
@@ -35,6 +35,6 @@ class Timeout_hypercall final : public Timeout
         ALWAYS_INLINE
         inline Timeout_hypercall (Ec *e) : ec (e) {}
 
-        ALWAYS_INLINE
-        inline void enqueue (uint64 t, Sm *s) { sm = s; Timeout::enqueue (t); }
+        void enqueue (uint64, uint64, Sm *);
+        void dequeue();
 };
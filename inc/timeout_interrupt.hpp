@@ -0,0 +1,61 @@
+/*
+ * Interrupt Moderation Timeout
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "atomic.hpp"
+#include "macros.hpp"
+#include "spinlock.hpp"
+#include "timeout.hpp"
+
+class Sm;
+
+/*
+ * A moderated interrupt delivers at most one SM up operation per delay
+ * interval, carrying the number of arrivals since the previous delivery.
+ * Reaching the arrival threshold delivers early. Arrivals that are held
+ * back are delivered by the timeout at the end of the interval.
+ *
+ * Arrivals, the timeout and reconfiguration may run on different CPUs
+ * and are serialized by the lock.
+ */
+class Timeout_interrupt final : public Timeout
+{
+    private:
+        Sm *            sm          { nullptr };
+        Atomic<uint64>  mod         { 0 };          // delay[63:16] thresh[15:0]
+        Atomic<uint64>  count       { 0 };          // Arrivals not delivered yet
+        Atomic<bool>    armed       { false };
+        unsigned        cpu         { 0 };          // CPU whose timeout heap holds the armed timeout
+        uint64          last        { 0 };          // Time of the last delivery
+        Spinlock        lock;
+
+        void deliver (uint64);
+
+        void trigger() override;
+
+    public:
+        ALWAYS_INLINE
+        inline Timeout_interrupt() {}
+
+        void configure (Sm *, uint64);
+
+        ALWAYS_INLINE
+        inline bool moderated() const { return mod.load(); }
+
+        void arrival();
+};
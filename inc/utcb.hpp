@@ -29,12 +29,18 @@ class Utcb final
     private:
         union {
             uintptr_t mr[Mtd_user::items];
+            uint64    bmp[PAGE_SIZE / sizeof (uint64)];
             Utcb_arch state;
         };
 
     public:
+        static constexpr auto bmp_bits { PAGE_SIZE * 8 };
+
         inline auto arch() { return &state; }
 
+        // Dirty or accessed bitmap returned by ctrl_pd
+        inline auto bitmap() { return bmp; }
+
         inline void copy (Mtd_user mtd, Utcb *dst) const
         {
             for (unsigned i = 0; i < mtd.count(); i++)
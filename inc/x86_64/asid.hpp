@@ -0,0 +1,65 @@
+/*
+ * Address Space Identifier (ASID)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "compiler.hpp"
+#include "macros.hpp"
+#include "types.hpp"
+
+class Asid final
+{
+    private:
+        uint64 tag { 0 };                       // Generation and ASID of the vCPU on its CPU
+
+        static uint64 gen CPULOCAL;             // Generation and most recently assigned ASID of this CPU
+
+        static constexpr auto bits { 32 };
+
+    public:
+        static uint32 num CPULOCAL;             // Number of ASIDs of this CPU
+
+        /*
+         * Determine the ASID of the vCPU on the current CPU
+         *
+         * @return  ASID, or 0 if the vCPU has no ASID in the current generation of the CPU
+         */
+        inline uint32 get() const
+        {
+            return (tag ^ gen) >> bits ? 0 : static_cast<uint32>(tag);
+        }
+
+        /*
+         * Assign a new ASID to the vCPU on the current CPU
+         *
+         * Once all ASIDs are used up, a new generation starts and the translations of all
+         * ASIDs of the CPU must be flushed before any of them is used again.
+         *
+         * @param flush Set to true if a new generation started
+         * @return      ASID
+         */
+        inline uint32 alloc (bool &flush)
+        {
+            // ASID 0 belongs to the host
+            if (EXPECT_FALSE (static_cast<uint32>(++gen) >= num)) {
+                gen = ((gen >> bits) + 1) << bits | 1;
+                flush = true;
+            }
+
+            return static_cast<uint32>(tag = gen);
+        }
+};
@@ -98,6 +98,7 @@ class Cpu final
             HWP_FAM         = 2 * 32 + 18,      // HWP Fast Access Mode
             // 0x7.EBX
             SMEP            = 3 * 32 +  7,      // Supervisor Mode Execution Prevention
+            INVPCID         = 3 * 32 + 10,      // INVPCID Instruction
             RDT_M           = 3 * 32 + 12,      // RDT Monitoring (PQM)
             RDT_A           = 3 * 32 + 15,      // RDT Allocation (PQE)
             SMAP            = 3 * 32 + 20,      // Supervisor Mode Access Prevention
@@ -192,6 +193,8 @@ class Cpu final
             .kernel_gs_base = 0,
         };
 
+        static State    gstate              CPULOCAL;   // Guest SYSCALL state, live while Hazard::MSR is set
+
         static unsigned id                  CPULOCAL_HOT;
         static unsigned hazard              CPULOCAL_HOT;
 
@@ -209,8 +212,8 @@ class Cpu final
         static inline Atomic<unsigned>      online { 0 };
 
         static inline unsigned  count;
-        static inline uint8     acpi_id[NUM_CPU];
-        static inline uint8     apic_id[NUM_CPU];
+        static inline uint32    acpi_id[NUM_CPU];
+        static inline uint32    apic_id[NUM_CPU];
 
         static void init();
         static void fini();
@@ -262,9 +265,9 @@ class Cpu final
         }
 
         ALWAYS_INLINE
-        static unsigned find_by_apic_id (unsigned x)
+        static unsigned find_by_apic_id (uint32 x)
         {
-            for (unsigned i = 0; i < NUM_CPU; i++)
+            for (unsigned i = 0; i < count; i++)
                 if (apic_id[i] == x)
                     return i;
 
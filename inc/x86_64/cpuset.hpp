@@ -22,15 +22,16 @@
 #pragma once
 
 #include "atomic.hpp"
+#include "config.hpp"
 #include "macros.hpp"
 #include "types.hpp"
 
 class Cpuset final
 {
     private:
-        Atomic<uintptr_t> msk[1] { 0 };
+        static constexpr auto bits { 8 * sizeof (uintptr_t) };
 
-        static constexpr auto bits { 8 * sizeof (*msk) };
+        Atomic<uintptr_t> msk[(NUM_CPU + bits - 1) / bits] { 0 };
 
         inline auto &cpu_to_msk (unsigned c)       { return msk[c / bits]; }
         inline auto &cpu_to_msk (unsigned c) const { return msk[c / bits]; }
@@ -41,6 +42,19 @@ class Cpuset final
         ALWAYS_INLINE
         inline bool tst (unsigned c) const { return cpu_to_msk (c) & cpu_to_bit (c); }
 
+        ALWAYS_INLINE
+        inline bool empty() const
+        {
+            for (unsigned i = 0; i < sizeof (msk) / sizeof (*msk); i++)
+                if (msk[i])
+                    return false;
+
+            return true;
+        }
+
+        ALWAYS_INLINE
+        inline void set (unsigned c) { cpu_to_msk (c) |= cpu_to_bit (c); }
+
         ALWAYS_INLINE
         inline void clr (unsigned c) { cpu_to_msk (c) &= ~cpu_to_bit (c); }
 
@@ -53,4 +67,12 @@ class Cpuset final
             for (unsigned i = 0; i < sizeof (msk) / sizeof (*msk); i++)
                 msk[i] = ~0UL;
         }
+
+        ALWAYS_INLINE
+        inline void set (Cpuset const &s)
+        {
+            for (unsigned i = 0; i < sizeof (msk) / sizeof (*msk); i++)
+                if (s.msk[i])
+                    msk[i] |= s.msk[i];
+        }
 };
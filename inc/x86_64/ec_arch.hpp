@@ -43,7 +43,9 @@ class Ec_arch final : private Ec
 
         // Constructor: Virtual CPU
         template <typename T>
-        Ec_arch (Space_obj *, Space_hst *, Fpu *, T *, unsigned, unsigned long, bool);
+        Ec_arch (Space_obj *, Space_hst *, Fpu *, T *, unsigned, unsigned long, bool, uintptr_t);
+
+        ~Ec_arch();
 
         static void handle_exc (Exc_regs *) asm ("exc_handler");
 
@@ -63,6 +65,13 @@ class Ec_arch final : private Ec
         [[noreturn]]
         inline void vmx_extint();
 
+        inline bool vmx_policy (unsigned);
+        inline bool vmx_pending() const;
+        inline bool vmx_poll();
+        inline bool vmx_unprotect();
+        inline void vmx_pml();
+        inline void vmx_reblock_nmi() const;
+
         ALWAYS_INLINE
         inline void redirect_to_iret()
         {
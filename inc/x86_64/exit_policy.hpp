@@ -0,0 +1,164 @@
+/*
+ * VM Exit Policy
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "macros.hpp"
+#include "slab.hpp"
+#include "types.hpp"
+#include "util.hpp"
+
+/*
+ * The exit policy of a vCPU lets the kernel complete simple VM exits itself
+ * instead of sending them to the VMM. The VMM transfers the policy with the
+ * EXIT MTD item. Exits that the policy does not cover go to the VMM as usual.
+ */
+class Exit_policy final
+{
+    public:
+        enum Flags : uint32
+        {
+            CPUID       = BIT (0),      // CPUID leaves from the table
+            RDTSC       = BIT (1),      // RDTSC and RDTSCP (TSC_AUX from the MSR table)
+            XSETBV      = BIT (2),      // XSETBV with a valid XCR0 value
+            MSR         = BIT (3),      // RDMSR and WRMSR of MSRs from the table
+            HLT         = BIT (4),      // HLT with an interrupt pending
+            POLL        = BIT (5),      // HLT with an interrupt arriving within the poll window (needs posted interrupts)
+        };
+
+        struct Cpuid
+        {
+            uint32  leaf, subleaf;      // Subleaf ~0U matches any subleaf
+            uint32  eax, ebx, ecx, edx;
+        };
+
+        struct Msr
+        {
+            enum Flags : uint32
+            {
+                R   = BIT (0),          // Reads return the value
+                W   = BIT (1),          // Writes update the value
+            };
+
+            uint32  index;
+            Flags   flags;
+            uint64  value;
+        };
+
+        /*
+         * The poll window adapts to the guest: It doubles when an interrupt
+         * arrives while polling and halves when the poll times out, so that
+         * vCPUs of I/O-bound guests avoid the VMM and idle vCPUs quickly stop
+         * burning cycles. The VMM bounds the window and reads the counters.
+         */
+        struct Poll
+        {
+            uint32  max;                // Maximum window in us
+            uint32  win;                // Current window in us
+            uint32  hits;               // Polls that ended with an interrupt
+            uint32  misses;             // Polls that timed out
+        };
+
+        static constexpr unsigned max_cpuid { 32 };
+        static constexpr unsigned max_msr   { 16 };
+        static constexpr unsigned max_poll  { 1000 };
+
+    private:
+        Flags   flags;
+        uint16  num_cpuid, num_msr;
+        Poll    poll;
+        Cpuid   cpuid[max_cpuid];
+        Msr     msr[max_msr];
+
+        static Slab_cache cache;
+
+    public:
+        inline bool enabled (Flags f) const { return flags & f; }
+
+        inline void disable (Flags f) { flags = Flags (flags & ~f); }
+
+        /*
+         * Look up a CPUID leaf
+         *
+         * @param l     Leaf
+         * @param s     Subleaf
+         * @return      Pointer to the CPUID entry or nullptr if there is none
+         */
+        inline Cpuid const *lookup_cpuid (uint32 l, uint32 s) const
+        {
+            for (unsigned i { 0 }; i < min (static_cast<unsigned>(num_cpuid), max_cpuid); i++)
+                if (cpuid[i].leaf == l && (cpuid[i].subleaf == s || cpuid[i].subleaf == ~0U))
+                    return cpuid + i;
+
+            return nullptr;
+        }
+
+        /*
+         * Look up an MSR
+         *
+         * @param i     MSR index
+         * @param f     Required access
+         * @return      Pointer to the MSR entry or nullptr if there is none
+         */
+        inline Msr *lookup_msr (uint32 i, Msr::Flags f)
+        {
+            for (unsigned n { 0 }; n < min (static_cast<unsigned>(num_msr), max_msr); n++)
+                if (msr[n].index == i && (msr[n].flags & f) == f)
+                    return msr + n;
+
+            return nullptr;
+        }
+
+        /*
+         * Determine the current poll window
+         *
+         * @return      Poll window in us, which is at least 1/16 of the maximum
+         */
+        inline unsigned poll_window() const
+        {
+            auto const m { min (poll.max, max_poll) };
+
+            return max (min (poll.win, m), m / 16);
+        }
+
+        /*
+         * Adapt the poll window to the outcome of a poll
+         *
+         * @param h     true if an interrupt arrived, false if the poll timed out
+         */
+        inline void poll_adapt (bool h)
+        {
+            if (h) {
+                poll.hits++;
+                poll.win = min (poll_window() * 2, min (poll.max, max_poll));
+            } else {
+                poll.misses++;
+                poll.win = poll_window() / 2;
+            }
+        }
+
+        [[nodiscard]] static inline void *operator new (size_t) noexcept
+        {
+            return cache.alloc();
+        }
+
+        static inline void operator delete (void *ptr)
+        {
+            if (EXPECT_TRUE (ptr))
+                cache.free (ptr);
+        }
+};
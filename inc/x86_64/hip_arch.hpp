@@ -22,6 +22,9 @@
 
 class Hip_arch final
 {
+    private:
+        uint32  mtd_vmx[64];        // Recommended MTD per VMX exit reason
+
     public:
         enum class Feature : uint64
         {
@@ -30,5 +33,5 @@ class Hip_arch final
             SVM     = BIT (2),
         };
 
-        inline void build() {};
+        void build();
 };
@@ -22,10 +22,15 @@
 #pragma once
 
 #include "atomic.hpp"
+#include "cpuset.hpp"
 #include "macros.hpp"
+#include "spinlock.hpp"
+#include "status.hpp"
+#include "timeout_interrupt.hpp"
 #include "types.hpp"
 #include "vectors.hpp"
 
+class Ec;
 class Ioapic;
 class Sm;
 
@@ -40,7 +45,11 @@ class Interrupt final
 
         static void set_mask (unsigned, bool);
 
-        static void init (unsigned, uint32 &, uint16 &);
+        static void link (Interrupt *, Ec *);
+        static void unlink (Interrupt *, Ec *);
+        static void signal (Ec const *);
+
+        static void init (unsigned, uint64 &, uint16 &);
 
     public:
         class Config final
@@ -52,6 +61,7 @@ class Interrupt final
                 inline auto cpu() const { return static_cast<uint16>(val >> 48 & BIT_RANGE (15, 0)); }
                 inline auto rid() const { return static_cast<uint16>(val >> 32 & BIT_RANGE (15, 0)); }
                 inline bool gst() const { return false; }
+                inline bool pst() const { return val & BIT (3); }
                 inline bool pol() const { return val & BIT (2); }
                 inline bool trg() const { return val & BIT (1); }
                 inline bool msk() const { return val & BIT (0); }
@@ -64,35 +74,51 @@ class Interrupt final
         {
             RRQ,
             RKE,
+            PIN,        // Posted-interrupt notification
+            PIW,        // Posted-interrupt wakeup
         };
 
         Sm *            sm      { nullptr };
         Ioapic *        ioapic  { nullptr };
         Atomic<Config>  config  { Config (0, 0, BIT (0)) };
+        Timeout_interrupt mod;
+        Atomic<Ec *>    vcpu    { nullptr };    // vCPU the interrupt is posted into
+        uint8           vec     { 0 };          // Vector in the vCPU
+        Interrupt *     pst     { nullptr };    // Next interrupt posted into the same vCPU
+        Spinlock        lock;                   // Keeps vcpu and vec consistent
 
         static inline unsigned pin { 0 };
 
+        static inline Spinlock pst_lock;                // Protects the lists of posted interrupts
+        static inline Ec *     pst_vcpu[NUM_CPU];       // vCPUs with posted interrupts per CPU
+
         static Interrupt int_table[NUM_GSI];
 
         static inline unsigned num_pin() { return pin; }
         static inline unsigned num_msi() { return NUM_GSI - pin; }
 
+        static inline bool postable (unsigned) { return true; }
+
         static void setup();
 
         ALWAYS_INLINE
         static inline void init_all()
         {
-            uint32 addr; uint16 data;
+            uint64 addr; uint16 data;
             for (unsigned i = 0; i < NUM_GSI; i++)
                 init (i, addr, data);
         }
 
         static void handler (unsigned) asm ("int_handler");
 
-        static void configure (unsigned, Config, uint32 &, uint16 &);
+        static void pin_handler();
+        static void pin_handler (Ec const *);
+
+        static Status configure (unsigned, Config, uint64, Ec *, uint16, uint64 &, uint16 &);
 
         static inline void deactivate (unsigned gsi) { set_mask (gsi, false); }
 
         static void send_cpu (Request, unsigned);
+        static void send_set (Request, Cpuset const &);
         static void send_exc (Request);
 };
@@ -26,6 +26,7 @@
 #include "macros.hpp"
 #include "memory.hpp"
 #include "slab.hpp"
+#include "spinlock.hpp"
 #include "std.hpp"
 #include "vectors.hpp"
 
@@ -22,8 +22,10 @@
 
 #pragma once
 
+#include "barrier.hpp"
 #include "compiler.hpp"
 #include "cpu.hpp"
+#include "cpuset.hpp"
 #include "lowlevel.hpp"
 #include "memory.hpp"
 #include "msr.hpp"
@@ -73,23 +75,34 @@ class Lapic final
             DLV_EXTINT  = VAL_SHIFT (7, 8),
         };
 
+        // In x2APIC mode, the registers are MSRs at the same index
         ALWAYS_INLINE
         static inline auto read (Register32 r)
         {
+            if (x2apic)
+                return static_cast<uint32>(Msr::read (Msr::Array::IA32_X2APIC, 1, std::to_underlying (r)));
+
             return *reinterpret_cast<uint32 volatile *>(MMAP_CPU_APIC + (std::to_underlying (r) << 4));
         }
 
         ALWAYS_INLINE
         static inline void write (Register32 r, uint32 v)
         {
-            *reinterpret_cast<uint32 volatile *>(MMAP_CPU_APIC + (std::to_underlying (r) << 4)) = v;
+            if (x2apic)
+                Msr::write (Msr::Array::IA32_X2APIC, 1, std::to_underlying (r), v);
+            else
+                *reinterpret_cast<uint32 volatile *>(MMAP_CPU_APIC + (std::to_underlying (r) << 4)) = v;
         }
 
         ALWAYS_INLINE
         static inline void write (Register64 r, uint64 v)
         {
-            write (Register32 (std::to_underlying (r) + 1), static_cast<uint32>(v >> 32));
-            write (Register32 (std::to_underlying (r) + 0), static_cast<uint32>(v));
+            if (x2apic)
+                Msr::write (Msr::Array::IA32_X2APIC, 1, std::to_underlying (r), v);
+            else {
+                write (Register32 (std::to_underlying (r) + 1), static_cast<uint32>(v >> 32));
+                write (Register32 (std::to_underlying (r) + 0), static_cast<uint32>(v));
+            }
         }
 
         ALWAYS_INLINE
@@ -101,17 +114,32 @@ class Lapic final
         ALWAYS_INLINE
         static inline void set_icr (uint64 v)
         {
-            while (EXPECT_FALSE (read (Register32::ICR) & BIT (12)))
-                pause();
+            // The x2APIC ICR has no delivery status, but WRMSR to it is not serializing and must be ordered after prior stores
+            if (x2apic) {
+                Barrier::fmb();
+                Barrier::rmb();
+            } else
+                while (EXPECT_FALSE (read (Register32::ICR) & BIT (12)))
+                    pause();
 
             write (Register64::ICR, v);
         }
 
+        /*
+         * Compute the ICR destination field of a CPU
+         *
+         * @param c     CPU number
+         * @return      Physical destination, in bits 63:32 (x2APIC) or 63:56 (xAPIC)
+         */
+        static inline uint64 dst (unsigned c) { return static_cast<uint64>(Cpu::apic_id[c]) << (x2apic ? 32 : 56); }
+
         static inline unsigned ratio { 0 };
 
     public:
+        static inline bool x2apic { true };
+
         static inline auto time()       { return __builtin_ia32_rdtsc(); }
-        static inline auto id()         { return read (Register32::IDR) >> 24 & BIT_RANGE (7, 0); }
+        static inline auto id()         { return x2apic ? read (Register32::IDR) : read (Register32::IDR) >> 24 & BIT_RANGE (7, 0); }
         static inline auto eoi_sup()    { return read (Register32::LVR) >> 24 & BIT (0); }
         static inline auto lvt_max()    { return read (Register32::LVR) >> 16 & BIT_RANGE (7, 0); }
         static inline auto version()    { return read (Register32::LVR)       & BIT_RANGE (7, 0); }
@@ -121,9 +149,11 @@ class Lapic final
 
         static inline void send_cpu (unsigned v, unsigned c, Delivery d = Delivery::DLV_FIXED)
         {
-            set_icr (static_cast<uint64>(Cpu::apic_id[c]) << 56 | BIT (14) | std::to_underlying (d) | v);
+            set_icr (dst (c) | BIT (14) | std::to_underlying (d) | v);
         }
 
+        static void send_set (unsigned, Cpuset const &);
+
         static inline void send_exc (unsigned v, Delivery d = Delivery::DLV_FIXED)
         {
             set_icr (BIT_RANGE (19, 18) | BIT (14) | std::to_underlying (d) | v);
@@ -145,5 +175,6 @@ class Lapic final
         static void perfm_handler();
         static void therm_handler();
 
+        static void setup();
         static void init (uint32, uint32);
 };
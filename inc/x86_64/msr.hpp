@@ -99,6 +99,7 @@ class Msr final
             IA32_LSTAR                      = 0xc0000082,   // LM
             IA32_FMASK                      = 0xc0000084,   // LM
             IA32_KERNEL_GS_BASE             = 0xc0000102,   // LM
+            IA32_TSC_AUX                    = 0xc0000103,   // RDTSCP
             AMD_IPMR                        = 0xc0010055,
             AMD_SVM_HSAVE_PA                = 0xc0010117,
         };
@@ -114,6 +115,7 @@ class Msr final
             IA32_MC_STATUS                  = 0x401,        // IA32_MCG_CAP[7:0] > 0
             IA32_MC_ADDR                    = 0x402,        // IA32_MCG_CAP[7:0] > 0
             IA32_MC_MISC                    = 0x403,        // IA32_MCG_CAP[7:0] > 0
+            IA32_X2APIC                     = 0x800,        // X2APIC
             IA32_L3_MASK                    = 0xc90,        // RDT-A (max 128)
             IA32_L2_MASK                    = 0xd10,        // RDT-A (max 64)
             IA32_MB_THRT                    = 0xd50,        // RDT-A (max 64)
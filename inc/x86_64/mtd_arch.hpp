@@ -58,6 +58,8 @@ class Mtd_arch final : public Mtd
             PAT             = BIT (23),
             EFER            = BIT (24),
             KERNEL_GS_BASE  = BIT (25),
+            EXIT            = BIT (26),
+            INSN            = BIT (27),
 
             TLB             = BIT (29),
             FPU             = BIT (30),
@@ -17,25 +17,56 @@
 
 #pragma once
 
-#include "atomic.hpp"
+#include "config.hpp"
+#include "cpu.hpp"
 #include "macros.hpp"
 #include "types.hpp"
 
 class Pcid final
 {
     private:
-        uint16 const val;
+        uint64 tag[NUM_CPU] { };                // Generation and PCID of the space on each CPU
 
-        static inline Atomic<uint16> allocator { 0 };
+        static uint64 gen CPULOCAL;             // Generation and most recently assigned PCID of this CPU
 
-        // FIXME: Handle overflow
-        static inline auto alloc()
+        static constexpr auto bits { 12 };
+
+    public:
+        /*
+         * Determine the PCID of the space on the current CPU
+         *
+         * @return  PCID, or 0 if the space has no PCID in the current generation of the CPU
+         */
+        inline uint16 get() const
         {
-            return allocator++;
+            auto const t { tag[Cpu::id] };
+
+            return (t ^ gen) >> bits ? 0 : static_cast<uint16>(t & BIT_RANGE (bits - 1, 0));
         }
 
-    public:
-        inline Pcid() : val (alloc()) {}
+        /*
+         * Assign a PCID to the space on the current CPU
+         *
+         * Within a generation, a PCID is never assigned twice, so a newly assigned PCID has no
+         * translations. Once all PCIDs are used up, a new generation starts and all PCIDs of
+         * the CPU must be flushed after switching to the new PCID.
+         *
+         * @param flush Set to true if a new generation started
+         * @return      PCID
+         */
+        inline uint16 alloc (bool &flush)
+        {
+            if (auto const p { get() })
+                return p;
+
+            // PCID 0 is not assigned, so that an unused tag is never current
+            if (EXPECT_FALSE (!(++gen & BIT_RANGE (bits - 1, 0)))) {
+                gen++;
+                flush = true;
+            }
+
+            return static_cast<uint16>((tag[Cpu::id] = gen) & BIT_RANGE (bits - 1, 0));
+        }
 
-        inline operator auto() const { return val & BIT_RANGE (11, 0); }
+        static void flush();
 };
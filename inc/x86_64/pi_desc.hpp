@@ -0,0 +1,110 @@
+/*
+ * Posted-Interrupt Descriptor (VMX, VT-d)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "atomic.hpp"
+#include "macros.hpp"
+#include "slab.hpp"
+#include "types.hpp"
+
+/*
+ * Interrupts are posted into the PIR by the kernel or by the SMMU. Whoever
+ * sets ON sends the notification vector NV to the CPU NDST. While the vCPU
+ * is in guest mode, NV is the posted-interrupt notification vector and the
+ * CPU moves the PIR into the virtual APIC without a VM exit. Otherwise NV is
+ * the wakeup vector and the notification is handled by the kernel.
+ */
+class alignas (64) Pi_desc final
+{
+    private:
+        Atomic<uint64>  pir[4]  { 0, 0, 0, 0 };     // Posted-Interrupt Requests
+        Atomic<uint64>  ctl     { 0 };              // NDST[63:32] NV[23:16] SN[1] ON[0]
+        uint64          reserved[3] { 0, 0, 0 };
+
+        static constexpr uint64 on { BIT64 (0) };
+        static constexpr uint64 sn { BIT64 (1) };
+
+        static Slab_cache cache;
+
+        bool set_nv (uint8);
+
+        inline bool posted() const { return pir[0] || pir[1] || pir[2] || pir[3]; }
+
+    public:
+        explicit Pi_desc (uint32);
+
+        // The SMMU posts into the PIR without setting ON while SN is set
+        inline bool pending() const { return ctl & on || (ctl & sn && posted()); }
+
+        inline bool suppressed() const { return ctl & sn; }
+
+        inline bool requested (uint8 vec) const { return pir[vec / 64] & BIT64 (vec % 64); }
+
+        /*
+         * Post an interrupt
+         *
+         * @param vec   Vector of the interrupt
+         * @return      Notification vector to send, or 0 if a notification is already outstanding
+         */
+        inline uint8 post (uint8 vec)
+        {
+            pir[vec / 64].fetch_or (BIT64 (vec % 64));
+
+            auto const o { ctl.fetch_or (on) };
+
+            return o & (on | sn) ? 0 : static_cast<uint8>(o >> 16);
+        }
+
+        /*
+         * Suppress or resume notifications
+         *
+         * Interrupts that the SMMU posted while notifications were suppressed
+         * did not set ON, so resuming sets ON for them.
+         *
+         * @param s     true to suppress, false to resume notifications
+         * @return      True if an interrupt is pending (ON is set)
+         */
+        inline bool suppress (bool s)
+        {
+            if (s)
+                return (ctl |= sn) & on;
+
+            if (!((ctl &= ~sn) & on) && posted())
+                ctl |= on;
+
+            return ctl & on;
+        }
+
+        bool enter();
+        bool leave();
+
+        unsigned harvest (uint32 *);
+
+        [[nodiscard]] static inline void *operator new (size_t) noexcept
+        {
+            return cache.alloc();
+        }
+
+        static inline void operator delete (void *ptr)
+        {
+            if (EXPECT_TRUE (ptr))
+                cache.free (ptr);
+        }
+};
+
+static_assert (sizeof (Pi_desc) == 64);
@@ -36,6 +36,7 @@ class Ept final : public Pagetable<Ept, uint64, uint64, 4, 3, false>::Entry
             ATTR_A      = BIT64  (8),   // Accessed
             ATTR_D      = BIT64  (9),   // Dirty
             ATTR_XU     = BIT64 (10),   // Executable (User)
+            ATTR_L      = BIT64 (11),   // Dirty Logging (Software): Dirty Below (Table), Write-Protected (Leaf)
             ATTR_VGP    = BIT64 (57),   // Verify Guest Paging
             ATTR_PW     = BIT64 (58),   // Paging-Write Access
             ATTR_SSS    = BIT64 (60),   // Supervisor Shadow Stack
@@ -45,6 +46,8 @@ class Ept final : public Pagetable<Ept, uint64, uint64, 4, 3, false>::Entry
 
     public:
         static inline bool mbec { true };
+        static inline bool ad   { true };   // Accessed and dirty flags
+        static inline bool pml  { true };   // Page-modification logging
 
         static constexpr OAddr ADDR_MASK { BIT64_RANGE (51, 12) };
 
@@ -68,19 +71,44 @@ class Ept final : public Pagetable<Ept, uint64, uint64, 4, 3, false>::Entry
                      ATTR_S  * !!l | Memattr::ca_to_ept (ca) << 3;
         }
 
+        // A leaf PTE that is write-protected for dirty logging remains writable
         Paging::Permissions page_pm() const
         {
             return Paging::Permissions (!val ? 0 :
-                                      !!(val & ATTR_XS) * Paging::XS |
-                                      !!(val & ATTR_XU) * Paging::XU |
-                                      !!(val & ATTR_W)  * Paging::W  |
-                                      !!(val & ATTR_R)  * Paging::R);
+                                      !!(val & ATTR_XS)            * Paging::XS |
+                                      !!(val & ATTR_XU)            * Paging::XU |
+                                      !!(val & (ATTR_W | ATTR_L))  * Paging::W  |
+                                      !!(val & ATTR_R)             * Paging::R);
         }
 
         Memattr::Cacheability page_ca (unsigned) const { return Memattr::ept_to_ca (val >> 3 & 0x7); }
 
         Memattr::Shareability page_sh() const { return Memattr::Shareability::NONE; }
 
+        // Dirty logging uses the dirty flag (ad) or write protection (!ad) of leaf PTEs
+        bool  is_dirty (bool a) const { return val & (a ? ATTR_D : ATTR_W); }
+        Entry clean    (bool a) const { return a ? val & ~ATTR_D : (val & ~ATTR_W) | ATTR_L; }
+        Entry dirty    (bool a) const { return a ? val |  ATTR_D : (val & ~ATTR_L) | ATTR_W; }
+
+        bool  is_dirty() const { return is_dirty (ad); }
+        Entry clean()    const { return clean (ad); }
+        Entry dirty()    const { return dirty (ad); }
+
+        bool  is_protected() const { return val & ATTR_L; }
+        Entry unprotect()    const { return (val & ~ATTR_L) | ATTR_W; }
+
+        // The dirty summary (pml) of a table PTE covers all leaf PTEs below
+        static bool dirty_summary() { return pml; }
+
+        bool  is_summary()     const { return val & ATTR_L; }
+        Entry summary (bool s) const { return s ? val | ATTR_L : val & ~ATTR_L; }
+
+        // The accessed flag (ad) of a table PTE covers all PTEs below
+        static bool accessed_summary() { return ad; }
+
+        bool  is_accessed() const { return val & ATTR_A; }
+        Entry unaccessed()  const { return val & ~ATTR_A; }
+
         // Needed by gcc version < 10
         ALWAYS_INLINE inline Ept() : Entry() {}
         ALWAYS_INLINE inline Ept (Entry x) : Entry (x) {}
@@ -93,6 +121,9 @@ class Eptp final : public Pagetable<Ept, uint64, uint64, 4, 3, false>
         ALWAYS_INLINE
         inline explicit Eptp (OAddr v = 0) : Pagetable (Ept (v)) {}
 
+        bool unprotect (uint64);
+        void mark (uint64);
+
         ALWAYS_INLINE
         inline void invalidate() const
         {
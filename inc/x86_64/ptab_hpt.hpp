@@ -80,6 +80,10 @@ class Hpt final : public Pagetable<Hpt, uint64, uint64, 4, 3, false>::Entry
 
         Memattr::Shareability page_sh() const { return Memattr::Shareability::NONE; }
 
+        // Working-set estimation samples and clears the accessed flag of leaf PTEs
+        bool  is_accessed() const { return val & ATTR_A; }
+        Entry unaccessed()  const { return val & ~ATTR_A; }
+
         // Needed by gcc version < 10
         ALWAYS_INLINE inline Hpt() : Entry() {}
         ALWAYS_INLINE inline Hpt (Entry x) : Entry (x) {}
@@ -137,6 +141,22 @@ class Hptp final : public Pagetable<Hpt, uint64, uint64, 4, 3, false>
             asm volatile ("invlpg %0" : : "m" (*reinterpret_cast<uintptr_t *>(addr)));
         }
 
+        ALWAYS_INLINE
+        static inline void invalidate (uintptr_t pcid, uintptr_t addr)
+        {
+            struct { uint64 pcid, addr; } desc = { pcid, addr };
+
+            asm volatile ("invpcid %0, %1" : : "m" (desc), "r" (0UL) : "memory");
+        }
+
+        ALWAYS_INLINE
+        static inline void invalidate_pcids()
+        {
+            struct { uint64 pcid, addr; } desc = { 0, 0 };
+
+            asm volatile ("invpcid %0, %1" : : "m" (desc), "r" (3UL) : "memory");
+        }
+
         ALWAYS_INLINE
         static inline void master_map (IAddr v, OAddr p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh)
         {
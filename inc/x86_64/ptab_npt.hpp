@@ -0,0 +1,97 @@
+/*
+ * Nested Page Table (NPT)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "ptab.hpp"
+
+/*
+ * NPT uses the format of the host page table. All guest accesses are user
+ * accesses at the nested level and a present PTE is always readable.
+ */
+class Npt final : public Pagetable<Npt, uint64, uint64, 4, 3, false>::Entry
+{
+    private:
+        enum
+        {
+            ATTR_P      = BIT64  (0),   // Present
+            ATTR_W      = BIT64  (1),   // Writable
+            ATTR_U      = BIT64  (2),   // User
+            ATTR_A      = BIT64  (5),   // Accessed
+            ATTR_D      = BIT64  (6),   // Dirty
+            ATTR_S      = BIT64  (7),   // Superpage
+            ATTR_nX     = BIT64 (63),   // Not Executable
+        };
+
+    public:
+        static constexpr OAddr ADDR_MASK { BIT64_RANGE (51, 12) };
+
+        bool is_large (unsigned l) const { return l &&  (val & ATTR_S); }
+        bool is_table (unsigned l) const { return l && !(val & ATTR_S); }
+
+        // Attributes for PTEs referring to page tables
+        static OAddr ptab_attr()
+        {
+            return ATTR_A | ATTR_U | ATTR_W | ATTR_P;
+        }
+
+        // Attributes for PTEs referring to leaf pages
+        static OAddr page_attr (unsigned l, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability)
+        {
+            return !(pm & Paging::API) ? 0 :
+                     ATTR_nX *  !(pm & (Paging::XS | Paging::XU))   |
+                     ATTR_D  * !!(pm &  Paging::W)                  |
+                     ATTR_W  * !!(pm &  Paging::W)                  |
+                     ATTR_S  * !!l | ATTR_A | ATTR_U | ATTR_P       |
+                     (std::to_underlying (ca) & BIT (2)) << (l ? 10 : 5) | (std::to_underlying (ca) & BIT_RANGE (1, 0)) << 3;
+        }
+
+        Paging::Permissions page_pm() const
+        {
+            return Paging::Permissions (!val ? 0 :
+                                       !(val & ATTR_nX) * (Paging::XS | Paging::XU) |
+                                      !!(val & ATTR_W)  *  Paging::W                |
+                                      !!(val & ATTR_P)  *  Paging::R);
+        }
+
+        Memattr::Cacheability page_ca (unsigned l) const { return Memattr::Cacheability ((val >> (l ? 10 : 5) & BIT (2)) | (val >> 3 & BIT_RANGE (1, 0))); }
+
+        Memattr::Shareability page_sh() const { return Memattr::Shareability::NONE; }
+
+        // Dirty logging uses the dirty flag of leaf PTEs, which the CPU always maintains
+        bool  is_dirty() const { return val & ATTR_D; }
+        Entry clean()    const { return val & ~ATTR_D; }
+        Entry dirty()    const { return val |  ATTR_D; }
+
+        // The accessed flag of a table PTE covers all PTEs below
+        static bool accessed_summary() { return true; }
+
+        bool  is_accessed() const { return val & ATTR_A; }
+        Entry unaccessed()  const { return val & ~ATTR_A; }
+
+        // Needed by gcc version < 10
+        ALWAYS_INLINE inline Npt() : Entry() {}
+        ALWAYS_INLINE inline Npt (Entry x) : Entry (x) {}
+};
+
+class Nptp final : public Pagetable<Npt, uint64, uint64, 4, 3, false>
+{
+    public:
+        // Constructor
+        ALWAYS_INLINE
+        inline explicit Nptp (OAddr v = 0) : Pagetable (Npt (v)) {}
+};
@@ -20,7 +20,9 @@
 #include "ptab_dpt.hpp"
 #include "ptab_ept.hpp"
 #include "ptab_hpt.hpp"
+#include "ptab_npt.hpp"
 
 template class Pagetable<Dpt, uint64, uint64, 4, 3, true>;
 template class Pagetable<Ept, uint64, uint64, 4, 3, false>;
 template class Pagetable<Hpt, uint64, uint64, 4, 3, false>;
+template class Pagetable<Npt, uint64, uint64, 4, 3, false>;
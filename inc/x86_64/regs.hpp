@@ -22,18 +22,25 @@
 #pragma once
 
 #include "arch.hpp"
+#include "asid.hpp"
 #include "fpu.hpp"
 #include "hazard.hpp"
 #include "selectors.hpp"
 #include "svm.hpp"
 #include "types.hpp"
 #include "vmx.hpp"
+#include "vpid.hpp"
 
+class Ec;
+class Exit_policy;
+class Interrupt;
+class Pi_desc;
 class Space_gst;
 class Space_hst;
 class Space_msr;
 class Space_obj;
 class Space_pio;
+class Vmcs_cache;
 
 struct Sys_regs
 {
@@ -120,6 +127,16 @@ class alignas (16) Cpu_regs final
         Space_pio *         pio     { nullptr };
         Space_msr *         msr     { nullptr };
         Hazard              hazard  { 0 };
+        Vpid                vpid;                   // VPID of the vCPU (VMX)
+        Asid                asid;                   // ASID of the vCPU (SVM)
+        uint16              pcid    { 0 };          // PCID in the host CR3 of the VMCS (VMX)
+        uint32 *            vapic   { nullptr };    // Virtual-APIC page (VMX)
+        Pi_desc *           pid     { nullptr };    // Posted-interrupt descriptor (VMX)
+        Interrupt *         pst     { nullptr };    // Interrupts posted into the vCPU (VMX)
+        Ec *                pst_nxt { nullptr };    // Next vCPU on the same CPU with posted interrupts (VMX)
+        Exit_policy *       exits   { nullptr };    // Exits completed by the kernel (VMX)
+        Vmcs_cache *        cache   { nullptr };    // Segment state cache (VMX)
+        uint64 *            pml     { nullptr };    // Page-modification log (VMX)
 
         inline Cpu_regs (Space_obj *o, Space_hst *h, Space_pio *p = nullptr) : vmcb (nullptr), obj (o), hst (h), pio (p) {}
         inline Cpu_regs (Space_obj *o, Space_hst *h, Vmcb *v) : vmcb (v), obj (o), hst (h), hazard (Hazard::ILLEGAL) {}
@@ -132,7 +149,7 @@ class alignas (16) Cpu_regs final
         void vmx_set_cpu_sec (uint32) const;
         void vmx_set_cpu_ter (uint64) const;
 
-        inline void svm_set_bmp_exc() const { vmcb->intercept_exc = set_exc() | exc.intcpt_exc; }
+        inline void svm_set_bmp_exc() const { vmcb->intercept_exc = set_exc() | exc.intcpt_exc; vmcb->modify (Vmcb::CLEAN_I); }
 
         inline auto vmx_get_gst_cr0() const
         {
@@ -24,6 +24,7 @@
 
 #include "buddy.hpp"
 #include "cache.hpp"
+#include "lapic.hpp"
 #include "list.hpp"
 #include "lowlevel.hpp"
 #include "macros.hpp"
@@ -210,6 +211,7 @@ class Smmu final : public List<Smmu>
         inline bool has_qi() const { return ecap & BIT (1); }
         inline bool has_dt() const { return ecap & BIT (2); }
         inline bool has_ir() const { return ecap & BIT (3); }
+        inline bool has_pi() const { return cap & BIT64 (59); }
 
         inline auto nfr() const { return static_cast<unsigned>(cap >> 40 & BIT_RANGE (7, 0)) + 1; }
         inline auto fro() const { return static_cast<unsigned>(cap >> 20 & BIT_RANGE (13, 4)); }
@@ -292,6 +294,7 @@ class Smmu final : public List<Smmu>
     public:
         static inline bool nc { false };    // Noncoherent
         static inline bool ir { false };
+        static inline bool pi { true };     // Posted interrupts
 
         explicit Smmu (Paddr);
 
@@ -322,7 +325,27 @@ class Smmu final : public List<Smmu>
             if (!ir)
                 return;
 
-            irt[i].set (BIT (18) | rid, static_cast<uint64>(aid) << 40 | vec << 16 | trg << 4 | BIT (0));
+            irt[i].set (BIT (18) | rid, static_cast<uint64>(aid) << (Lapic::x2apic ? 32 : 40) | vec << 16 | trg << 4 | BIT (0));
+
+            for (auto l = list; l; l = l->next)
+                l->invalidate_iec();
+        }
+
+        /*
+         * Set a posted-format IRT entry
+         *
+         * @param i     IRT index
+         * @param rid   Requester ID
+         * @param pda   Physical address of the posted-interrupt descriptor
+         * @param vec   Vector in the vCPU
+         */
+        ALWAYS_INLINE
+        static inline void set_irt (unsigned i, uint16 rid, uint64 pda, uint8 vec)
+        {
+            if (!ir)
+                return;
+
+            irt[i].set ((pda & BIT64_RANGE (63, 32)) | BIT (18) | rid, (pda & BIT64_RANGE (31, 6)) << 32 | vec << 16 | BIT (15) | BIT (0));
 
             for (auto l = list; l; l = l->next)
                 l->invalidate_iec();
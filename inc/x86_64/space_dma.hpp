@@ -35,9 +35,13 @@ class Space_dma final : public Space_mem<Space_dma>
 
         inline Space_dma (Pd *p) : Space_mem (Kobject::Subtype::DMA, p) {}
 
+        inline ~Space_dma() { dptp.root_fini(); }
+
     public:
         static Space_dma nova;
 
+        typedef Dptp::Cursor Cursor;
+
         static constexpr auto num { BIT64 (Dptp::lev * Dptp::bpl) };
 
         [[nodiscard]] inline auto get_ptab (unsigned l) { return dptp.root_init (Smmu::nc, l); }
@@ -59,11 +63,13 @@ class Space_dma final : public Space_mem<Space_dma>
             return nullptr;
         }
 
-        inline void destroy (Slab_cache &cache) { operator delete (this, cache); }
+        inline void destroy (Slab_cache &cache) { this->~Space_dma(); operator delete (this, cache); }
+
+        static void free (Rcu_elem *e) { auto const o { static_cast<Space_dma *>(e) }; o->get_pd()->reclaim (o); }
 
-        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh) { return dptp.update (v, p, o, pm, ca, sh, Smmu::nc); }
+        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh, Cursor *c = nullptr) { return dptp.update (v, p, o, pm, ca, sh, Smmu::nc, c); }
 
-        inline void sync() { Smmu::invalidate_all (sdid); }
+        inline void sync (uint64, uint64) { Smmu::invalidate_all (sdid); }
 
         inline auto get_sdid() const { return sdid; }
 
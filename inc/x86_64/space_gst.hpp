@@ -21,8 +21,11 @@
 
 #pragma once
 
+#include "cpu.hpp"
 #include "cpuset.hpp"
+#include "hip.hpp"
 #include "ptab_ept.hpp"
+#include "ptab_npt.hpp"
 #include "space_mem.hpp"
 #include "tlb.hpp"
 
@@ -30,11 +33,40 @@ class Space_gst final : public Space_mem<Space_gst>
 {
     private:
         Eptp    eptp;
+        Nptp    nptp;
 
-        inline Space_gst (Pd *p) : Space_mem (Kobject::Subtype::GST, p) {}
+        // Flush stale translations that may exist for a recycled page table root
+        inline Space_gst (Pd *p) : Space_mem (Kobject::Subtype::GST, p) { gtlb.set(); }
+
+        inline ~Space_gst() { eptp.root_fini(); nptp.root_fini(); }
+
+        // Guest spaces use NPT with SVM and EPT otherwise
+        static inline bool npt() { return Hip::feature (Hip_arch::Feature::SVM); }
+
+    public:
+        Cpuset  gtlb;                       // CPUs that must flush the space before using it
+        Cpuset  active;                     // CPUs that may hold translations of the space
+
+        struct Cursor
+        {
+            Eptp::Cursor ept;
+            Nptp::Cursor npt;
+
+            ALWAYS_INLINE inline explicit Cursor (bool p = false) : ept (p), npt (p) {}
+        };
+
+        // Guest state that controls the translation of guest-linear addresses
+        struct Paging_state
+        {
+            uint64 cr0, cr3, cr4, efer;
+            uint64 const *pdpte;            // PDPTEs loaded by the CPU for PAE paging or nullptr
+        };
+
+    private:
+        bool read (uint64, void *, unsigned, Cursor &) const;
+        bool translate (Paging_state const &, uint64 &, Cursor &) const;
 
     public:
-        Cpuset  gtlb;
 
         static constexpr auto num { BIT64 (Eptp::lev * Eptp::bpl) };
 
@@ -44,7 +76,7 @@ class Space_gst final : public Space_mem<Space_gst>
 
             if (EXPECT_TRUE (gst)) {
 
-                if (EXPECT_TRUE (gst->eptp.root_init (false)))
+                if (EXPECT_TRUE (npt() ? !!gst->nptp.root_init (false) : !!gst->eptp.root_init (false)))
                     return gst;
 
                 operator delete (gst, cache);
@@ -55,13 +87,89 @@ class Space_gst final : public Space_mem<Space_gst>
             return nullptr;
         }
 
-        inline void destroy (Slab_cache &cache) { operator delete (this, cache); }
+        inline void destroy (Slab_cache &cache) { this->~Space_gst(); operator delete (this, cache); }
+
+        static void free (Rcu_elem *e) { auto const o { static_cast<Space_gst *>(e) }; o->get_pd()->reclaim (o); }
+
+        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh, Cursor *c = nullptr)
+        {
+            return npt() ? nptp.update (v, p, o, pm, ca, sh, false, c ? &c->npt : nullptr) : eptp.update (v, p, o, pm, ca, sh, false, c ? &c->ept : nullptr);
+        }
+
+        // INVEPT and the NPT ASID flush cannot invalidate individual guest-physical addresses
+        inline void sync (uint64, uint64) { gtlb.set (active); Tlb::shootdown (this); }
+
+        // Become active before checking for stale translations, so that a concurrent sync either marks or sees us
+        ALWAYS_INLINE
+        inline bool stale()
+        {
+            if (EXPECT_FALSE (!active.tst (Cpu::id)))
+                active.set (Cpu::id);
+
+            if (EXPECT_TRUE (!gtlb.tst (Cpu::id)))
+                return false;
 
-        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh) { return eptp.update (v, p, o, pm, ca, sh); }
+            gtlb.clr (Cpu::id);
 
-        inline void sync() { gtlb.set(); Tlb::shootdown (this); }
+            return true;
+        }
 
         inline void invalidate() { eptp.invalidate(); }
 
-        inline auto get_phys() const { return eptp.root_addr(); }
+        /*
+         * Harvest the dirty state of a range
+         *
+         * @param v     Guest page number of the range
+         * @param o     Page order of the range
+         * @param bmp   Dirty bitmap of the range (one bit per page)
+         * @return      SUCCESS
+         */
+        inline Status harvest (uint64 v, unsigned o, uint64 *bmp)
+        {
+            auto const s { v << PAGE_BITS }, e { s + BITN (o + PAGE_BITS) };
+
+            uint64 lo { e }, hi { s };
+
+            npt() ? nptp.harvest (s, e, bmp, lo, hi) : eptp.harvest (s, e, bmp, lo, hi);
+
+            // Cached translations would let writes to cleaned pages go unnoticed
+            if (lo < hi)
+                sync (lo, hi - lo);
+
+            return Status::SUCCESS;
+        }
+
+        /*
+         * Sample and clear the accessed state of a range
+         *
+         * @param v     Guest page number of the range
+         * @param o     Page order of the range
+         * @param bmp   Accessed bitmap of the range (one bit per page)
+         * @return      SUCCESS or BAD_FTR if EPT has no accessed flags
+         */
+        inline Status age (uint64 v, unsigned o, uint64 *bmp)
+        {
+            if (EXPECT_FALSE (!npt() && !Ept::ad))
+                return Status::BAD_FTR;
+
+            auto const s { v << PAGE_BITS }, e { s + BITN (o + PAGE_BITS) };
+
+            uint64 lo { e }, hi { s };
+
+            npt() ? nptp.age (s, e, bmp, lo, hi) : eptp.age (s, e, bmp, lo, hi);
+
+            // One invalidation for the cleared part of the range, so that subsequent accesses set the accessed flags again
+            if (lo < hi)
+                sync (lo, hi - lo);
+
+            return Status::SUCCESS;
+        }
+
+        inline bool unprotect (uint64 v) { return eptp.unprotect (v); }
+
+        inline void mark (uint64 v) { eptp.mark (v); }
+
+        unsigned fetch (Paging_state const &, uint64, uint8 *, unsigned) const;
+
+        inline auto get_phys() const { return npt() ? nptp.root_addr() : eptp.root_addr(); }
 };
@@ -35,13 +35,18 @@ class Space_hst final : public Space_mem<Space_hst>
 
         inline Space_hst (Pd *p) : Space_mem (Kobject::Subtype::HST, p) {}
 
+        ~Space_hst();
+
     public:
+        typedef Hptp::Cursor Cursor;
+
         Hptp    hptp;
         Pcid    pcid;
 
         Hptp    loc[NUM_CPU];
         Cpuset  cpus;
-        Cpuset  htlb;
+        Cpuset  htlb;                       // CPUs that must flush the space before using it
+        Cpuset  active;                     // CPUs that may hold translations of the space
 
         static Space_hst nova;
         static Space_hst *current CPULOCAL;
@@ -67,36 +72,87 @@ class Space_hst final : public Space_mem<Space_hst>
             return nullptr;
         }
 
-        inline void destroy (Slab_cache &cache) { operator delete (this, cache); }
+        inline void destroy (Slab_cache &cache) { this->~Space_hst(); operator delete (this, cache); }
 
-        inline auto lookup (uint64 v, uint64 &p, unsigned &o, Memattr::Cacheability &ca, Memattr::Shareability &sh) const { return hptp.lookup (v, p, o, ca, sh); }
+        static void free (Rcu_elem *);
 
-        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh) { return hptp.update (v, p, o, pm, ca, sh); }
+        inline auto lookup (uint64 v, uint64 &p, unsigned &o, Memattr::Cacheability &ca, Memattr::Shareability &sh, Cursor *c = nullptr) const { return hptp.lookup (v, p, o, ca, sh, c); }
 
-        inline void sync() { htlb.set(); Tlb::shootdown (this); }
+        inline auto update (uint64 v, uint64 p, unsigned o, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh, Cursor *c = nullptr) { return hptp.update (v, p, o, pm, ca, sh, false, c); }
+
+        inline void sync (uint64 v, uint64 s)
+        {
+            if (s <= Tlb::max_size)
+                Tlb::shootdown (this, v, s);
+            else {
+                htlb.set (active);
+                Tlb::shootdown (this);
+            }
+        }
+
+        /*
+         * Sample and clear the accessed state of a range
+         *
+         * @param v     Page number of the range
+         * @param o     Page order of the range
+         * @param bmp   Accessed bitmap of the range (one bit per page)
+         * @return      SUCCESS
+         */
+        inline Status age (uint64 v, unsigned o, uint64 *bmp)
+        {
+            auto const s { v << PAGE_BITS }, e { s + BITN (o + PAGE_BITS) };
+
+            uint64 lo { e }, hi { s };
+
+            hptp.age (s, e, bmp, lo, hi);
+
+            // One invalidation for the cleared part of the range, so that subsequent accesses set the accessed flags again
+            if (lo < hi)
+                sync (lo, hi - lo);
+
+            return Status::SUCCESS;
+        }
 
         ALWAYS_INLINE
         inline void make_current()
         {
-            uintptr_t p = pcid;
+            // Become active before checking for stale translations, so that a concurrent sync either marks or sees us
+            if (EXPECT_FALSE (!active.tst (Cpu::id)))
+                active.set (Cpu::id);
 
-            if (EXPECT_FALSE (htlb.tst (Cpu::id)))
-                htlb.clr (Cpu::id);
+            bool const stale { htlb.tst (Cpu::id) };
 
-            else {
+            if (EXPECT_FALSE (stale))
+                htlb.clr (Cpu::id);
 
-                if (EXPECT_TRUE (current == this))
-                    return;
+            else if (EXPECT_TRUE (current == this))
+                return;
 
-                p |= BIT64 (63);
-            }
+            auto const prev { current };
 
             current = this;
 
-            loc[Cpu::id].make_current (Cpu::feature (Cpu::Feature::PCID) ? p : 0);
+            if (Cpu::feature (Cpu::Feature::PCID)) {
+
+                bool flush { false };
+
+                loc[Cpu::id].make_current (pcid.alloc (flush) | !stale * BIT64 (63));
+
+                // The old generation of PCIDs is no longer current, so their translations can no longer be refilled
+                if (EXPECT_FALSE (flush))
+                    Pcid::flush();
+
+            } else {
+
+                loc[Cpu::id].make_current (0);
+
+                // Without PCIDs, loading CR3 flushed the translations of the previous space
+                if (prev && prev != this)
+                    prev->active.clr (Cpu::id);
+            }
         }
 
-        inline auto get_pcid() const { return pcid; }
+        inline auto get_pcid() const { return pcid.get(); }
 
         void init (unsigned);
 
@@ -35,7 +35,7 @@ class Space_msr final : public Space
 
         Space_msr();
 
-        inline Space_msr (Pd *p, Bitmap_msr *b) : Space (Kobject::Subtype::MSR, p), bmp (b) {}
+        inline Space_msr (Pd *p, Bitmap_msr *b) : Space (Kobject::Subtype::MSR, p, free), bmp (b) {}
 
         inline ~Space_msr() { delete bmp; }
 
@@ -67,7 +67,9 @@ class Space_msr final : public Space
             return nullptr;
         }
 
-        inline void destroy (Slab_cache &cache) { operator delete (this, cache); }
+        inline void destroy (Slab_cache &cache) { this->~Space_msr(); operator delete (this, cache); }
+
+        static void free (Rcu_elem *e) { auto const o { static_cast<Space_msr *>(e) }; o->get_pd()->reclaim (o); }
 
         static void user_access (uint64 base, size_t size, bool a)
         {
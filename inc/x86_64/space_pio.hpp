@@ -34,7 +34,7 @@ class Space_pio final : public Space
 
         Space_pio();
 
-        inline Space_pio (Pd *p, Bitmap_pio *b, Space_hst *h) : Space (Kobject::Subtype::PIO, p), bmp (b), hst (h)
+        inline Space_pio (Pd *p, Bitmap_pio *b, Space_hst *h) : Space (Kobject::Subtype::PIO, p, free), bmp (b), hst (h)
         {
             if (hst)
                 hst->update (MMAP_SPC_PIO, Kmem::ptr_to_phys (bmp), 1, Paging::R, Memattr::Cacheability::MEM_WB, Memattr::Shareability::NONE);
@@ -42,8 +42,11 @@ class Space_pio final : public Space
 
         inline ~Space_pio()
         {
-            if (hst)
+            if (hst) {
                 hst->update (MMAP_SPC_PIO, 0, 1, Paging::NONE, Memattr::Cacheability::MEM_WB, Memattr::Shareability::NONE);
+                hst->htlb.set();
+                hst->del_ref();
+            }
 
             delete bmp;
         }
@@ -66,6 +69,12 @@ class Space_pio final : public Space
                 return nullptr;
             }
 
+            // An attached PIO space maps its bitmap into the HST space
+            if (EXPECT_FALSE (a && !hst->add_ref())) {
+                s = Status::ABORTED;
+                return nullptr;
+            }
+
             auto const bmp { new Bitmap_pio };
 
             if (EXPECT_TRUE (bmp)) {
@@ -78,12 +87,17 @@ class Space_pio final : public Space
                 delete bmp;
             }
 
+            if (a)
+                hst->del_ref();
+
             s = Status::INS_MEM;
 
             return nullptr;
         }
 
-        inline void destroy (Slab_cache &cache) { operator delete (this, cache); }
+        inline void destroy (Slab_cache &cache) { this->~Space_pio(); operator delete (this, cache); }
+
+        static void free (Rcu_elem *e) { auto const o { static_cast<Space_pio *>(e) }; o->get_pd()->reclaim (o); }
 
         static void user_access (uint64 base, size_t size, bool a)
         {
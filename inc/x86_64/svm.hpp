@@ -51,6 +51,7 @@ class Vmcb final
                 uint64      inj_control;            // 0xa8
                 uint64      npt_cr3;                // 0xb0
                 uint64      lbr;                    // 0xb8
+                uint32      clean;                  // 0xc0
             };
         };
 
@@ -68,7 +69,7 @@ class Vmcb final
         uint64              g_pat;
 
         static Paddr        root        CPULOCAL;
-        static unsigned     asid_ctr    CPULOCAL;
+        static Paddr        hsave       CPULOCAL;
         static uint32       svm_version CPULOCAL;
         static uint32       svm_feature CPULOCAL;
 
@@ -142,6 +143,30 @@ class Vmcb final
             CPU_TLBSYNC     = BIT  (4),
         };
 
+        // State that VMRUN may use from its cache instead of loading it from the VMCB
+        enum Clean : uint32
+        {
+            CLEAN_I         = BIT  (0),     // Intercepts, TSC offset
+            CLEAN_IOPM      = BIT  (1),     // I/O and MSR permission maps
+            CLEAN_ASID      = BIT  (2),     // ASID
+            CLEAN_TPR       = BIT  (3),     // Virtual interrupt control
+            CLEAN_NP        = BIT  (4),     // Nested paging: nCR3, gPAT
+            CLEAN_CR        = BIT  (5),     // CR0, CR3, CR4, EFER
+            CLEAN_DR        = BIT  (6),     // DR6, DR7
+            CLEAN_DT        = BIT  (7),     // GDTR, IDTR
+            CLEAN_SEG       = BIT  (8),     // CS, DS, ES, SS, CPL
+            CLEAN_CR2       = BIT  (9),     // CR2
+            CLEAN_LBR       = BIT (10),     // Last branch records
+            CLEAN_ALL       = BIT_RANGE (10, 0),
+        };
+
+        enum Tlb : uint32
+        {
+            TLB_NONE        = 0,            // No flush
+            TLB_ALL         = 1,            // Flush all ASIDs
+            TLB_ASID        = 3,            // Flush this ASID
+        };
+
         static constexpr uint32 force_ctrl0 {   CPU_INTR        |
                                                 CPU_NMI         |
                                                 CPU_INIT        |
@@ -156,16 +181,32 @@ class Vmcb final
                                                 CPU_CLGI        |
                                                 CPU_SKINIT      };
 
-        Vmcb (mword, mword);
+        Vmcb();
 
+        /*
+         * Mark state as modified, so that the next VMRUN loads it from the VMCB
+         *
+         * @param c     Modified state
+         */
         ALWAYS_INLINE
-        inline Vmcb()
-        {
-            asm volatile ("vmsave" : : "a" (Kmem::ptr_to_phys (this)) : "memory");
-        }
+        inline void modify (Clean c) { clean &= ~c; }
+
+        /*
+         * Request a TLB flush for the next VMRUN
+         *
+         * @param t     Flush type, which only ever widens
+         */
+        ALWAYS_INLINE
+        inline void flush (Tlb t) { if (tlb_control != TLB_ALL) tlb_control = t; }
+
+        // Flush the translations of this ASID, or of all ASIDs if the CPU cannot flush by ASID
+        ALWAYS_INLINE
+        inline void flush_asid() { flush (has_flush_asid() ? TLB_ASID : TLB_ALL); }
 
-        static bool has_npt() { return Vmcb::svm_feature & 1; }
-        static bool has_urg() { return true; }
+        static bool has_npt()        { return Vmcb::svm_feature & BIT (0); }
+        static bool has_clean()      { return Vmcb::svm_feature & BIT (5); }
+        static bool has_flush_asid() { return Vmcb::svm_feature & BIT (6); }
+        static bool has_urg()        { return true; }
 
         static void init();
 
@@ -21,10 +21,36 @@
 
 #pragma once
 
+#include "cpuset.hpp"
+#include "memory.hpp"
+
 class Space;
+class Space_hst;
 
 class Tlb final
 {
+    private:
+        // Shootdown request of the initiating CPU
+        struct Request
+        {
+            Space_hst * hst     { nullptr };    // Host space (ranged invalidation) or nullptr (flush)
+            uint64      addr    { 0 };          // Base address of the range
+            uint64      size    { 0 };          // Size of the range
+            Cpuset      cpus;                   // CPUs that still have to invalidate the range
+        };
+
+        static Request request CPULOCAL;
+
+        static void invalidate (Space_hst *, uint64, uint64);
+
+        static void broadcast();
+
     public:
+        // Ranges up to this size are invalidated page by page, larger ranges are flushed entirely
+        static constexpr uint64 max_size { 32 * PAGE_SIZE };
+
         static void shootdown (Space *);
+        static void shootdown (Space_hst *, uint64, uint64);
+
+        static void handle_rke();
 };
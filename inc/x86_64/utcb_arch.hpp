@@ -21,11 +21,13 @@
 
 #pragma once
 
+#include "exit_policy.hpp"
 #include "mtd_arch.hpp"
 
 class Cpu_regs;
 class Exc_regs;
 class Space_obj;
+class Vmcs_cache;
 
 class Utcb_segment final
 {
@@ -34,6 +36,9 @@ class Utcb_segment final
         uint32  limit;
         uint64  base;
 
+        ALWAYS_INLINE
+        inline bool operator== (Utcb_segment const &x) const { return sel == x.sel && ar == x.ar && limit == x.limit && base == x.base; }
+
         ALWAYS_INLINE
         inline void set_vmx (uint16 s, uint64 b, uint32 l, uint32 a)
         {
@@ -46,12 +51,15 @@ class Utcb_segment final
 
 class Utcb_arch final
 {
+    friend class Vmcs_cache;
+
     private:
         uint64          rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi;
         uint64          r8,  r9,  r10, r11, r12, r13, r14, r15;
         uint64          rfl, rip;
         uint32          inst_len, inst_info, intr_state, actv_state;
-        uint64          qual[3], reserved;
+        uint64          qual[3];
+        uint32          intr_status, reserved;
         uint32          ctrl_pri, ctrl_sec;
         uint64          ctrl_ter;
         uint64          intcpt_cr0, intcpt_cr4;
@@ -71,6 +79,13 @@ class Utcb_arch final
             uint64      msr;
         } sel;
 
+        Exit_policy     exits;
+
+        struct {
+            uint64      len;            // Number of bytes fetched
+            uint8       val[16];        // Instruction bytes at RIP
+        } insn;
+
         bool assign_spaces (Cpu_regs &, Space_obj const *) const;
 
     public:
@@ -82,4 +97,4 @@ class Utcb_arch final
         bool save_svm (Mtd_arch const, Cpu_regs &, Space_obj const *) const;
 };
 
-static_assert (__is_standard_layout (Utcb_arch) && sizeof (Utcb_arch) == 0x260);
+static_assert (__is_standard_layout (Utcb_arch) && sizeof (Utcb_arch) == 0x690);
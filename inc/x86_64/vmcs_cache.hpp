@@ -0,0 +1,116 @@
+/*
+ * VMCS Segment Cache
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "slab.hpp"
+#include "utcb_arch.hpp"
+
+/*
+ * The segment cache of a vCPU holds the segment state that was last read
+ * from its VMCS. The guest cannot change that state before the next VM
+ * entry, which invalidates the cache. Until then, segment state that the
+ * VMM transfers back unchanged need not be written to the VMCS, and state
+ * the VMM requests again need not be read from it.
+ */
+class Vmcs_cache final
+{
+    private:
+        Utcb_segment    cs, ss, ds, es, fs, gs, tr, ld, gd, id;
+
+        static Slab_cache cache;
+
+    public:
+        static constexpr uint32 items { Mtd_arch::Item::CS_SS | Mtd_arch::Item::DS_ES | Mtd_arch::Item::FS_GS | Mtd_arch::Item::TR |
+                                        Mtd_arch::Item::LDTR  | Mtd_arch::Item::GDTR  | Mtd_arch::Item::IDTR };
+
+        uint32          valid { 0 };    // MTD items the cache holds
+
+        /*
+         * Fill the cache from segment state read from the VMCS
+         *
+         * @param m     MTD items that were read
+         * @param u     UTCB holding the segment state
+         */
+        ALWAYS_INLINE
+        inline void fill (Mtd_arch const m, Utcb_arch const &u)
+        {
+            cs = u.cs; ss = u.ss; ds = u.ds; es = u.es; fs = u.fs;
+            gs = u.gs; tr = u.tr; ld = u.ld; gd = u.gd; id = u.id;
+
+            valid = m & items;
+        }
+
+        /*
+         * Copy cached segment state into a UTCB
+         *
+         * @param m     MTD items to copy
+         * @param u     UTCB
+         * @return      MTD items that were copied
+         */
+        ALWAYS_INLINE
+        inline uint32 copy (Mtd_arch const m, Utcb_arch &u) const
+        {
+            auto const h { m & valid };
+
+            if (h & Mtd_arch::Item::CS_SS) { u.cs = cs; u.ss = ss; }
+            if (h & Mtd_arch::Item::DS_ES) { u.ds = ds; u.es = es; }
+            if (h & Mtd_arch::Item::FS_GS) { u.fs = fs; u.gs = gs; }
+            if (h & Mtd_arch::Item::TR)      u.tr = tr;
+            if (h & Mtd_arch::Item::LDTR)    u.ld = ld;
+            if (h & Mtd_arch::Item::GDTR)    u.gd = gd;
+            if (h & Mtd_arch::Item::IDTR)    u.id = id;
+
+            return h;
+        }
+
+        /*
+         * Determine which segment state in a UTCB the VMCS already holds
+         *
+         * @param m     MTD items to compare
+         * @param u     UTCB
+         * @return      MTD items whose segment state is unchanged
+         */
+        ALWAYS_INLINE
+        inline uint32 same (Mtd_arch const m, Utcb_arch const &u) const
+        {
+            auto const h { m & valid };
+
+            uint32 s { 0 };
+
+            if (h & Mtd_arch::Item::CS_SS && u.cs == cs && u.ss == ss) s |= Mtd_arch::Item::CS_SS;
+            if (h & Mtd_arch::Item::DS_ES && u.ds == ds && u.es == es) s |= Mtd_arch::Item::DS_ES;
+            if (h & Mtd_arch::Item::FS_GS && u.fs == fs && u.gs == gs) s |= Mtd_arch::Item::FS_GS;
+            if (h & Mtd_arch::Item::TR    && u.tr == tr)               s |= Mtd_arch::Item::TR;
+            if (h & Mtd_arch::Item::LDTR  && u.ld == ld)               s |= Mtd_arch::Item::LDTR;
+            if (h & Mtd_arch::Item::GDTR  && u.gd == gd)               s |= Mtd_arch::Item::GDTR;
+            if (h & Mtd_arch::Item::IDTR  && u.id == id)               s |= Mtd_arch::Item::IDTR;
+
+            return s;
+        }
+
+        [[nodiscard]] static inline void *operator new (size_t) noexcept
+        {
+            return cache.alloc();
+        }
+
+        static inline void operator delete (void *ptr)
+        {
+            if (EXPECT_TRUE (ptr))
+                cache.free (ptr);
+        }
+};
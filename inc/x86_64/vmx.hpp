@@ -35,6 +35,7 @@ class Vmcs final
         static uint64   basic       CPULOCAL;
         static uint64   ept_vpid    CPULOCAL;
         static uint32   pin         CPULOCAL;
+        static uint32   pin_clr     CPULOCAL;
         static uint32   ent         CPULOCAL;
         static uint32   exi_pri     CPULOCAL;
         static uint64   exi_sec     CPULOCAL;
@@ -512,13 +513,15 @@ class Vmcs final
             VMX_EPT_VIOLATION       = 48,
             VMX_EPT_MISCONFIG       = 49,
             VMX_INVEPT              = 50,
+            VMX_RDTSCP              = 51,
             VMX_PREEMPT             = 52,
             VMX_INVVPID             = 53,
             VMX_WBINVD              = 54,
             VMX_XSETBV              = 55,
+            VMX_PML_FULL            = 62,
         };
 
-        void init (uintptr_t, uintptr_t, uint16);
+        void init (uintptr_t, uintptr_t);
 
         ALWAYS_INLINE
         inline void clear()
@@ -568,6 +571,9 @@ class Vmcs final
             return has_vpid() ? read<uint16> (Encoding::VPID) : 0;
         }
 
+        // The page-modification log fills from the last entry downward
+        static constexpr uint16 pml_entries { PAGE_SIZE / sizeof (uint64) };
+
         static inline bool has_exi_sec()        { return exi_pri     & Exi_pri::EXI_SECONDARY; }
         static inline bool has_cpu_sec()        { return cpu_pri_clr & Cpu_pri::CPU_SECONDARY; }
         static inline bool has_cpu_ter()        { return cpu_pri_clr & Cpu_pri::CPU_TERTIARY; }
@@ -575,10 +581,21 @@ class Vmcs final
         static inline bool has_vpid()           { return cpu_sec_clr & Cpu_sec::CPU_VPID; }
         static inline bool has_urg()            { return cpu_sec_clr & Cpu_sec::CPU_URG; }
         static inline bool has_mbec()           { return cpu_sec_clr & Cpu_sec::CPU_MBEC; }
+        static inline bool has_tpr()            { return cpu_pri_clr & Cpu_pri::CPU_TPR_SHADOW; }
+        static inline bool has_vint()           { return cpu_sec_clr & Cpu_sec::CPU_VIRT_INTR; }
+        static inline bool has_pi()             { return (pin_clr & Pin::PIN_POSTED_INTR) && has_vint() && has_tpr(); }
         static inline bool has_invept()         { return ept_vpid & BIT64 (20); }
+        static inline bool has_ept_ad()         { return ept_vpid & BIT64 (21); }
+        static inline bool has_pml()            { return cpu_sec_clr & Cpu_sec::CPU_PML && has_ept_ad(); }
         static inline bool has_invvpid()        { return ept_vpid & BIT64 (32); }
         static inline bool has_invvpid_sgl()    { return ept_vpid & BIT64 (41); }
 
+        ALWAYS_INLINE
+        static inline void set_pin (uint32 val)
+        {
+            write (Encoding::PIN_CONTROLS, pin | (val & pin_clr));
+        }
+
         static void init();
         static void fini();
 
@@ -20,8 +20,9 @@
 
 #pragma once
 
-#include "atomic.hpp"
-#include "kmem.hpp"
+#include "compiler.hpp"
+#include "macros.hpp"
+#include "types.hpp"
 
 class Invvpid final
 {
@@ -45,13 +46,40 @@ class Invvpid final
 class Vpid final
 {
     private:
-        static Atomic<uint16> allocator CPULOCAL;
+        uint64 tag { 0 };                       // Generation and VPID of the vCPU on its CPU
+
+        static uint64 gen CPULOCAL;             // Generation and most recently assigned VPID of this CPU
+
+        static constexpr auto bits { 16 };
 
     public:
-        // FIXME: Handle overflow
-        static inline auto alloc (unsigned cpu)
+        /*
+         * Determine the VPID of the vCPU on the current CPU
+         *
+         * @return  VPID, or 0 if the vCPU has no VPID in the current generation of the CPU
+         */
+        inline uint16 get() const
+        {
+            return (tag ^ gen) >> bits ? 0 : static_cast<uint16>(tag);
+        }
+
+        /*
+         * Assign a new VPID to the vCPU on the current CPU
+         *
+         * Once all VPIDs are used up, a new generation starts and the translations of all
+         * VPIDs of the CPU are flushed before any of them is assigned again.
+         *
+         * @return  VPID
+         */
+        inline uint16 alloc()
         {
-            return ++*Kmem::loc_to_glob (&allocator, cpu);
+            // VPID 0 belongs to the host
+            if (EXPECT_FALSE (!static_cast<uint16>(++gen))) {
+                gen++;
+                invalidate (Invvpid::Type::ALL, 0);
+            }
+
+            return static_cast<uint16>(tag = gen);
         }
 
         static inline void invalidate (Invvpid::Type t, uint16 vpid, uint64 addr = 0)
@@ -20,6 +20,7 @@
 #include "gicd.hpp"
 #include "gich.hpp"
 #include "gicr.hpp"
+#include "gits.hpp"
 #include "psci.hpp"
 #include "stdio.hpp"
 #include "util.hpp"
@@ -71,7 +72,18 @@ void Acpi_table_madt::Controller_gicc::parse() const
         Cpu::count++;
 }
 
-void Acpi_table_madt::Controller_gits::parse() const {}
+void Acpi_table_madt::Controller_gits::parse() const
+{
+    // Only the first ITS is used
+    if (Gits::phys)
+        return;
+
+    // Use split loads to avoid unaligned accesses
+    Gits::phys = static_cast<uint64>(phys_gits_hi) << 32 | phys_gits_lo;
+
+    trace (TRACE_FIRM | TRACE_PARSE, "MADT: GITS:%#010llx", Gits::phys);
+}
+
 void Acpi_table_madt::Controller_gmsi::parse() const {}
 
 void Acpi_table_madt::parse() const
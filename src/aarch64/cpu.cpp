@@ -23,6 +23,7 @@
 #include "gicd.hpp"
 #include "gich.hpp"
 #include "gicr.hpp"
+#include "gits.hpp"
 #include "ptab_npt.hpp"
 #include "stdio.hpp"
 #include "timer.hpp"
@@ -222,6 +223,7 @@ void Cpu::init (unsigned cpu, unsigned e)
 
     Gicd::init();
     Gicr::init();
+    Gits::init();
     Gicc::init();
     Gich::init();
 
@@ -22,13 +22,16 @@
 #include "event.hpp"
 #include "extern.hpp"
 #include "fpu.hpp"
+#include "gits.hpp"
 #include "pd.hpp"
+#include "rcu.hpp"
 #include "sc.hpp"
 #include "space_gst.hpp"
 #include "space_hst.hpp"
 #include "stdio.hpp"
 #include "timer.hpp"
 #include "vmcb.hpp"
+#include "vpe.hpp"
 
 // Constructor: Kernel Thread
 Ec_arch::Ec_arch (unsigned c, cont_t x) : Ec (&Space_hst::nova, c, x) {}
@@ -56,21 +59,39 @@ Ec_arch::Ec_arch (Space_obj *obj, Space_hst *hst, Fpu *f, Vmcb *v, unsigned c, u
     trace (TRACE_CREATE, "EC:%p created (OBJ:%p HST:%p CPU:%u VMCB:%p %c)", static_cast<void *>(this), static_cast<void *>(obj), static_cast<void *>(hst), c, static_cast<void *>(v), subtype == Kobject::Subtype::EC_VCPU_REAL ? 'R' : 'O');
 
     exc_regs().set_ep (Event::gst_arch + Event::Selector::STARTUP);
+
+    // Without a vPE, MSIs cannot be posted into the vCPU
+    if (Gits::vlpi)
+        regs.vpe = Vpe::create (c);
+}
+
+// Destructor
+Ec_arch::~Ec_arch()
+{
+    if (is_vcpu()) {
+
+        if (Vmcb::current == regs.vmcb)
+            Vmcb::load_hst();
+
+        delete regs.vmcb;
+        delete regs.vpe;
+    }
+
+    if (regs.gst)
+        regs.gst->del_ref();
 }
 
 // Factory: Virtual CPU
-Ec *Ec::create (Status &s, Pd *pd, bool fpu, unsigned c, unsigned long e, bool t)
+Ec *Ec::create (Status &s, Pd *pd, bool fpu, unsigned c, unsigned long e, bool t, uintptr_t)
 {
     auto const obj { pd->get_obj() };
     auto const hst { pd->get_hst() };
 
-    if (EXPECT_FALSE (!obj || !hst)) {
+    if (EXPECT_FALSE (!obj || !hst || !acquire_spaces (obj, hst, nullptr))) {
         s = Status::ABORTED;
         return nullptr;
     }
 
-    // FIXME: Refcount updates
-
     auto const f { fpu ? new (pd->fpu_cache) Fpu : nullptr };
     auto const v { new Vmcb };
     Ec *ec;
@@ -81,6 +102,8 @@ Ec *Ec::create (Status &s, Pd *pd, bool fpu, unsigned c, unsigned long e, bool t
     delete v;
     Fpu::operator delete (f, pd->fpu_cache);
 
+    release_spaces (obj, hst, nullptr);
+
     s = Status::INS_MEM;
 
     return nullptr;
@@ -94,6 +117,9 @@ void Ec::adjust_offset_ticks (uint64 t)
 
 void Ec::handle_hazard (unsigned h, cont_t func)
 {
+    if (h & Hazard::RCU)
+        Rcu::quiet();
+
     if (EXPECT_FALSE (h & (Hazard::ILLEGAL | Hazard::RECALL | Hazard::SLEEP | Hazard::SCHED))) {
 
         Cpu::preemption_point();
@@ -192,8 +218,13 @@ void Ec_arch::ret_user_vmexit (Ec *const self)
     else
         v->load_tmr();      // Restore only vTMR PPI state
 
+    if (self->regs.vpe)
+        self->regs.vpe->schedule();
+
     self->get_gst()->make_current();
 
+    Rcu::eqs_enter();
+
     asm volatile ("mov sp, %0;" EXPAND (LOAD_STATE ERET) : : "r" (&self->exc_regs()), "m" (self->exc_regs()));
 
     UNREACHED;
@@ -22,8 +22,11 @@
 #include "interrupt.hpp"
 #include "pd.hpp"
 #include "smc.hpp"
+#include "space_gst.hpp"
+#include "space_hst.hpp"
 #include "stdio.hpp"
 #include "vmcb.hpp"
+#include "vpe.hpp"
 
 void Ec::fpu_load()
 {
@@ -60,6 +63,8 @@ void Ec_arch::handle_exc_kern (Exc_regs *r)
 
 void Ec_arch::handle_exc_user (Exc_regs *r)
 {
+    Rcu::eqs_exit();
+
     auto const esr { static_cast<uint32>(r->el2.esr) };
 
     Ec *const self { current };
@@ -78,6 +83,29 @@ void Ec_arch::handle_exc_user (Exc_regs *r)
     else if (r->ep() == 0x7)
         resolved = switch_fpu (self);
 
+    // Stage-2 permission fault on a write to a page that may be write-protected for dirty logging
+    else if (r->ep() == 0x24 && self->is_vcpu() && (esr & BIT_RANGE (5, 2)) == 0xc && esr & BIT (6)) {
+        uint64 hpfar;
+        asm volatile ("mrs %x0, hpfar_el2" : "=r" (hpfar));
+        resolved = self->get_gst()->unprotect ((hpfar & BIT64_RANGE (43, 4)) << 8);
+    }
+
+    // Stage-2 access flag fault on a page whose access flag was cleared for working-set estimation
+    else if ((r->ep() == 0x20 || r->ep() == 0x24) && (esr & BIT_RANGE (5, 2)) == 0x8) {
+        uint64 hpfar;
+        asm volatile ("mrs %x0, hpfar_el2" : "=r" (hpfar));
+        auto const v { (hpfar & BIT64_RANGE (43, 4)) << 8 };
+        resolved = self->is_vcpu() ? self->get_gst()->touch (v) : self->get_hst()->touch (v);
+    }
+
+    // WFI from a vCPU makes its vPE non-resident, so that vLPIs arriving while the VMM blocks ring their doorbells
+    else if (r->ep() == 0x1 && self->is_vcpu() && !(esr & BIT (0)) && self->regs.vpe) {
+
+        // WFI completes without an exit to the VMM if a vLPI is pending already
+        if ((resolved = self->regs.vpe->deschedule()))
+            r->el2.elr += esr & BIT (25) ? 4 : 2;
+    }
+
     trace (TRACE_EXCEPTION, "EC:%p %s %#llx at M:%#x IP:%#llx", static_cast<void *>(self), self->is_vcpu() ? "VMX" : "EXC", r->ep(), r->mode(), r->el2.elr);
 
     if (self->is_vcpu()) {
@@ -89,11 +117,15 @@ void Ec_arch::handle_exc_user (Exc_regs *r)
 
 void Ec_arch::handle_irq_kern()
 {
+    Rcu::eqs_exit();
+
     Interrupt::handler (false);
 }
 
 void Ec_arch::handle_irq_user()
 {
+    Rcu::eqs_exit();
+
     Ec *const self { current };
 
     Event::Selector evt = Interrupt::handler (self->is_vcpu());
@@ -18,11 +18,21 @@
 #include "acpi.hpp"
 #include "assert.hpp"
 #include "bits.hpp"
+#include "buddy.hpp"
+#include "cache.hpp"
 #include "gicd.hpp"
 #include "gicr.hpp"
+#include "gits.hpp"
+#include "kmem.hpp"
 #include "lowlevel.hpp"
 #include "space_hst.hpp"
 #include "stdio.hpp"
+#include "vpe.hpp"
+
+uint64 Gicr::rd_phys;
+uint64 Gicr::rd_type;
+uint64 Gicr::resident;
+void * Gicr::lpend;
 
 void Gicr::init()
 {
@@ -62,9 +72,24 @@ bool Gicr::mmap_mmio()
 
         if (type >> 32 == Cpu::affinity()) {
 
-            trace (TRACE_INTR, "GICR: %#010llx v%u r%up%u Impl:%#x Prod:%#x EPPI:%u MPAM:%u",
+            trace (TRACE_INTR, "GICR: %#010llx v%u r%up%u Impl:%#x Prod:%#x EPPI:%u MPAM:%u VLPI:%u",
                    addr, arch, iidr >> 16 & BIT_RANGE (3, 0), iidr >> 12 & BIT_RANGE (3, 0), iidr & BIT_RANGE (11, 0), iidr >> 24,
-                   !!(type >> 27 & BIT_RANGE (4, 0)), !!(type & BIT (6)));
+                   !!(type >> 27 & BIT_RANGE (4, 0)), !!(type & BIT (6)), !!(type & BIT (1)));
+
+            rd_phys = addr;
+            rd_type = type;
+
+            // Direct injection requires vLPI support in all redistributors
+            Gits::vlpi &= !!(type & BIT (1));
+
+            // Map the vLPI frames as well
+            if (size > 0x20000) {
+                Hptp::current().update (MMAP_CPU_GICR, addr, bit_scan_reverse (size) - PAGE_BITS,
+                                        Paging::Permissions (Paging::G | Paging::W | Paging::R),
+                                        Memattr::Cacheability::DEV, Memattr::Shareability::NONE);
+
+                Hptp::invalidate_cpu(); // XXX: Should invalidate VA
+            }
 
             // Reserve MMIO region
             Space_hst::user_access (addr, size, false);
@@ -114,6 +139,57 @@ void Gicr::init_mmio()
     write (Register32::WAKER, 0);
     while (read (Register32::WAKER) & BIT (2))
         pause();
+
+    // No vPE is resident after reset
+    resident = 0;
+
+    // Physical LPIs are only used as doorbells for vLPIs. Their tables must not change once enabled,
+    // so doorbells remain unused if LPIs are already enabled with tables other than ours.
+    if (rd_type & BIT (1)) {
+
+        if (read (Register32::CTLR) & BIT (0))
+            lpi &= lprop && lpend && (read (Register64::PROPBASER) & BIT64_RANGE (51, 12)) == Kmem::ptr_to_phys (lprop)
+                                  && (read (Register64::PENDBASER) & BIT64_RANGE (51, 16)) == Kmem::ptr_to_phys (lpend);
+
+        else if (init_lpi())
+            write (Register32::CTLR, BIT (0));
+
+        else
+            lpi = false;
+    }
+}
+
+/*
+ * Allocate (once) and program the LPI tables
+ *
+ * @return      true if successful, false otherwise
+ */
+bool Gicr::init_lpi()
+{
+    // All doorbells are enabled at the same priority
+    if (Cpu::bsp && !lprop) {
+
+        constexpr auto size { BIT (lpi_bits) - BASE_LPI };
+
+        if (!(lprop = Buddy::alloc (static_cast<unsigned>(bit_scan_reverse (size)) - PAGE_BITS)))
+            return false;
+
+        for (unsigned i { 0 }; i < size; i++)
+            static_cast<uint8 *>(lprop)[i] = 0xa0 | BIT (1) | BIT (0);
+
+        Cache::data_clean (lprop, size);
+    }
+
+    // The LPI pending table must be 64K-aligned
+    if (!lprop || (!lpend && !(lpend = Buddy::alloc (4, Buddy::Fill::BITS0))))
+        return false;
+
+    Cache::data_clean (lpend, BIT (lpi_bits - 3));
+
+    write (Register64::PROPBASER, Kmem::ptr_to_phys (lprop) | attr | (lpi_bits - 1));
+    write (Register64::PENDBASER, Kmem::ptr_to_phys (lpend) | attr);
+
+    return true;
 }
 
 bool Gicr::get_act (unsigned i)
@@ -155,3 +231,67 @@ void Gicr::wait_rwp()
     while (read (Register32::CTLR) & BIT (3))
         pause();
 }
+
+/*
+ * Determine the target address of the redistributor of a CPU for ITS commands
+ *
+ * @param cpu   CPU number
+ * @param pta   true if the ITS uses physical target addresses, false for processor numbers
+ * @return      RDbase in the format of ITS commands
+ */
+uint64 Gicr::rdbase (unsigned cpu, bool pta)
+{
+    return pta ? *Kmem::loc_to_glob (&rd_phys, cpu) : (*Kmem::loc_to_glob (&rd_type, cpu) >> 8 & BIT_RANGE (15, 0)) << 16;
+}
+
+/*
+ * Switch the resident vPE
+ *
+ * The redistributor writes the pending state of the outgoing vPE back to its VPT.
+ *
+ * @param vpt   Physical address of the VPT of the incoming vPE, or 0 for none
+ * @return      true if vLPIs of the outgoing vPE were pending, false otherwise
+ */
+bool Gicr::set_vpt (uint64 vpt)
+{
+    uint64 v { 0 };
+
+    if (resident) {
+
+        write (Register64::VPENDBASER, attr);
+
+        while ((v = read (Register64::VPENDBASER)) & BIT64 (60))
+            pause();
+    }
+
+    if ((resident = vpt)) {
+
+        write (Register64::VPROPBASER, Kmem::ptr_to_phys (Gits::vprop) | attr | (Vpe::bits - 1));
+
+        // The IMPLEMENTATION DEFINED area of the VPT is not maintained and vLPIs may have been pending before
+        write (Register64::VPENDBASER, BIT64_RANGE (63, 61) | vpt | attr);
+    }
+
+    // PendingLast is valid once the outgoing vPE is no longer dirty
+    return v & BIT64 (61);
+}
+
+/*
+ * Ensure a vPE is no longer resident
+ *
+ * @param vpt   Physical address of the VPT of the vPE
+ * @param cpu   CPU the vPE is mapped to
+ * @return      true if the VPT is no longer in use, false if it is still resident on a remote CPU
+ */
+bool Gicr::evict (uint64 vpt, unsigned cpu)
+{
+    if (*Kmem::loc_to_glob (&resident, cpu) != vpt)
+        return true;
+
+    if (cpu != Cpu::id)
+        return false;
+
+    set_vpt (0);
+
+    return true;
+}
@@ -0,0 +1,323 @@
+/*
+ * Generic Interrupt Controller: Interrupt Translation Service (GITS)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "acpi.hpp"
+#include "barrier.hpp"
+#include "bits.hpp"
+#include "buddy.hpp"
+#include "cache.hpp"
+#include "cpu.hpp"
+#include "gicr.hpp"
+#include "gits.hpp"
+#include "kmem.hpp"
+#include "lock_guard.hpp"
+#include "lowlevel.hpp"
+#include "space_hst.hpp"
+#include "stdio.hpp"
+#include "util.hpp"
+#include "vpe.hpp"
+
+void Gits::init()
+{
+    if (!Cpu::bsp)
+        return;
+
+    if (!Acpi::resume && !mmap_mmio())
+        vlpi = false;
+
+    // The ITS is only used for direct injection of vLPIs
+    if (vlpi && !init_mmio())
+        vlpi = false;
+}
+
+bool Gits::mmap_mmio()
+{
+    if (!phys)
+        return false;
+
+    Hptp::master_map (MMAP_GLB_GITS, phys, bit_scan_reverse (0x10000) - PAGE_BITS,
+                      Paging::Permissions (Paging::G | Paging::W | Paging::R),
+                      Memattr::Cacheability::DEV, Memattr::Shareability::NONE);
+
+    auto const pidr { Coresight::read (Coresight::Component::PIDR2, MMAP_GLB_GITS + 0x10000) };
+
+    if (!pidr)
+        return false;
+
+    auto const iidr  { read (Register32::IIDR) };
+    auto const typer { read (Register64::TYPER) };
+
+    dev_bits   = (typer >> 13 & BIT_RANGE (4, 0)) + 1;
+    pta        = typer & BIT (19);
+    translater = phys + 0x10040;
+
+    // EventIDs are interrupt slots, which need evt_bits
+    vlpi &= !!(typer & BIT (1)) && (typer >> 8 & BIT_RANGE (4, 0)) + 1 >= evt_bits;
+
+    trace (TRACE_INTR, "GITS: %#010llx v%u r%up%u Impl:%#x Prod:%#x PHYS:%u VIRT:%u PTA:%u DEV:%u ITE:%llu",
+           phys, pidr >> 4 & BIT_RANGE (3, 0), iidr >> 16 & BIT_RANGE (3, 0), iidr >> 12 & BIT_RANGE (3, 0), iidr & BIT_RANGE (11, 0), iidr >> 24,
+           !!(typer & BIT (0)), !!(typer & BIT (1)), pta, dev_bits, (typer >> 4 & BIT_RANGE (3, 0)) + 1);
+
+    // Reserve MMIO region of the control frame. The translation frame is the target of device MSIs.
+    Space_hst::user_access (phys, 0x10000, false);
+
+    return true;
+}
+
+bool Gits::init_mmio()
+{
+    // Disable the ITS and wait until it is quiescent
+    write (Register32::CTLR, 0);
+    while (!(read (Register32::CTLR) & BIT (31)))
+        pause();
+
+    if (!cmdq && !(cmdq = static_cast<uint64 *>(Buddy::alloc (cmdq_ord, Buddy::Fill::BITS0))))
+        return false;
+
+    // All vLPIs are enabled at the same priority. The property table is shared by all vPEs.
+    if (!vprop) {
+
+        constexpr auto size { BIT (Vpe::bits) - Vpe::base };
+
+        if (!(vprop = Buddy::alloc (static_cast<unsigned>(bit_scan_reverse (size)) - PAGE_BITS)))
+            return false;
+
+        for (unsigned i { 0 }; i < size; i++)
+            static_cast<uint8 *>(vprop)[i] = 0xa0 | BIT (1) | BIT (0);
+
+        Cache::data_clean (vprop, size);
+    }
+
+    for (unsigned n { 0 }; n < sizeof (table) / sizeof (*table); n++) {
+
+        switch (static_cast<Table>(read (Array64::BASER, n) >> 56 & BIT_RANGE (2, 0))) {
+
+            case Table::DEV:
+                if (!(dev_num = init_table (n, BIT (min (dev_bits, 16U)))))
+                    return false;
+                break;
+
+            case Table::VPE:
+                if (!init_table (n, Vpe::num))
+                    return false;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    write (Register64::CBASER, BIT64 (63) | attr | Kmem::ptr_to_phys (cmdq) | (BIT (cmdq_ord) - 1));
+
+    // A non-shareable ITS does not snoop our caches
+    nc |= !(read (Register64::CBASER) & BIT_RANGE (11, 10));
+
+    write (Register64::CWRITER, cwr = 0);
+
+    // Enable the ITS
+    write (Register32::CTLR, BIT (0));
+
+    return true;
+}
+
+/*
+ * Allocate (once) and program a flat translation table
+ *
+ * @param n     Index of the BASER register
+ * @param e     Number of entries
+ * @return      Number of entries the table covers, or 0 on allocation failure
+ */
+unsigned Gits::init_table (unsigned n, unsigned e)
+{
+    auto const esz { static_cast<unsigned>(read (Array64::BASER, n) >> 48 & BIT_RANGE (4, 0)) + 1 };
+
+    // Tables are 64K-aligned, which satisfies all page sizes, and at most 1M large
+    auto const ord { static_cast<uint8>(min (max (static_cast<unsigned>(bit_scan_reverse (esz * e - 1)) + 1, cmdq_ord + PAGE_BITS), 20U) - PAGE_BITS) };
+
+    if (!table[n] && !(table[n] = Buddy::alloc (ord, Buddy::Fill::BITS0)))
+        return 0;
+
+    // Try 64K, 16K, 4K pages
+    for (unsigned p { 2 };; p--) {
+
+        auto const v { BIT64 (63) | attr | Kmem::ptr_to_phys (table[n]) | p << 8 | ((BIT (ord + PAGE_BITS) >> (PAGE_BITS + 2 * p)) - 1) };
+
+        write (Array64::BASER, n, v);
+
+        auto const r { read (Array64::BASER, n) };
+
+        if ((r >> 8 & BIT_RANGE (1, 0)) != p && p)
+            continue;
+
+        if (!(r & BIT_RANGE (11, 10))) {
+            nc = true;
+            Cache::data_clean (table[n], BIT (ord + PAGE_BITS));
+        }
+
+        break;
+    }
+
+    return BIT (ord + PAGE_BITS) / esz;
+}
+
+/*
+ * Issue a command and wait for its completion
+ *
+ * Must be called with the lock held.
+ *
+ * @param c     Command
+ * @param d0    Doubleword 0 without the command number
+ * @param d1    Doubleword 1
+ * @param d2    Doubleword 2
+ * @param d3    Doubleword 3
+ * @return      true if the ITS consumed the command, false if it stalled
+ */
+bool Gits::command (Command c, uint64 d0, uint64 d1, uint64 d2, uint64 d3)
+{
+    auto const q { cmdq + cwr * 4 };
+
+    q[0] = d0 | std::to_underlying (c);
+    q[1] = d1;
+    q[2] = d2;
+    q[3] = d3;
+
+    if (nc)
+        Cache::data_clean (q, 4 * sizeof (*q));
+
+    cwr = (cwr + 1) % cmdq_num;
+
+    // Ensure the command is observable before the ITS gets to read it
+    Barrier::wsb (Barrier::ISH);
+
+    write (Register64::CWRITER, cwr * 32);
+
+    for (uint64 r; (r = read (Register64::CREADR)) != cwr * 32; pause()) {
+
+        if (EXPECT_FALSE (r & BIT (0))) {
+            trace (TRACE_ERROR, "GITS: Command %#x stalled", std::to_underlying (c));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Map a device to an ITT, unless it already is
+ *
+ * Must be called with the lock held. The DeviceID is assumed to equal the requester ID.
+ *
+ * @param rid   DeviceID
+ * @return      true if the device is mapped, false otherwise
+ */
+bool Gits::map_dev (uint16 rid)
+{
+    Device *f { nullptr };
+
+    for (auto &d : device) {
+
+        if (d.itt && d.rid == rid)
+            return true;
+
+        if (!d.itt && !f)
+            f = &d;
+    }
+
+    if (!f || rid >= dev_num)
+        return false;
+
+    auto const itt { Buddy::alloc (itt_ord, Buddy::Fill::BITS0) };
+
+    if (!itt)
+        return false;
+
+    if (nc)
+        Cache::data_clean (itt, BIT (itt_ord + PAGE_BITS));
+
+    if (!command (Command::MAPD, static_cast<uint64>(rid) << 32, evt_bits - 1, BIT64 (63) | Kmem::ptr_to_phys (itt), 0)) {
+        Buddy::free (itt);
+        return false;
+    }
+
+    f->itt = itt;
+    f->rid = rid;
+
+    return true;
+}
+
+/*
+ * Map or unmap a vPE
+ *
+ * @param vid   vPEID
+ * @param cpu   CPU whose redistributor hosts the vPE
+ * @param vpt   Physical address of the virtual pending table
+ * @param v     true to map, false to unmap
+ * @return      true if successful, false otherwise
+ */
+bool Gits::map_vpe (uint16 vid, unsigned cpu, uint64 vpt, bool v)
+{
+    auto const rd { Gicr::rdbase (cpu, pta) };
+
+    Lock_guard <Spinlock> guard (lock);
+
+    if (!command (Command::VMAPP, 0, static_cast<uint64>(vid) << 32, static_cast<uint64>(v) << 63 | rd, vpt | (Vpe::bits - 1)))
+        return false;
+
+    return v ? command (Command::VSYNC, 0, static_cast<uint64>(vid) << 32, 0, 0) : command (Command::SYNC, 0, 0, rd, 0);
+}
+
+/*
+ * Translate an event of a device into a vLPI
+ *
+ * If the vPE is not resident, the ITS also raises the doorbell. Without a doorbell (1023),
+ * a vPE that is not resident observes the vLPI once it becomes resident again.
+ *
+ * @param rid   DeviceID
+ * @param evt   EventID
+ * @param vid   vPEID
+ * @param vint  vINTID
+ * @param dbell Doorbell pINTID or 1023 for none
+ * @return      SUCCESS, BAD_DEV if the device cannot be mapped, or ABORTED if the ITS stalled
+ */
+Status Gits::assign (uint16 rid, uint32 evt, uint16 vid, uint32 vint, uint32 dbell)
+{
+    Lock_guard <Spinlock> guard (lock);
+
+    if (EXPECT_FALSE (!map_dev (rid)))
+        return Status::BAD_DEV;
+
+    if (EXPECT_FALSE (!command (Command::VMAPTI, static_cast<uint64>(rid) << 32, static_cast<uint64>(vid) << 32 | evt, static_cast<uint64>(dbell) << 32 | vint, 0) ||
+                      !command (Command::VSYNC, 0, static_cast<uint64>(vid) << 32, 0, 0)))
+        return Status::ABORTED;
+
+    return Status::SUCCESS;
+}
+
+/*
+ * Remove the translation of an event of a device
+ *
+ * @param rid   DeviceID
+ * @param evt   EventID
+ * @param vid   vPEID the event was translated for
+ */
+void Gits::discard (uint16 rid, uint32 evt, uint16 vid)
+{
+    Lock_guard <Spinlock> guard (lock);
+
+    if (command (Command::DISCARD, static_cast<uint64>(rid) << 32, evt, 0, 0))
+        command (Command::VSYNC, 0, static_cast<uint64>(vid) << 32, 0, 0);
+}
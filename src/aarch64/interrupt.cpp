@@ -21,13 +21,16 @@
 #include "gicc.hpp"
 #include "gicd.hpp"
 #include "gicr.hpp"
+#include "gits.hpp"
 #include "interrupt.hpp"
+#include "rcu.hpp"
 #include "sc.hpp"
 #include "sm.hpp"
 #include "smmu.hpp"
 #include "space_obj.hpp"
 #include "stdio.hpp"
 #include "timer.hpp"
+#include "vpe.hpp"
 
 Interrupt Interrupt::int_table[NUM_SPI];
 
@@ -36,10 +39,25 @@ unsigned Interrupt::num_pin()
     return Intid::to_spi (Gicd::intid);
 }
 
+/*
+ * The remaining slots are MSIs, which the ITS translates into vLPIs
+ */
+unsigned Interrupt::num_msi()
+{
+    return Gits::vlpi ? NUM_SPI - num_pin() : 0;
+}
+
+bool Interrupt::postable (unsigned spi)
+{
+    return spi >= num_pin();
+}
+
 void Interrupt::rke_handler()
 {
     if (Acpi::get_transition().state())
         Cpu::hazard |= Hazard::SLEEP;
+
+    Rcu::update();
 }
 
 Event::Selector Interrupt::handle_sgi (uint32 val, bool)
@@ -75,8 +93,10 @@ Event::Selector Interrupt::handle_ppi (uint32 val, bool vcpu)
     if (ppi == Timer::ppi_el1_v)        // Deactivation by guest
         return vcpu ? Event::Selector::VTIMER : Event::Selector::NONE;
 
-    if (ppi == Timer::ppi_el2_p)        // Deactivation by host
+    if (ppi == Timer::ppi_el2_p) {      // Deactivation by host
         Stc::interrupt();
+        Rcu::update();
+    }
 
     Gicc::dir (val);
 
@@ -91,10 +111,14 @@ Event::Selector Interrupt::handle_spi (uint32 val, bool)
 
     Gicc::eoi (val);
 
-    if (EXPECT_TRUE (int_table[spi].sm))
-        int_table[spi].sm->up();
+    if (EXPECT_TRUE (int_table[spi].sm)) {
+
+        if (int_table[spi].mod.moderated())
+            int_table[spi].mod.arrival();
+        else
+            int_table[spi].sm->up();
 
-    else {
+    } else {
 
         Smmu::interrupt (spi);
 
@@ -104,10 +128,31 @@ Event::Selector Interrupt::handle_spi (uint32 val, bool)
     return Event::Selector::NONE;
 }
 
+/*
+ * Handle the doorbell of an MSI slot
+ *
+ * The ITS rings the doorbell when it posts the MSI into a vPE that is not resident.
+ * LPIs have no active state, so they need no deactivation.
+ */
+Event::Selector Interrupt::handle_lpi (uint32 val, bool)
+{
+    auto const spi { val - BASE_LPI };
+
+    Gicc::eoi (val);
+
+    if (EXPECT_TRUE (spi < NUM_SPI && int_table[spi].sm))
+        int_table[spi].sm->up();
+
+    return Event::Selector::NONE;
+}
+
 Event::Selector Interrupt::handler (bool vcpu)
 {
     auto const val { Gicc::ack() }, i { val & BIT_RANGE (9, 0) };
 
+    if (val >= BASE_LPI)
+        return handle_lpi (val, vcpu);
+
     if (i < BASE_PPI)
         return handle_sgi (val, vcpu);
 
@@ -151,15 +196,74 @@ void Interrupt::conf_spi (unsigned spi, bool msk, bool lvl, unsigned cpu)
     Gicd::conf (Intid::from_spi (spi), msk, lvl, cpu);
 }
 
-void Interrupt::configure (unsigned spi, Config cfg, uint32 &msi_addr, uint16 &msi_data)
+Status Interrupt::configure (unsigned spi, Config cfg, uint64 mod, Ec *vcpu, uint16 vec, uint64 &msi_addr, uint16 &msi_data)
 {
-    trace (TRACE_INTR, "INTR: SPI:%#06x %c%c%c routed to CPU:%u", spi, cfg.msk() ? 'M' : 'U', cfg.trg() ? 'L' : 'E', cfg.gst() ? 'G' : 'H', cfg.cpu());
+    if (postable (spi))
+        return configure_msi (spi, cfg, vcpu, vec, msi_addr, msi_data);
+
+    // Only MSIs can be posted into a vCPU
+    if (EXPECT_FALSE (vcpu))
+        return Status::BAD_FTR;
+
+    // A host SPI stays active until the VMM deactivates it, so moderation could only add latency
+    if (EXPECT_FALSE (mod))
+        return Status::BAD_FTR;
+
+    trace (TRACE_INTR, "INTR: SPI:%#06x %c%c%c routed to CPU:%u MOD:%#llx", spi, cfg.msk() ? 'M' : 'U', cfg.trg() ? 'L' : 'E', cfg.gst() ? 'G' : 'H', cfg.cpu(), mod);
 
     int_table[spi].config = cfg;
+    int_table[spi].mod.configure (int_table[spi].sm, mod);
 
     conf_spi (spi, cfg.msk(), cfg.trg(), cfg.cpu());
 
     msi_addr = msi_data = 0;
+
+    return Status::SUCCESS;
+}
+
+/*
+ * Post an MSI into a vCPU
+ *
+ * Physical LPIs only serve as doorbells, so an MSI must be posted. The EventID is the interrupt slot.
+ *
+ * @param spi       Interrupt slot
+ * @param cfg       Interrupt configuration
+ * @param vcpu      vCPU to post into
+ * @param vec       vINTID in the vCPU
+ * @param msi_addr  MSI address to program into the device
+ * @param msi_data  MSI data to program into the device
+ * @return          SUCCESS or failure status
+ */
+Status Interrupt::configure_msi (unsigned spi, Config cfg, Ec *vcpu, uint16 vec, uint64 &msi_addr, uint16 &msi_data)
+{
+    if (EXPECT_FALSE (!vcpu || !vcpu->regs.vpe))
+        return Status::BAD_FTR;
+
+    if (EXPECT_FALSE (!Vpe::valid (vec)))
+        return Status::BAD_PAR;
+
+    trace (TRACE_INTR, "INTR: MSI:%#06x RID:%#06x posted into vCPU:%p vINTID:%u", spi, cfg.rid(), static_cast<void *>(vcpu), vec);
+
+    // Remove the previous translation and release the reference to the vCPU it was posted into
+    Ec *old, *none { nullptr };
+    int_table[spi].vcpu.exchange (old, none);
+
+    if (old) {
+        Gits::discard (int_table[spi].config.load().rid(), spi, old->regs.vpe->id());
+        old->del_ref();
+    }
+
+    // The doorbell of the slot wakes the VMM when the MSI arrives while the vPE is not resident
+    if (auto const s { Gits::assign (cfg.rid(), spi, vcpu->regs.vpe->id(), vec, Gicr::lpi ? BASE_LPI + spi : 1023) }; EXPECT_FALSE (s != Status::SUCCESS))
+        return s;
+
+    int_table[spi].config = cfg;
+    int_table[spi].vcpu   = vcpu;
+
+    msi_addr = Gits::translater;
+    msi_data = static_cast<uint16>(spi);
+
+    return Status::SUCCESS;
 }
 
 void Interrupt::deactivate (unsigned spi)
@@ -179,9 +283,9 @@ void Interrupt::send_exc (Request req)
 
 void Interrupt::init()
 {
-    assert (num_pin() <= sizeof (int_table) / sizeof (*int_table));
+    assert (num_pin() + num_msi() <= sizeof (int_table) / sizeof (*int_table));
 
-    for (unsigned spi { 0 }; spi < num_pin(); spi++) {
+    for (unsigned spi { 0 }; spi < num_pin() + num_msi(); spi++) {
 
         // Don't touch SMMU interrupts
         if (Smmu::using_spi (spi))
@@ -193,8 +297,9 @@ void Interrupt::init()
         if (Cpu::id != cfg.cpu())
             continue;
 
-        // Configure interrupt
-        conf_spi (spi, cfg.msk(), cfg.trg(), cfg.cpu());
+        // Configure interrupt. MSIs are translated by the ITS.
+        if (spi < num_pin())
+            conf_spi (spi, cfg.msk(), cfg.trg(), cfg.cpu());
 
         Status s;
 
@@ -18,3 +18,70 @@
 #include "ptab_npt.hpp"
 
 uint64 Nptp::current;
+
+/*
+ * Dirty logging write-protects clean leaf PTEs and restores write access upon the first
+ * write. Working-set estimation likewise clears the access flag of leaf PTEs and sets it
+ * again upon the access flag fault of the next access. The stage-2 page table of a space
+ * is coherent, so no cache maintenance is required for its PTEs.
+ */
+
+/*
+ * Restore write access to a page that was write-protected for dirty logging
+ *
+ * @param v     Guest-physical address of the page
+ * @return      true if the page is writable, false otherwise
+ */
+bool Nptp::unprotect (uint64 v)
+{
+    auto tbl { slots (static_cast<Npt>(root)) };
+
+    for (auto l { lev - 1 };; l--) {
+
+        auto const ptr { tbl + (v >> (l * bpl + PAGE_BITS)) % BIT (bpl) };
+
+        Npt pte { *ptr };
+
+        if (pte.is_table (l)) {
+            tbl = slots (pte);
+            continue;
+        }
+
+        for (Npt tmp; !pte.is_empty() && pte.is_protected(); )
+            if (ptr->compare_exchange (pte, tmp = pte.unprotect()))
+                return true;
+
+        // A write fault on another CPU may have restored write access already
+        return !pte.is_empty() && !pte.is_table (l) && pte.is_dirty();
+    }
+}
+
+/*
+ * Set the access flag of a page whose access flag was cleared by working-set estimation
+ *
+ * @param v     Intermediate-physical address of the page
+ * @return      true if the page is accessible, false otherwise
+ */
+bool Nptp::touch (uint64 v)
+{
+    auto tbl { slots (static_cast<Npt>(root)) };
+
+    for (auto l { lev - 1 };; l--) {
+
+        auto const ptr { tbl + (v >> (l * bpl + PAGE_BITS)) % BIT (bpl) };
+
+        Npt pte { *ptr };
+
+        if (pte.is_table (l)) {
+            tbl = slots (pte);
+            continue;
+        }
+
+        for (Npt tmp; !pte.is_empty() && !pte.is_accessed(); )
+            if (ptr->compare_exchange (pte, tmp = pte.accessed()))
+                return true;
+
+        // An access flag fault on another CPU may have set the access flag already
+        return !pte.is_empty() && !pte.is_table (l);
+    }
+}
@@ -150,7 +150,7 @@ bool Smmu::configure (Space_dma *dma, uintptr_t dad)
 
     trace (TRACE_SMMU, "SMMU: SID:%#06x MSK:%#06x SMG:%#04x CTX:%#04x assigned to DMA:%p", sid, msk, smg, ctx, static_cast<void *>(dma));
 
-    Lock_guard <Spinlock> guard (lock);
+    Lock_guard <Mcslock> guard (lock);
 
     // Remember SMG configuration for suspend/resume
     config->entry[smg].dma = dma;
@@ -208,7 +208,7 @@ void Smmu::invalidate (Sdid sdid)
 {
     write (GR0_Register32::TLBIVMID, sdid & BIT_RANGE (15, 0));
 
-    {   Lock_guard <Spinlock> guard (lock);
+    {   Lock_guard <Mcslock> guard (lock);
 
         write (GR0_Register32::TLBGSYNC, 0);
 
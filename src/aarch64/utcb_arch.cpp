@@ -316,7 +316,12 @@ bool Utcb_arch::assign_spaces (Cpu_regs &c, Space_obj const *obj) const
     if (EXPECT_FALSE (gst->get_pd() != c.obj->get_pd()))
         return false;
 
-    // FIXME: Refcount updates
+    // Acquire a reference to the new space before releasing the one to the old space
+    if (EXPECT_FALSE (!gst->add_ref()))
+        return false;
+
+    if (c.gst)
+        c.gst->del_ref();
 
     c.gst = gst;
 
@@ -0,0 +1,154 @@
+/*
+ * Virtual-Machine Identifier (VMID)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "cpu.hpp"
+#include "kmem.hpp"
+#include "lock_guard.hpp"
+#include "vmid.hpp"
+
+Atomic<uint64>  Vmid::active        { 0 };
+uint64          Vmid::reserved      { 0 };
+Atomic<uint64>  Vmid::generation    { BIT64 (bits) };
+uint64          Vmid::map[]         { 0 };
+unsigned        Vmid::next          { 1 };
+Spinlock        Vmid::lock;
+
+/*
+ * Move a reserved tag into the current generation
+ *
+ * @param o     Tag of the previous generation
+ * @param n     Tag of the current generation
+ * @return      true if some CPU reserved the tag, false otherwise
+ */
+bool Vmid::reserve (uint64 o, uint64 n)
+{
+    bool hit { false };
+
+    // All CPUs that reserved the tag must be updated, not just the first
+    for (unsigned cpu { 0 }; cpu < Cpu::count; cpu++) {
+
+        auto &r { *Kmem::loc_to_glob (&reserved, cpu) };
+
+        if (r == o) {
+            r = n;
+            hit = true;
+        }
+    }
+
+    return hit;
+}
+
+/*
+ * Start a new generation of VMIDs
+ *
+ * A CPU that did not switch spaces since the last rollover still uses its reserved tag.
+ */
+void Vmid::rollover()
+{
+    for (auto &m : map)
+        m = 0;
+
+    for (unsigned cpu { 0 }; cpu < Cpu::count; cpu++) {
+
+        uint64 t { 0 }, z { 0 };
+
+        Kmem::loc_to_glob (&active, cpu)->exchange (t, z);
+
+        auto &r { *Kmem::loc_to_glob (&reserved, cpu) };
+
+        if (!t)
+            t = r;
+
+        auto const i { t & BIT_RANGE (bits - 1, 0) };
+
+        map[i / 64] |= BIT64 (i % 64);
+
+        r = t;
+    }
+
+    asm volatile ("dsb  ishst           ;"  // Ensure PTE writes have completed
+                  "tlbi alle1is         ;"  // Invalidate TLB entries of all VMIDs
+                  "dsb  ish             ;"  // Ensure TLB invalidation completed
+                  "isb                  ;"  // Ensure subsequent instructions use new PTEs
+                  : : : "memory");
+}
+
+/*
+ * Allocate a tag in the current generation
+ *
+ * The space keeps its VMID if no other space uses it in the current generation.
+ *
+ * @return  Tag
+ */
+uint64 Vmid::alloc()
+{
+    auto const t { tag.load() };
+
+    if (t) {
+
+        auto const i { t & BIT_RANGE (bits - 1, 0) };
+        auto const n { generation | i };
+
+        if (reserve (t, n))
+            return n;
+
+        if (!(map[i / 64] & BIT64 (i % 64))) {
+            map[i / 64] |= BIT64 (i % 64);
+            return n;
+        }
+    }
+
+    unsigned i;
+
+    // Search for a free VMID, starting a new generation if there is none
+    for (i = next; i < BIT (bits) && map[i / 64] & BIT64 (i % 64); i++) ;
+
+    if (i == BIT (bits)) {
+
+        generation += BIT64 (bits);
+
+        rollover();
+
+        // There are more VMIDs than CPUs, so a free one always exists
+        for (i = 1; map[i / 64] & BIT64 (i % 64); i++) ;
+    }
+
+    map[i / 64] |= BIT64 (i % 64);
+
+    next = i;
+
+    return generation | i;
+}
+
+/*
+ * Assign a tag of the current generation to the space and record it as being in use on the current CPU
+ *
+ * @return  VMID
+ */
+uint16 Vmid::assign()
+{
+    Lock_guard <Spinlock> guard (lock);
+
+    auto t { tag.load() };
+
+    if ((t ^ generation) >> bits)
+        tag = t = alloc();
+
+    active = t;
+
+    return static_cast<uint16>(t & BIT_RANGE (bits - 1, 0));
+}
@@ -0,0 +1,94 @@
+/*
+ * Virtual Processing Element (GICv4)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "buddy.hpp"
+#include "cache.hpp"
+#include "gits.hpp"
+#include "lock_guard.hpp"
+#include "vpe.hpp"
+
+INIT_PRIORITY (PRIO_SLAB)
+Slab_cache  Vpe::cache (sizeof (Vpe), alignof (Vpe));
+
+Spinlock    Vpe::lock;
+uint64      Vpe::map[] { 0 };
+
+Vpe::Vpe (void *p, uint16 v, unsigned c) : vpt (p), vid (v), cpu (c) {}
+
+/*
+ * Create a vPE and map it to the redistributor of a CPU
+ *
+ * @param c     CPU the vPE is mapped to
+ * @return      Pointer to the vPE or nullptr on failure
+ */
+Vpe *Vpe::create (unsigned c)
+{
+    unsigned v;
+
+    {   Lock_guard <Spinlock> guard (lock);
+
+        for (v = 0; v < num && map[v / 64] & BIT64 (v % 64); v++) ;
+
+        if (v == num)
+            return nullptr;
+
+        map[v / 64] |= BIT64 (v % 64);
+    }
+
+    // The VPT must be 64K-aligned
+    auto const p { Buddy::alloc (4, Buddy::Fill::BITS0) };
+
+    if (p) {
+
+        Cache::data_clean (p, BIT (Vpe::bits - 3));
+
+        if (auto const vpe { new Vpe (p, static_cast<uint16>(v), c) }; vpe) {
+
+            if (EXPECT_TRUE (Gits::map_vpe (vpe->vid, c, Kmem::ptr_to_phys (p), true)))
+                return vpe;
+
+            delete vpe;
+
+            return nullptr;
+        }
+
+        Buddy::free (p);
+    }
+
+    Lock_guard <Spinlock> guard (lock);
+
+    map[v / 64] &= ~BIT64 (v % 64);
+
+    return nullptr;
+}
+
+Vpe::~Vpe()
+{
+    auto const p { Kmem::ptr_to_phys (vpt) };
+
+    // FIXME: The VPT and vPEID of a vPE that is still resident on a remote CPU are leaked
+    if (!Gicr::evict (p, cpu))
+        return;
+
+    Gits::map_vpe (vid, cpu, p, false);
+
+    Buddy::free (vpt);
+
+    Lock_guard <Spinlock> guard (lock);
+
+    map[vid / 64] &= ~BIT64 (vid % 64);
+}
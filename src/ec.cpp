@@ -32,6 +32,7 @@
 #include "sm.hpp"
 #include "space_hst.hpp"
 #include "space_obj.hpp"
+#include "space_pio.hpp"
 #include "stdio.hpp"
 
 INIT_PRIORITY (PRIO_SLAB)
@@ -54,13 +55,11 @@ Ec *Ec::create (Status &s, Pd *pd, bool fpu, unsigned c, unsigned long e, bool t
     auto const hst { pd->get_hst() };
     auto const pio { pd->get_pio() };
 
-    if (EXPECT_FALSE (!obj || !hst || (Ec_arch::needs_pio && !pio))) {
+    if (EXPECT_FALSE (!obj || !hst || (Ec_arch::needs_pio && !pio) || !acquire_spaces (obj, hst, pio))) {
         s = Status::ABORTED;
         return nullptr;
     }
 
-    // FIXME: Refcount updates
-
     auto const f { fpu ? new (pd->fpu_cache) Fpu : nullptr };
     auto const u { new Utcb };
     Ec *ec;
@@ -71,11 +70,101 @@ Ec *Ec::create (Status &s, Pd *pd, bool fpu, unsigned c, unsigned long e, bool t
     delete u;
     Fpu::operator delete (f, pd->fpu_cache);
 
+    release_spaces (obj, hst, pio);
+
     s = Status::INS_MEM;
 
     return nullptr;
 }
 
+/*
+ * Destructor
+ *
+ * The UTCB remains mapped in the HST space and is reclaimed along with it.
+ */
+Ec::~Ec()
+{
+    Fpu::operator delete (fpu, regs.obj->get_pd()->fpu_cache);
+
+    release_spaces (regs.obj, regs.hst, nullptr);
+}
+
+void Ec::destroy()
+{
+    static_cast<Ec_arch *>(this)->~Ec_arch();
+
+    operator delete (this, cache);
+}
+
+/*
+ * Acquire references to the spaces that a new EC will be bound to
+ *
+ * @return      true if successful, false if any of the spaces is already being reclaimed
+ */
+bool Ec::acquire_spaces (Space_obj *obj, Space_hst *hst, Space_pio *pio)
+{
+    if (EXPECT_TRUE (obj->add_ref())) {
+
+        if (EXPECT_TRUE (hst->add_ref())) {
+
+            if (EXPECT_TRUE (!pio || pio->add_ref()))
+                return true;
+
+            hst->del_ref();
+        }
+
+        obj->del_ref();
+    }
+
+    return false;
+}
+
+void Ec::release_spaces (Space_obj *obj, Space_hst *hst, Space_pio *pio)
+{
+    if (pio)
+        pio->del_ref();
+
+    hst->del_ref();
+    obj->del_ref();
+}
+
+/*
+ * Reclaim the EC after the last reference is gone
+ *
+ * The EC is torn down on its own CPU once it is no longer current and no longer engaged in
+ * IPC or blocked on a semaphore. An EC that is blocked on a semaphore aborts its down
+ * operation, unless an up operation is about to wake it. Otherwise reclamation is retried
+ * after another grace period.
+ */
+void Ec::free (Rcu_elem *e)
+{
+    auto const ec { static_cast<Ec *>(e) };
+
+    if (EXPECT_FALSE (ec->cpu != Cpu::id)) {
+        Rcu::call (ec, ec->cpu);
+        return;
+    }
+
+    // Sm::free keeps the semaphore for another grace period after it cleared the pointer
+    if (auto const sm { ec->blk.load() }; EXPECT_FALSE (sm))
+        sm->abort (ec);
+
+    if (EXPECT_FALSE (current == ec || ec->caller || ec->callee || ec->cont == blocking)) {
+        Rcu::call (ec);
+        return;
+    }
+
+    ec->clr_timeout();
+
+    // Release any SCs that are still queued on the EC
+    ec->unblock_sc();
+
+    if (fpowner == ec)
+        fpowner = nullptr;
+
+    ec->destroy();
+}
+
 void Ec::create_idle()
 {
     Status s;
@@ -207,10 +296,15 @@ void Ec::idle (Ec *const self)
 
     for (;;) {
 
+        // Start a batch for pending callbacks before becoming quiescent
+        Rcu::update();
+
         auto hzd { Cpu::hazard & (Hazard::RCU | Hazard::SLEEP | Hazard::SCHED) };
         if (EXPECT_FALSE (hzd))
             self->handle_hazard (hzd, idle);
 
+        Rcu::eqs_enter();
+
         Cpu::halt();
     }
 }
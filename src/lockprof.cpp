@@ -0,0 +1,115 @@
+/*
+ * Lock Contention Profiler
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "lockprof.hpp"
+
+#ifdef DEBUG
+#include "bits.hpp"
+#include "macros.hpp"
+#include "stdio.hpp"
+#include "timer.hpp"
+
+Lockprof::Site Lockprof::site[sites];
+
+/*
+ * Find or allocate the statistics slot for a lock site
+ *
+ * @param f     Source file of the site
+ * @param l     Source line of the site
+ * @return      Pointer to the slot or nullptr if the table is full
+ */
+Lockprof::Site *Lockprof::lookup (char const *f, unsigned l)
+{
+    // Kernel addresses are canonical, so the upper 16 bits are redundant
+    uint64 const k { static_cast<uint64>(reinterpret_cast<uintptr_t>(f)) << 16 | (l & BIT_RANGE (15, 0)) };
+
+    for (unsigned i { 0 }, h { static_cast<unsigned>(k % sites) }; i < sites; i++) {
+
+        auto &s { site[(h + i) % sites] };
+
+        uint64 o { s.key.load (__ATOMIC_ACQUIRE) }, n { k };
+
+        if (o == k)
+            return &s;
+
+        if (!o && s.key.compare_exchange (o, n)) {
+            s.file = f;
+            s.line = l;
+            return &s;
+        }
+
+        // Someone else claimed the slot for the same site
+        if (o == k)
+            return &s;
+    }
+
+    return nullptr;
+}
+
+uint64 Lockprof::time()
+{
+    return Timer::time();
+}
+
+/*
+ * Account a duration in a log4-scaled bucket
+ *
+ * @param t     Duration in timer ticks
+ */
+void Lockprof::Histogram::add (uint64 t)
+{
+    cnt[min (static_cast<unsigned>(bit_scan_reverse (t) + 1) / 2, buckets - 1)]++;
+}
+
+void Lockprof::Histogram::dump (char const *file, unsigned line, char const *type) const
+{
+    trace (TRACE_PERF, "LOCK: %s:%u %s %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u", file, line, type,
+           cnt[0].load(), cnt[1].load(), cnt[2].load(),  cnt[3].load(),  cnt[4].load(),  cnt[5].load(),  cnt[6].load(),  cnt[7].load(),
+           cnt[8].load(), cnt[9].load(), cnt[10].load(), cnt[11].load(), cnt[12].load(), cnt[13].load(), cnt[14].load(), cnt[15].load());
+}
+
+void Lockprof::Site::acquired (uint64 t)
+{
+    count++;
+    spin += t;
+    hist_wait.add (t);
+}
+
+void Lockprof::Site::released (uint64 t)
+{
+    for (uint64 o { hold.load() }; o < t && !hold.compare_exchange (o, t); ) ;
+
+    hist_hold.add (t);
+}
+
+/*
+ * Dump the statistics of all lock sites
+ *
+ * @return      SUCCESS
+ */
+Status Lockprof::dump()
+{
+    for (auto const &s : site)
+        if (s.key.load (__ATOMIC_ACQUIRE) && s.file) {
+            trace (TRACE_PERF, "LOCK: %s:%u CNT:%llu SPIN:%llu HOLD:%llu", s.file, s.line, s.count.load(), s.spin.load(), s.hold.load());
+            s.hist_wait.dump (s.file, s.line, "WAIT");
+            s.hist_hold.dump (s.file, s.line, "HOLD");
+        }
+
+    return Status::SUCCESS;
+}
+#endif
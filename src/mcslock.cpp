@@ -0,0 +1,77 @@
+/*
+ * Queued (MCS) Spinlock
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "assert.hpp"
+#include "cpu.hpp"
+#include "kmem.hpp"
+#include "lowlevel.hpp"
+#include "mcslock.hpp"
+
+Mcslock::Node   Mcslock::node[nodes];
+unsigned        Mcslock::depth;
+
+/*
+ * Acquire a contended lock
+ *
+ * Enqueue the per-CPU node for the current nesting depth at the tail, spin
+ * on that node until the predecessor hands over, then spin on the lock word
+ * as head of the queue and finally pass the headship to the successor.
+ */
+void Mcslock::contended()
+{
+    auto const d { depth++ };
+
+    assert (d < nodes);
+
+    auto const l { node + d };
+    auto const t { (Cpu::id + 1) << 10 | d << 8 };
+
+    l->next.store (nullptr);
+    l->wait.store (true);
+
+    // Make our node the new tail, keeping the locked byte intact
+    uint32 o { __atomic_load_n (&val, __ATOMIC_RELAXED) }, n;
+
+    do n = (o & ~tail) | t; while (!__atomic_compare_exchange_n (&val, &o, n, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    // Link behind the predecessor and spin locally until it hands over
+    if (o & tail) {
+
+        Kmem::loc_to_glob (node + (o >> 8 & BIT_RANGE (1, 0)), (o >> 10) - 1)->next.store (Kmem::loc_to_glob (l, Cpu::id), __ATOMIC_RELEASE);
+
+        while (l->wait.load (__ATOMIC_ACQUIRE))
+            pause();
+    }
+
+    // As head of the queue, wait for the owner to drop the lock and take it. If we are still the tail, empty the queue.
+    for (o = __atomic_load_n (&val, __ATOMIC_RELAXED);; pause(), o = __atomic_load_n (&val, __ATOMIC_RELAXED))
+        if (!(o & locked) && __atomic_compare_exchange_n (&val, &o, (o & tail) == t ? locked : o | locked, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+
+    // Otherwise wait for the successor to link itself and make it the new head
+    if ((o & tail) != t) {
+
+        Node *s;
+
+        while (!(s = l->next.load (__ATOMIC_ACQUIRE)))
+            pause();
+
+        s->wait.store (false, __ATOMIC_RELEASE);
+    }
+
+    depth--;
+}
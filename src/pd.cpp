@@ -34,7 +34,7 @@
 INIT_PRIORITY (PRIO_SLAB)
 Slab_cache Pd::cache (sizeof (Pd), Kobject::alignment);
 
-Pd::Pd() : Kobject (Kobject::Type::PD),
+Pd::Pd() : Kobject (Kobject::Type::PD, free),
            dma_cache (sizeof (Space_dma), Kobject::alignment),
            gst_cache (sizeof (Space_gst), Kobject::alignment),
            hst_cache (sizeof (Space_hst), Kobject::alignment),
@@ -46,6 +46,62 @@ Pd::Pd() : Kobject (Kobject::Type::PD),
     trace (TRACE_CREATE, "PD:%p created", static_cast<void *>(this));
 }
 
+/*
+ * Detach a space from the PD if it is attached
+ *
+ * New ECs can still find an attached space via the PD until it is detached, so the space
+ * is reclaimed only after another grace period.
+ *
+ * @return      true if the space was detached, false if it was not attached
+ */
+template <typename T>
+bool Pd::retire (Atomic<T *> &a, T *o, Kobject::Subtype s)
+{
+    T *n { nullptr };
+
+    if (!a.compare_exchange (o, n))
+        return false;
+
+    detach (s);
+
+    Rcu::call (o);
+
+    return true;
+}
+
+/*
+ * Destroy a space and release its reference to the PD
+ */
+template <typename T>
+void Pd::release (T *o, Slab_cache &c)
+{
+    o->destroy (c);
+
+    del_ref();
+}
+
+void Pd::reclaim (Space_obj *o)
+{
+    if (!retire (space_obj, o, Kobject::Subtype::OBJ))
+        release (o, obj_cache);
+}
+
+void Pd::reclaim (Space_hst *o)
+{
+    if (!retire (space_hst, o, Kobject::Subtype::HST))
+        release (o, hst_cache);
+}
+
+void Pd::reclaim (Space_pio *o)
+{
+    if (!retire (space_pio, o, Kobject::Subtype::PIO))
+        release (o, pio_cache);
+}
+
+void Pd::reclaim (Space_gst *o) { release (o, gst_cache); }
+void Pd::reclaim (Space_dma *o) { release (o, dma_cache); }
+void Pd::reclaim (Space_msr *o) { release (o, msr_cache); }
+
 Space_obj *Pd::create_obj (Status &s, Space_obj *obj, unsigned long sel)
 {
     if (EXPECT_FALSE (!attach (Kobject::Subtype::OBJ))) {
@@ -53,15 +109,23 @@ Space_obj *Pd::create_obj (Status &s, Space_obj *obj, unsigned long sel)
         return nullptr;
     }
 
-    auto const o { Space_obj::create (s, obj_cache, this) };
+    // The space holds a reference to the PD
+    if (EXPECT_TRUE (add_ref())) {
 
-    if (EXPECT_TRUE (o)) {
+        auto const o { Space_obj::create (s, obj_cache, this) };
 
-        if (EXPECT_TRUE ((s = obj->insert (sel, Capability (o, std::to_underlying (Capability::Perm_sp::DEFINED_OBJ)))) == Status::SUCCESS))
-            return space_obj = o;
+        if (EXPECT_TRUE (o)) {
 
-        o->destroy (obj_cache);
-    }
+            if (EXPECT_TRUE ((s = obj->insert (sel, Capability (o, std::to_underlying (Capability::Perm_sp::DEFINED_OBJ)))) == Status::SUCCESS))
+                return space_obj = o;
+
+            o->destroy (obj_cache);
+        }
+
+        del_ref();
+
+    } else
+        s = Status::ABORTED;
 
     detach (Kobject::Subtype::OBJ);
 
@@ -75,15 +139,23 @@ Space_hst *Pd::create_hst (Status &s, Space_obj *obj, unsigned long sel)
         return nullptr;
     }
 
-    auto const o { Space_hst::create (s, hst_cache, this) };
+    // The space holds a reference to the PD
+    if (EXPECT_TRUE (add_ref())) {
 
-    if (EXPECT_TRUE (o)) {
+        auto const o { Space_hst::create (s, hst_cache, this) };
 
-        if (EXPECT_TRUE ((s = obj->insert (sel, Capability (o, std::to_underlying (Capability::Perm_sp::DEFINED_HST)))) == Status::SUCCESS))
-            return space_hst = o;
+        if (EXPECT_TRUE (o)) {
 
-        o->destroy (hst_cache);
-    }
+            if (EXPECT_TRUE ((s = obj->insert (sel, Capability (o, std::to_underlying (Capability::Perm_sp::DEFINED_HST)))) == Status::SUCCESS))
+                return space_hst = o;
+
+            o->destroy (hst_cache);
+        }
+
+        del_ref();
+
+    } else
+        s = Status::ABORTED;
 
     detach (Kobject::Subtype::HST);
 
@@ -92,6 +164,12 @@ Space_hst *Pd::create_hst (Status &s, Space_obj *obj, unsigned long sel)
 
 Space_gst *Pd::create_gst (Status &s, Space_obj *obj, unsigned long sel)
 {
+    // The space holds a reference to the PD
+    if (EXPECT_FALSE (!add_ref())) {
+        s = Status::ABORTED;
+        return nullptr;
+    }
+
     auto const o { Space_gst::create (s, gst_cache, this) };
 
     if (EXPECT_TRUE (o)) {
@@ -102,11 +180,19 @@ Space_gst *Pd::create_gst (Status &s, Space_obj *obj, unsigned long sel)
         o->destroy (gst_cache);
     }
 
+    del_ref();
+
     return nullptr;
 }
 
 Space_dma *Pd::create_dma (Status &s, Space_obj *obj, unsigned long sel)
 {
+    // The space holds a reference to the PD
+    if (EXPECT_FALSE (!add_ref())) {
+        s = Status::ABORTED;
+        return nullptr;
+    }
+
     auto const o { Space_dma::create (s, dma_cache, this) };
 
     if (EXPECT_TRUE (o)) {
@@ -117,11 +203,19 @@ Space_dma *Pd::create_dma (Status &s, Space_obj *obj, unsigned long sel)
         o->destroy (dma_cache);
     }
 
+    del_ref();
+
     return nullptr;
 }
 
 Space_pio *Pd::create_pio (Status &s, Space_obj *obj, unsigned long sel)
 {
+    // The space holds a reference to the PD
+    if (EXPECT_FALSE (!add_ref())) {
+        s = Status::ABORTED;
+        return nullptr;
+    }
+
     auto const a { attach (Kobject::Subtype::PIO) };
 
     auto const o { Space_pio::create (s, pio_cache, this, a) };
@@ -137,11 +231,19 @@ Space_pio *Pd::create_pio (Status &s, Space_obj *obj, unsigned long sel)
     if (a)
         detach (Kobject::Subtype::PIO);
 
+    del_ref();
+
     return nullptr;
 }
 
 Space_msr *Pd::create_msr (Status &s, Space_obj *obj, unsigned long sel)
 {
+    // The space holds a reference to the PD
+    if (EXPECT_FALSE (!add_ref())) {
+        s = Status::ABORTED;
+        return nullptr;
+    }
+
     auto const o { Space_msr::create (s, msr_cache, this) };
 
     if (EXPECT_TRUE (o)) {
@@ -152,6 +254,8 @@ Space_msr *Pd::create_msr (Status &s, Space_obj *obj, unsigned long sel)
         o->destroy (msr_cache);
     }
 
+    del_ref();
+
     return nullptr;
 }
 
@@ -172,7 +276,7 @@ Pd *Pd::create_pd (Status &s, Space_obj *obj, unsigned long sel, unsigned prm)
 
 Ec *Pd::create_ec (Status &s, Space_obj *obj, unsigned long sel, Pd *pd, unsigned cpu, uintptr_t utcb, uintptr_t sp, uintptr_t eb, uint8 flg)
 {
-    auto const o { flg & BIT (1) ? Ec::create (s, pd, flg & BIT (2), cpu, eb, flg & BIT (0)) : Ec::create (s, pd, flg & BIT (2), cpu, eb, flg & BIT (0), utcb, sp) };
+    auto const o { flg & BIT (1) ? Ec::create (s, pd, flg & BIT (2), cpu, eb, flg & BIT (0), utcb) : Ec::create (s, pd, flg & BIT (2), cpu, eb, flg & BIT (0), utcb, sp) };
 
     if (EXPECT_TRUE (o)) {
 
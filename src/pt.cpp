@@ -26,7 +26,34 @@
 INIT_PRIORITY (PRIO_SLAB)
 Slab_cache Pt::cache (sizeof (Pt), Kobject::alignment);
 
-Pt::Pt (Ec *e, uintptr_t i) : Kobject (Kobject::Type::PT), ec (e), ip (i)
+Pt::Pt (Ec *e, uintptr_t i) : Kobject (Kobject::Type::PT, free), ec (e), ip (i)
 {
     trace (TRACE_CREATE, "PT:%p created (EC:%p IP:%#lx)", static_cast<void *>(this), static_cast<void *>(e), ip);
 }
+
+Pt *Pt::create (Status &s, Ec *e, uintptr_t i)
+{
+    // The PT holds a reference to the EC
+    if (EXPECT_FALSE (!e->add_ref())) {
+        s = Status::ABORTED;
+        return nullptr;
+    }
+
+    auto const pt { new (cache) Pt (e, i) };
+
+    if (EXPECT_TRUE (pt))
+        return pt;
+
+    e->del_ref();
+
+    s = Status::INS_MEM;
+
+    return nullptr;
+}
+
+void Pt::destroy()
+{
+    ec->del_ref();
+
+    operator delete (this, cache);
+}
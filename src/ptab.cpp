@@ -62,15 +62,25 @@
  * @param n     Target level to walk down to
  * @param e     True if making entries, false if making holes
  * @param nc    True if the page table is non-coherent, false otherwise
+ * @param c     Cursor for resuming the walk (optional)
  * @return      Pointer to the PTE (if exists) or ~0 (skippable hole) or nullptr (allocation failure)
  */
 template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
-typename Pagetable<T,I,O,L,M,C>::PTE *Pagetable<T,I,O,L,M,C>::walk (IAddr v, unsigned n, bool e, bool nc)
+typename Pagetable<T,I,O,L,M,C>::PTE *Pagetable<T,I,O,L,M,C>::walk (IAddr v, unsigned n, bool e, bool nc, Cursor *c)
 {
-    auto l = lev; T pte;
+    auto l = lev; auto ptr = &root; T pte;
+
+    // Resume the walk at the deepest page table that the cursor remembers for this address
+    if (c)
+        for (auto k = n; k < lev; k++)
+            if (c->hit (k, v)) {
+                ptr = &c->tbl[k]->slot[(v >> (k * bpl + PAGE_BITS)) % Table::entries];
+                l = k;
+                break;
+            }
 
-    // Walk down the page tables from the root, computing the slot index at each level
-    for (auto ptr = &root;; ptr = &pte->slot[(v >> (--l * bpl + PAGE_BITS)) % Table::entries]) {
+    // Walk down the page tables, computing the slot index at each level
+    for (;; ptr = &pte->slot[(v >> (--l * bpl + PAGE_BITS)) % Table::entries]) {
 
         // Terminate the walk upon reaching the target level and return pointer to the PTE
         if (l == n)
@@ -119,6 +129,10 @@ typename Pagetable<T,I,O,L,M,C>::PTE *Pagetable<T,I,O,L,M,C>::walk (IAddr v, uns
                 pte = tmp;
             }
 
+            // Remember the page table for the next level
+            if (c)
+                c->set (l - 1, v, static_cast<Table *>(Kmem::phys_to_ptr (pte.addr())));
+
             // Proceed with the page table for the next level
             break;
         }
@@ -133,15 +147,25 @@ typename Pagetable<T,I,O,L,M,C>::PTE *Pagetable<T,I,O,L,M,C>::walk (IAddr v, uns
  * @param o     Reference to the page order that is being returned
  * @param ca    Reference to the cacheability attributes that are being returned
  * @param sh    Reference to the shareability attributes that are being returned
+ * @param c     Cursor for resuming the walk (optional)
  * @return      Page permissions (0 for empty PTEs)
  */
 template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
-Paging::Permissions Pagetable<T,I,O,L,M,C>::lookup (IAddr v, OAddr &p, unsigned &o, Memattr::Cacheability &ca, Memattr::Shareability &sh) const
+Paging::Permissions Pagetable<T,I,O,L,M,C>::lookup (IAddr v, OAddr &p, unsigned &o, Memattr::Cacheability &ca, Memattr::Shareability &sh, Cursor *c) const
 {
-    auto l = lev; T pte;
+    auto l = lev; PTE const *ptr { &root }; T pte;
+
+    // Resume the walk at the deepest page table that the cursor remembers for this address
+    if (c)
+        for (unsigned k = 0; k < lev; k++)
+            if (c->hit (k, v)) {
+                ptr = &c->tbl[k]->slot[(v >> (k * bpl + PAGE_BITS)) % Table::entries];
+                l = k;
+                break;
+            }
 
-    // Walk down the page tables from the root, computing the slot index at each level
-    for (auto ptr = &root;; ptr = &pte->slot[(v >> (--l * bpl + PAGE_BITS)) % Table::entries]) {
+    // Walk down the page tables, computing the slot index at each level
+    for (;; ptr = &pte->slot[(v >> (--l * bpl + PAGE_BITS)) % Table::entries]) {
 
         // Compute the page order for this level
         o = l * bpl;
@@ -153,9 +177,12 @@ Paging::Permissions Pagetable<T,I,O,L,M,C>::lookup (IAddr v, OAddr &p, unsigned
         if (pte.is_empty())
             return Paging::Permissions (p = 0);
 
-        // If the PTE refers to a page table, then proceed with the next level
-        if (pte.is_table (l))
+        // If the PTE refers to a page table, then remember it and proceed with the next level
+        if (pte.is_table (l)) {
+            if (c)
+                c->set (l - 1, v, static_cast<Table *>(Kmem::phys_to_ptr (pte.addr())));
             continue;
+        }
 
         // Compute the physical address of the leaf page
         p = pte.addr (l) | (v & T::offs_mask (o));
@@ -179,10 +206,11 @@ Paging::Permissions Pagetable<T,I,O,L,M,C>::lookup (IAddr v, OAddr &p, unsigned
  * @param ca    Cacheability attributes
  * @param sh    Shareability attributes
  * @param nc    True if the page table is non-coherent, false otherwise
+ * @param c     Cursor for resuming walks across consecutive updates (optional)
  * @return      SUCCESS (successful) or INS_MEM (allocation failure)
  */
 template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
-Status Pagetable<T,I,O,L,M,C>::update (IAddr v, OAddr p, unsigned ord, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh, bool nc)
+Status Pagetable<T,I,O,L,M,C>::update (IAddr v, OAddr p, unsigned ord, Paging::Permissions pm, Memattr::Cacheability ca, Memattr::Shareability sh, bool nc, Cursor *c)
 {
     // Both virtual and physical address must be order-aligned
     assert ((v & T::offs_mask (ord)) == 0);
@@ -193,11 +221,16 @@ Status Pagetable<T,I,O,L,M,C>::update (IAddr v, OAddr p, unsigned ord, Paging::P
     auto const n = BIT (o % bpl);
     auto const a = T::page_attr (l, pm, ca, sh);
 
+    // Without a cursor from the caller, still avoid walking from the root for each chunk of the range
+    Cursor tmp;
+    if (!c)
+        c = &tmp;
+
     // Split operations that cross page-table boundaries into the largest possible size
     for (unsigned i = 0; i < BIT (ord - o); i++, v += BIT (o + PAGE_BITS), p += BIT (o + PAGE_BITS)) {
 
         // Get pointer to the first PTE
-        auto const ptr = walk (v, l, a, nc);
+        auto const ptr = walk (v, l, a, nc, c);
 
         // Allocation failure
         if (EXPECT_FALSE (!ptr))
@@ -226,30 +259,354 @@ Status Pagetable<T,I,O,L,M,C>::update (IAddr v, OAddr p, unsigned ord, Paging::P
             if (old.is_empty())
                 continue;
 
-            // If the old PTE refers to a page table, then deallocate it
-            if (old.is_table (l))
+            // If the old PTE refers to a page table, then deallocate it and forget the page tables below
+            if (old.is_table (l)) {
                 old->deallocate (l - 1);
+                c->invalidate (l);
+            }
         }
 
         // Ensure PTE coherence
         if (C && nc)
             Cache::data_clean (ptr, n * sizeof (*ptr));
+
+        // Merge fully populated page tables into large pages
+        if (a && c->promote)
+            promote (v, l, n, nc, c);
     }
 
     return Status::SUCCESS;
 }
 
+/*
+ * Promote fully populated page tables to large pages
+ *
+ * A page table whose PTEs map contiguous frames with identical attributes is replaced by a single
+ * large page one level up, which may in turn complete the page table above it. To keep the cost of
+ * piecemeal updates low, a page table is only checked when an update touched its first or last slot.
+ *
+ * @param v     Virtual base address of the updated range
+ * @param l     Level of the updated PTEs
+ * @param n     Number of updated PTEs
+ * @param nc    True if the page table is non-coherent, false otherwise
+ * @param c     Cursor for resuming walks
+ */
+template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
+void Pagetable<T,I,O,L,M,C>::promote (IAddr v, unsigned l, unsigned n, bool nc, Cursor *c)
+{
+    // The large page must stay below the maximum leaf page size and cannot be the root
+    for (; (l + 1) * bpl < lim && l + 1 < lev; l++, n = 1) {
+
+        auto const i = (v >> (l * bpl + PAGE_BITS)) % Table::entries;
+
+        if (i && i + n != Table::entries)
+            return;
+
+        // Get pointer to the PTE that refers to the page table
+        auto const ptr = walk (v, l + 1, false, nc, c);
+
+        if (EXPECT_FALSE (ptr == reinterpret_cast<decltype (ptr)>(~0UL)))
+            return;
+
+        auto pte = static_cast<T>(*ptr);
+
+        if (!pte.is_table (l + 1))
+            return;
+
+        auto const tbl = static_cast<Table *>(Kmem::phys_to_ptr (pte.addr()));
+        auto const fst = static_cast<T>(tbl->slot[0]);
+        auto const siz = OAddr (T::page_size (l * bpl));
+
+        // The first PTE must map a suitably aligned frame that is not kernel memory
+        if (fst.is_empty() || fst.is_table (l) || fst.page_pm() & Paging::K || fst.addr (l) & T::offs_mask ((l + 1) * bpl))
+            return;
+
+        // All other PTEs must continue the frame range with identical attributes
+        if (!tbl->contiguous (fst, siz))
+            return;
+
+        // Construct a large PTE that maps the entire range of the page table
+        T big (fst.addr (l) | T::page_attr (l + 1, fst.page_pm(), fst.page_ca (l), fst.page_sh()));
+
+        // Try to replace the PTE that refers to the page table
+        if (!ptr->compare_exchange (pte, big))
+            return;
+
+        // Ensure PTE coherence
+        if (C && nc)
+            Cache::data_clean (ptr);
+
+        // A concurrent update of the page table before it was replaced must not get lost, so revert
+        if (EXPECT_FALSE (!tbl->contiguous (fst, siz))) {
+            ptr->compare_exchange (big, pte);
+
+            if (C && nc)
+                Cache::data_clean (ptr);
+
+            return;
+        }
+
+        // The page table may still be cached in TLBs, so its deallocation must wait for a TLB shootdown
+        Table::operator delete (tbl, true);
+
+        c->invalidate (l + 1);
+    }
+}
+
+/*
+ * Deallocate the page table tree
+ *
+ * The caller must ensure that no CPU can use the page tables anymore, which allows them to be
+ * freed immediately. Kernel memory (e.g., UTCBs) mapped into the tree is freed along with it.
+ */
+template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
+void Pagetable<T,I,O,L,M,C>::root_fini()
+{
+    auto const pte = static_cast<T>(root);
+
+    if (!pte.is_empty())
+        pte->deallocate (lev - 1, false);
+
+    root = Entry (0);
+}
+
+/*
+ * Deallocate a page table tree that shares all page tables except those along the path to the specified virtual address
+ *
+ * @param v     Virtual address that determines the path
+ * @param n     Lowest level of a page table along the path that is not shared
+ */
+template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
+void Pagetable<T,I,O,L,M,C>::root_fini (IAddr v, unsigned n)
+{
+    // Deallocate the page tables bottom-up; walking the path only reads the tables above the one being deallocated
+    for (auto l = n; l < lev; l++) {
+
+        auto const ptr = walk (v, l, false);
+
+        if (ptr != reinterpret_cast<decltype (ptr)>(~0UL))
+            Table::operator delete (reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(ptr) & ~OFFS_MASK), false);
+    }
+
+    root = Entry (0);
+}
+
+/*
+ * Set the dirty summary of a table PTE
+ *
+ * @param ptr   Pointer to the PTE
+ * @param l     Level of the PTE
+ */
+template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
+void Pagetable<T,I,O,L,M,C>::summarize (PTE *ptr, unsigned l)
+{
+    for (T pte { *ptr }, tmp; pte.is_table (l) && !pte.is_summary(); )
+        if (ptr->compare_exchange (pte, tmp = pte.summary (true)))
+            break;
+}
+
+/*
+ * Harvest the dirty state of the leaf PTEs in a page table
+ *
+ * @param tbl   Slots of the page table
+ * @param l     Level of the slots
+ * @param b     Input address covered by the first slot
+ * @param s     Start of the harvested range
+ * @param e     End of the harvested range
+ * @param bmp   Dirty bitmap of the harvested range
+ * @param lo    Start of the part that requires a TLB invalidation
+ * @param hi    End of the part that requires a TLB invalidation
+ */
+template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
+void Pagetable<T,I,O,L,M,C>::scan (PTE *tbl, unsigned l, IAddr b, IAddr s, IAddr e, uint64 *bmp, IAddr &lo, IAddr &hi)
+{
+    auto const sz { T::page_size (l * bpl) };
+
+    for (auto i { (max (s, b) - b) / sz }; i < BIT (bpl) && b + i * sz < e; i++) {
+
+        auto const a { b + i * sz };
+
+        T pte { tbl[i] };
+
+        if (pte.is_empty())
+            continue;
+
+        if (pte.is_table (l)) {
+
+            if (T::dirty_summary()) {
+
+                if (!pte.is_summary())
+                    continue;
+
+                // Clear the summary before scanning below, so that concurrent writes set it again
+                if (a >= s && a + sz <= e)
+                    for (T tmp; pte.is_table (l) && pte.is_summary(); )
+                        if (tbl[i].compare_exchange (pte, tmp = pte.summary (false)))
+                            break;
+            }
+
+            if (pte.is_table (l)) {
+                scan (slots (pte), l - 1, a, s, e, bmp, lo, hi);
+                continue;
+            }
+        }
+
+        if (!pte.is_dirty())
+            continue;
+
+        set_bits (bmp, (max (a, s) - s) >> PAGE_BITS, (min (a + sz, e) - s) >> PAGE_BITS);
+
+        // A leaf PTE that extends beyond the range is splintered, so that only the part within the range is cleaned
+        if (a < s || a + sz > e) {
+
+            auto const ptr { walk (a, l - 1, true) };
+
+            if (EXPECT_FALSE (!ptr))
+                continue;
+
+            // Splintering retains write access, but not necessarily the dirty flag, which the smaller PTEs inherit
+            for (unsigned j { 0 }; j < BIT (bpl); j++)
+                for (T old { ptr[j] }, tmp; !old.is_empty() && !old.is_table (l - 1) && !old.is_dirty(); )
+                    if (ptr[j].compare_exchange (old, tmp = old.dirty()))
+                        break;
+
+            // The new page table may hold dirty PTEs outside the range
+            if (T::dirty_summary())
+                summarize (tbl + i, l);
+
+            scan (ptr, l - 1, a, s, e, bmp, lo, hi);
+
+            // Cached translations of the large page must go as well
+            lo = min (lo, a);
+            hi = max (hi, a + sz);
+
+            continue;
+        }
+
+        for (T tmp; !pte.is_empty() && !pte.is_table (l) && pte.is_dirty(); )
+            if (tbl[i].compare_exchange (pte, tmp = pte.clean())) {
+                lo = min (lo, a);
+                hi = max (hi, a + sz);
+                break;
+            }
+    }
+}
+
+/*
+ * Harvest the dirty state of an input address range
+ *
+ * The dirty bitmap receives one bit per page of the range. Dirty state within the range is
+ * cleaned, but the cleaned state only takes effect after a TLB invalidation.
+ *
+ * @param s     Start of the range
+ * @param e     End of the range
+ * @param bmp   Dirty bitmap of the range
+ * @param lo    Start of the part that requires a TLB invalidation (lowered)
+ * @param hi    End of the part that requires a TLB invalidation (raised)
+ */
+template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
+void Pagetable<T,I,O,L,M,C>::harvest (IAddr s, IAddr e, uint64 *bmp, IAddr &lo, IAddr &hi)
+{
+    scan (slots (static_cast<T>(root)), lev - 1, 0, s, e, bmp, lo, hi);
+}
+
+/*
+ * Sample and clear the accessed state of the PTEs in a page table
+ *
+ * Table PTEs are only sampled if their accessed flag summarizes the PTEs below.
+ *
+ * @param tbl   Slots of the page table
+ * @param l     Level of the slots
+ * @param b     Input address covered by the first slot
+ * @param s     Start of the sampled range
+ * @param e     End of the sampled range
+ * @param bmp   Accessed bitmap of the sampled range
+ * @param lo    Start of the part that requires a TLB invalidation
+ * @param hi    End of the part that requires a TLB invalidation
+ */
+template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
+void Pagetable<T,I,O,L,M,C>::sample (PTE *tbl, unsigned l, IAddr b, IAddr s, IAddr e, uint64 *bmp, IAddr &lo, IAddr &hi)
+{
+    auto const sz { T::page_size (l * bpl) };
+
+    for (auto i { (max (s, b) - b) / sz }; i < BIT (bpl) && b + i * sz < e; i++) {
+
+        auto const a { b + i * sz };
+
+        T pte { tbl[i] };
+
+        if (pte.is_empty())
+            continue;
+
+        // A PTE that extends beyond the range retains its accessed flag for the part outside the range
+        auto const inside { a >= s && a + sz <= e };
+
+        if (pte.is_table (l)) {
+
+            if (T::accessed_summary()) {
+
+                if (!pte.is_accessed())
+                    continue;
+
+                // Clear the accessed flag before sampling below, so that concurrent walks set it again
+                for (T tmp; inside && pte.is_table (l) && pte.is_accessed(); )
+                    if (tbl[i].compare_exchange (pte, tmp = pte.unaccessed())) {
+                        lo = min (lo, a);
+                        hi = max (hi, a + sz);
+                        break;
+                    }
+            }
+
+            if (pte.is_table (l)) {
+                sample (slots (pte), l - 1, a, s, e, bmp, lo, hi);
+                continue;
+            }
+
+            if (pte.is_empty())
+                continue;
+        }
+
+        if (!pte.is_accessed())
+            continue;
+
+        set_bits (bmp, (max (a, s) - s) >> PAGE_BITS, (min (a + sz, e) - s) >> PAGE_BITS);
+
+        for (T tmp; inside && !pte.is_empty() && !pte.is_table (l) && pte.is_accessed(); )
+            if (tbl[i].compare_exchange (pte, tmp = pte.unaccessed())) {
+                lo = min (lo, a);
+                hi = max (hi, a + sz);
+                break;
+            }
+    }
+}
+
+/*
+ * Sample and clear the accessed state of an input address range
+ *
+ * The accessed bitmap receives one bit per page of the range. The cleared state only takes
+ * effect after a TLB invalidation.
+ *
+ * @param s     Start of the range
+ * @param e     End of the range
+ * @param bmp   Accessed bitmap of the range
+ * @param lo    Start of the part that requires a TLB invalidation (lowered)
+ * @param hi    End of the part that requires a TLB invalidation (raised)
+ */
+template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
+void Pagetable<T,I,O,L,M,C>::age (IAddr s, IAddr e, uint64 *bmp, IAddr &lo, IAddr &hi)
+{
+    sample (slots (static_cast<T>(root)), lev - 1, 0, s, e, bmp, lo, hi);
+}
+
 /*
  * Deallocate a page table subtree
  *
  * @param l     Subtree level
+ * @param w     True if the deallocation must wait for a TLB shootdown, false if the subtree is being torn down
  */
 template <typename T, typename I, typename O, unsigned L, unsigned M, bool C>
-void Pagetable<T,I,O,L,M,C>::Table::deallocate (unsigned l)
+void Pagetable<T,I,O,L,M,C>::Table::deallocate (unsigned l, bool w)
 {
-    if (!l)
-        return;
-
     // Iterate over all slots
     for (unsigned i = 0; i < entries; i++) {
 
@@ -262,8 +619,12 @@ void Pagetable<T,I,O,L,M,C>::Table::deallocate (unsigned l)
 
         // If the old PTE refers to a page table, then deallocate it
         if (old.is_table (l))
-            old->deallocate (l - 1);
+            old->deallocate (l - 1, w);
+
+        // If the tree is being torn down, then deallocate kernel memory mapped by the old PTE
+        else if (!w && old.page_pm() & Paging::K)
+            Buddy::free (Kmem::phys_to_ptr (old.addr (l)));
     }
 
-    operator delete (this, true);
+    operator delete (this, w);
 }
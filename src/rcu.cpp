@@ -0,0 +1,224 @@
+/*
+ * Read-Copy Update (RCU)
+ *
+ * Copyright (C) 2009-2011 Udo Steinberg <udo@hypervisor.org>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * Copyright (C) 2012-2013 Udo Steinberg, Intel Corporation.
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "cpu.hpp"
+#include "hazard.hpp"
+#include "initprio.hpp"
+#include "interrupt.hpp"
+#include "kmem.hpp"
+#include "lock_guard.hpp"
+#include "rcu.hpp"
+#include "stdio.hpp"
+
+mword   Rcu::state = RCU_CMP;
+mword   Rcu::count;
+
+Atomic<mword> Rcu::xpd { ~0UL };
+
+mword   Rcu::l_batch;
+mword   Rcu::c_batch;
+
+Atomic<mword>    Rcu::q_batch;
+Atomic<unsigned> Rcu::eqs;
+unsigned         Rcu::qlen;
+
+INIT_PRIORITY (PRIO_LOCAL) Rcu_list Rcu::next;
+INIT_PRIORITY (PRIO_LOCAL) Rcu_list Rcu::curr;
+INIT_PRIORITY (PRIO_LOCAL) Rcu_list Rcu::done;
+INIT_PRIORITY (PRIO_LOCAL) Rcu::Remote Rcu::remote;
+
+/*
+ * Enqueue a callback for invocation on the specified CPU
+ */
+void Rcu::call (Rcu_elem *e, unsigned cpu)
+{
+    if (cpu == Cpu::id) {
+        call (e);
+        return;
+    }
+
+    auto const r { Kmem::loc_to_glob (&remote, cpu) };
+
+    {   Lock_guard <Mcslock> guard (r->lock);
+
+        r->list.enqueue (e);
+    }
+
+    // A CPU in an extended quiescent state would not pick up the callback until its next interrupt
+    if (*Kmem::loc_to_glob (&eqs, cpu))
+        Interrupt::send_cpu (Interrupt::Request::RKE, cpu);
+}
+
+void Rcu::invoke_batch()
+{
+    for (Rcu_elem *e = done.head, *n; e; e = n) {
+        n = e->rcu_next;
+        (e->rcu_func)(e);
+    }
+
+    done.clear();
+}
+
+/*
+ * Mark the state of a batch
+ *
+ * @param s     RCU_CMP to complete the batch or RCU_PND to request another one
+ * @param b     Batch the caller observed, which need not be the l_batch of the current CPU
+ */
+void Rcu::start_batch (State s, mword b)
+{
+    mword v, m = RCU_CMP | RCU_PND;
+
+    do if ((v = state) >> 2 != b) return; while (!(v & s) && !__atomic_compare_exchange_n (&state, &v, v | s, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+
+    if ((v ^ ~s) & m)
+        return;
+
+    count = Cpu::count;
+
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+    state++;
+
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+    // CPUs in an extended quiescent state cannot report for themselves
+    for (unsigned cpu { 0 }; cpu < Cpu::count; cpu++)
+        if (*Kmem::loc_to_glob (&eqs, cpu))
+            report (cpu);
+
+    if (expedited())
+        kick (true);
+}
+
+/*
+ * Report a quiescent state of the current CPU
+ */
+void Rcu::report()
+{
+    report (Cpu::id);
+}
+
+/*
+ * Report a quiescent state of the specified CPU for the current batch
+ *
+ * The CPU itself and any CPU that starts a batch while the CPU is in an extended quiescent
+ * state may report, but only the first report for each batch counts.
+ *
+ * @param cpu   CPU whose quiescent state is reported
+ */
+void Rcu::report (unsigned cpu)
+{
+    auto &q { *Kmem::loc_to_glob (&q_batch, cpu) };
+
+    auto o { q.load() }, b { batch() };
+
+    if (o == b || !q.compare_exchange (o, b))
+        return;
+
+    if (__atomic_sub_fetch (&count, 1, __ATOMIC_SEQ_CST))
+        return;
+
+    // The last report may come from a CPU that has not yet observed the batch via update()
+    start_batch (RCU_CMP, b);
+
+    // Quiescent CPUs with callbacks must process the completed batch
+    kick (expedited());
+}
+
+/*
+ * Interrupt other CPUs so that they process the current state of RCU
+ *
+ * @param all   Also interrupt CPUs that are not in an extended quiescent state
+ */
+void Rcu::kick (bool all)
+{
+    for (unsigned cpu { 0 }; cpu < Cpu::count; cpu++) {
+
+        if (cpu == Cpu::id)
+            continue;
+
+        auto const e { Kmem::loc_to_glob (&eqs, cpu)->load() };
+
+        if (e == EQS_CBS || (all && e == EQS_NONE))
+            Interrupt::send_cpu (Interrupt::Request::RKE, cpu);
+    }
+}
+
+/*
+ * Expedite the grace period for the callbacks enqueued so far
+ *
+ * Instead of waiting for timer ticks, the CPUs are interrupted whenever a batch starts or
+ * completes, until the batch that follows the current one has completed. The current CPU
+ * processes its callbacks when it leaves the kernel.
+ */
+void Rcu::expedite()
+{
+    auto b { batch() + 2 };
+
+    for (auto x { xpd.load() }; static_cast<signed long>(b - x) > 0 && !xpd.compare_exchange (x, b); ) ;
+
+    Cpu::hazard |= Hazard::RCU;
+
+    kick (true);
+}
+
+void Rcu::quiet()
+{
+    Cpu::hazard &= ~Hazard::RCU;
+
+    report (Cpu::id);
+
+    if (expedited())
+        update();
+}
+
+void Rcu::update()
+{
+    if (__atomic_load_n (&remote.list.head, __ATOMIC_RELAXED)) {
+
+        Lock_guard <Mcslock> guard (remote.lock);
+
+        if (remote.list.head)
+            next.append (&remote.list);
+    }
+
+    if (l_batch != batch()) {
+        l_batch = batch();
+        Cpu::hazard |= Hazard::RCU;
+    }
+
+    if (curr.head && complete (c_batch))
+        done.append (&curr);
+
+    if (!curr.head && next.head) {
+        curr.append (&next);
+
+        qlen = 0;
+
+        c_batch = l_batch + 1;
+
+        start_batch (RCU_PND, l_batch);
+    }
+
+    if (done.head)
+        invoke_batch();
+}
@@ -35,16 +35,49 @@ INIT_PRIORITY (PRIO_LOCAL)  Scheduler::Release  Scheduler::release;
 
 Sc *Scheduler::current { nullptr };
 
-Sc::Sc (unsigned n, Ec *e, uint16 b, uint8 p, uint16 c) : Kobject (Kobject::Type::SC), ec (e), budget (Stc::ms_to_ticks (b)), cpu (n), cos (c), prio (p)
+Sc::Sc (unsigned n, Ec *e, uint16 b, uint8 p, uint16 c) : Kobject (Kobject::Type::SC, free), ec (e), budget (Stc::ms_to_ticks (b)), cpu (n), cos (c), prio (p)
 {
     trace (TRACE_CREATE, "SC:%p created (EC:%p CPU:%u Budget:%ums Prio:%u COS:%u)", static_cast<void *>(this), static_cast<void *>(ec), cpu, b, p, c);
 }
 
+Sc *Sc::create (Status &s, unsigned n, Ec *e, uint16 b, uint8 p, uint16 c)
+{
+    // The SC holds a reference to the EC
+    if (EXPECT_FALSE (!e->add_ref())) {
+        s = Status::ABORTED;
+        return nullptr;
+    }
+
+    auto const sc { new (cache) Sc (n, e, b, p, c) };
+
+    if (EXPECT_TRUE (sc))
+        return sc;
+
+    e->del_ref();
+
+    s = Status::INS_MEM;
+
+    return nullptr;
+}
+
+void Sc::destroy()
+{
+    ec->del_ref();
+
+    operator delete (this, cache);
+}
+
 void Scheduler::Ready::enqueue (Sc *sc, uint64 t)
 {
     assert (sc->cpu == Cpu::id);
     assert (sc->prio < priorities);
 
+    // An SC whose last reference is gone does not become ready again
+    if (EXPECT_FALSE (sc->dead)) {
+        zombie.enqueue_tail (sc);
+        return;
+    }
+
     if (sc->prio > prio_top)
         prio_top = sc->prio;
 
@@ -78,6 +111,16 @@ auto Scheduler::Ready::dequeue (uint64 t)
     return sc;
 }
 
+/*
+ * Reclaim SCs whose last reference is gone
+ *
+ * None of these SCs can be current, because the scheduler has already picked the next SC.
+ */
+void Scheduler::Ready::reap()
+{
+    for (Sc *sc; (sc = zombie.dequeue_head()); sc->destroy()) ;
+}
+
 void Scheduler::Release::enqueue (Sc *sc)
 {
     auto const r { Kmem::loc_to_glob (this, sc->cpu) };
@@ -137,6 +180,8 @@ void Scheduler::schedule (bool blocked)
 
         current = ready.dequeue (t);
 
+        ready.reap();
+
         Cos::make_current (current->cos);
 
         Timeout_budget::timeout.enqueue (t + current->left);
@@ -166,7 +166,7 @@ Slab_cache::Slab_cache (size_t s, size_t a) : bsz (static_cast<uint16>(align_up
  */
 void *Slab_cache::alloc()
 {
-    Lock_guard <Spinlock> guard (lock);
+    Lock_guard <Mcslock> guard (lock);
 
     // Cache contains no slabs or only full slabs
     if (EXPECT_FALSE (!curr)) {
@@ -210,7 +210,7 @@ void *Slab_cache::alloc()
  */
 void Slab_cache::free (void *p)
 {
-    Lock_guard <Spinlock> guard (lock);
+    Lock_guard <Mcslock> guard (lock);
 
     // Compute slab for this element
     auto slab = Slab::from_buffer (p);
@@ -25,7 +25,45 @@
 INIT_PRIORITY (PRIO_SLAB)
 Slab_cache Sm::cache (sizeof (Sm), Kobject::alignment);
 
-Sm::Sm (uint64 c, unsigned i) : Kobject (Kobject::Type::SM), counter (c), id (i)
+Sm::Sm (uint64 c, unsigned i) : Kobject (Kobject::Type::SM, free), counter (static_cast<int64_t>(c)), id (i)
 {
     trace (TRACE_CREATE, "SM:%p created (CNT:%llu)", static_cast<void *>(this), c);
 }
+
+/*
+ * Reclaim the SM after the last reference is gone
+ *
+ * ECs that are still blocked on the SM abort their operation. None of them can have a
+ * pending timeout, because that would hold a reference to the SM. The SM is destroyed
+ * after another grace period, because Ec::free may still use the SM of an aborted EC.
+ */
+void Sm::free (Rcu_elem *e)
+{
+    auto const sm { static_cast<Sm *>(e) };
+
+    for (Ec *ec;;) {
+
+        {   Lock_guard <Mcslock> guard (sm->lock);
+
+            if (!(ec = sm->dequeue_head()))
+                break;
+
+            // The EC can now be activated again
+            ec->unblock (Ec::sys_finish<Status::ABORTED>, false);
+        }
+
+        ec->unblock_sc();
+    }
+
+    sm->rcu_func = drop;
+
+    Rcu::call (sm);
+}
+
+/*
+ * Destroy the SM after ECs that were blocked on it can no longer refer to it
+ */
+void Sm::drop (Rcu_elem *e)
+{
+    static_cast<Sm *>(e)->destroy();
+}
@@ -35,6 +35,10 @@ Status Space_mem<T>::delegate (Space_hst const *hst, unsigned long ssb, unsigned
 
     Status sts { Status::SUCCESS };
 
+    // Source lookups and destination updates advance in lock-step, each resuming the walk of its predecessor
+    Space_hst::Cursor s_cur;
+    typename T::Cursor d_cur { true };
+
     for (auto src { ssb }, dst { dsb }; src < s_end; src += BITN (o), dst += BITN (o)) {
 
         uintptr_t s { src << PAGE_BITS };
@@ -43,7 +47,7 @@ Status Space_mem<T>::delegate (Space_hst const *hst, unsigned long ssb, unsigned
         Memattr::Cacheability src_ca;
         Memattr::Shareability src_sh;
 
-        auto pm { Paging::Permissions (hst->lookup (s, p, o, src_ca, src_sh) & (Paging::K | Paging::U | pmm)) };
+        auto pm { Paging::Permissions (hst->lookup (s, p, o, src_ca, src_sh, &s_cur) & (Paging::K | Paging::U | pmm)) };
 
         // Kernel memory cannot be delegated
         if (pm & Paging::K)
@@ -61,11 +65,11 @@ Status Space_mem<T>::delegate (Space_hst const *hst, unsigned long ssb, unsigned
         d &= ~Hpt::offs_mask (o);
         p &= ~Hpt::offs_mask (o);
 
-        if ((sts = static_cast<T *>(this)->update (d, p, o, pm, ca, sh)) != Status::SUCCESS)
+        if ((sts = static_cast<T *>(this)->update (d, p, o, pm, ca, sh, &d_cur)) != Status::SUCCESS)
             break;
     }
 
-    static_cast<T *>(this)->sync();
+    static_cast<T *>(this)->sync (dsb << PAGE_BITS, BITN (ord + PAGE_BITS));
 
     Buddy::free_wait();
 
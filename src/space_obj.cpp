@@ -20,8 +20,88 @@
  */
 
 #include "buddy.hpp"
+#include "lock_guard.hpp"
 #include "space_obj.hpp"
 
+/*
+ * Derivation Tree Node
+ *
+ * Every non-empty capability slot has a node that links it to the node of the slot it was
+ * delegated from (parent) and to the nodes of the slots that were delegated from it (children).
+ * All slot updates and all changes to the derivation tree are serialized by a single lock.
+ * Capability lookups do not take the lock and only observe atomic slot updates.
+ */
+struct Space_obj::Node final : public Queue<Node>::Element
+{
+    Atomic<Capability> *const   slot;                   // Capability Slot
+    Node *                      parent  { nullptr };    // Parent Node
+    Queue<Node>                 child;                  // Child Nodes
+
+    static Slab_cache           cache;
+    static Spinlock             lock;
+
+    inline explicit Node (Atomic<Capability> *s) : slot (s) {}
+
+    /*
+     * Determine the node pointer for a capability slot
+     *
+     * The node pointers of a leaf Captable reside in the page following its capability slots.
+     *
+     * @param s     Capability slot
+     * @return      Pointer to the node pointer of that slot
+     */
+    static inline auto ptr (Atomic<Capability> *s) { return reinterpret_cast<Atomic<Node *> *>(reinterpret_cast<uintptr_t>(s) + PAGE_SIZE); }
+
+    /*
+     * Link the node as a child of the specified parent node
+     *
+     * @param p     Parent node (or nullptr for a root node)
+     */
+    inline void link (Node *p)
+    {
+        if ((parent = p))
+            p->child.enqueue_tail (this);
+    }
+
+    /*
+     * Unlink the node from the derivation tree; its children move up to its parent
+     */
+    inline void unlink()
+    {
+        for (Node *c; (c = child.dequeue_head()); c->link (parent)) ;
+
+        if (parent)
+            parent->child.dequeue (this);
+
+        parent = nullptr;
+    }
+
+    /*
+     * Remove the capability from the slot, drop the object reference and deallocate the node
+     */
+    inline void zap()
+    {
+        Capability old, nul;
+
+        slot->exchange (old, nul);
+
+        *ptr (slot) = nullptr;
+
+        old.obj()->del_ref();
+
+        delete this;
+    }
+
+    [[nodiscard]] static inline void *operator new (size_t) noexcept { return cache.alloc(); }
+
+    NONNULL static inline void operator delete (void *ptr) { cache.free (ptr); }
+};
+
+INIT_PRIORITY (PRIO_SLAB)
+Slab_cache Space_obj::Node::cache (sizeof (Node), alignof (Node));
+
+Spinlock Space_obj::Node::lock;
+
 INIT_PRIORITY (PRIO_SPACE_OBJ)
 ALIGNED (Kobject::alignment) Space_obj Space_obj::nova;
 
@@ -39,6 +119,9 @@ ALIGNED (Kobject::alignment) Space_obj Space_obj::nova;
  *   - or nullptr (next level does not yet exist)
  * The root is a single Captable * and is not indexed.
  *
+ * Leaf Captables are followed by a second page that stores the derivation tree node
+ * pointers (Node *[n]) for the respective capability slots.
+ *
  *      --------------------------------------------------------------------
  * sel | unused |  bpl bits (ccc)   |  bpl bits (bbb)   |  bpl bits (aaa)   |
  *      -------------|-------------------|-------------------|--------------
@@ -65,13 +148,14 @@ struct Space_obj::Captable
     /*
      * Allocate a Captable
      *
+     * @param leaf  True for a leaf Captable (with node pointers), false otherwise
      * @return      Pointer to the Captable (allocation success) or nullptr (allocation failure)
      */
     [[nodiscard]] ALWAYS_INLINE
-    static inline void *operator new (size_t) noexcept
+    static inline void *operator new (size_t, bool leaf) noexcept
     {
         static_assert (sizeof (Captable) == PAGE_SIZE);
-        return Buddy::alloc (0);
+        return leaf ? Buddy::alloc (1, Buddy::Fill::BITS0) : Buddy::alloc (0);
     }
 
     /*
@@ -88,14 +172,30 @@ struct Space_obj::Captable
     /*
      * Deallocate a Captable subtree
      *
+     * Capabilities in leaf Captables are removed from the derivation tree and release their object reference.
+     *
      * @param l     Subtree level
      */
     inline void deallocate (unsigned l)
     {
         if (l)
-            for (unsigned i = 0; i < entries; i++)
+            for (unsigned i = 0; i < entries; i++) {
                 if (slot[i])
                     slot[i]->deallocate (l - 1);
+            }
+
+        else {
+            Lock_guard <Spinlock> guard (Node::lock);
+
+            for (unsigned i = 0; i < entries; i++) {
+                auto const s { reinterpret_cast<Atomic<Capability> *>(slot + i) };
+
+                if (auto const n { Node::ptr (s)->load() }; n) {
+                    n->unlink();
+                    n->zap();
+                }
+            }
+        }
 
         delete this;
     }
@@ -136,7 +236,7 @@ Atomic<Capability> *Space_obj::walk (unsigned long sel, bool e)
                 return reinterpret_cast<Atomic<Capability> *>(~0UL);
 
             // Allocate a new capability table
-            auto tbl = new Captable;
+            auto tbl = new (l == 1) Captable;
 
             // Terminate the walk if allocation failed
             if (EXPECT_FALSE (!tbl))
@@ -156,6 +256,24 @@ Atomic<Capability> *Space_obj::walk (unsigned long sel, bool e)
     }
 }
 
+/*
+ * Find the capability slot for the specified selector without allocating capability tables
+ *
+ * @param sel   Selector whose slot is being looked up
+ * @return      Pointer to the capability slot (if exists) or nullptr (otherwise)
+ */
+Atomic<Capability> *Space_obj::find (unsigned long sel) const
+{
+    Captable *cte { root };
+
+    // Walk down the existing capability tables from the root, computing the slot index at each level
+    for (auto l = lev - 1; cte; cte = cte->slot[(sel >> l-- * bpl) % Captable::entries])
+        if (!l)
+            return reinterpret_cast<Atomic<Capability> *>(&cte->slot[sel % Captable::entries]);
+
+    return nullptr;
+}
+
 /*
  * Lookup OBJ capability for the specified selector
  *
@@ -175,36 +293,11 @@ Capability Space_obj::lookup (unsigned long sel) const
     }
 }
 
-/*
- * Update OBJ capability for the specified selector
- *
- * @param sel   Selector whose capability is being updated
- * @param cap   New capability for that selector
- * @param old   Old capability for that selector
- * @return      SUCCESS (successful) or INS_MEM (allocation failure)
- */
-Status Space_obj::update (unsigned long sel, Capability cap, Capability &old)
-{
-    // Get capability slot pointer
-    auto ptr = walk (sel, cap.prm());
-
-    // Allocation failure
-    if (EXPECT_FALSE (!ptr))
-        return Status::INS_MEM;
-
-    // Skippable hole
-    if (ptr == reinterpret_cast<decltype (ptr)>(~0UL))
-        return Status::SUCCESS;
-
-    // Replace old with new capability
-    ptr->exchange (old, cap);
-
-    return Status::SUCCESS;
-}
-
 /*
  * Insert OBJ capability for the specified selector if slot is empty
  *
+ * The capability takes over the initial reference of its object and becomes a derivation tree root.
+ *
  * @param sel   Selector whose capability is being inserted
  * @param cap   New capability for that selector (must not be a null capability)
  * @return      SUCCESS (successful) or INS_MEM (allocation failure) or BAD_CAP (slot not empty)
@@ -212,19 +305,37 @@ Status Space_obj::update (unsigned long sel, Capability cap, Capability &old)
 Status Space_obj::insert (unsigned long sel, Capability cap)
 {
     // Get capability slot pointer. Allocate based on assumption that cap is not a null capability
-    auto ptr = walk (sel, true); Capability old;
+    auto const ptr { walk (sel, true) };
 
     // No slot, return error because we wanted to allocate
     if (EXPECT_FALSE (!ptr))
         return Status::INS_MEM;
 
-    // Try to install the new capability
-    return ptr->compare_exchange (old, cap) ? Status::SUCCESS : Status::BAD_CAP;
+    auto const nod { new Node (ptr) };
+
+    if (EXPECT_FALSE (!nod))
+        return Status::INS_MEM;
+
+    {   Lock_guard <Spinlock> guard (Node::lock);
+
+        // Try to install the new capability
+        if (Capability old; EXPECT_TRUE (ptr->compare_exchange (old, cap))) {
+            *Node::ptr (ptr) = nod;
+            return Status::SUCCESS;
+        }
+    }
+
+    delete nod;
+
+    return Status::BAD_CAP;
 }
 
 /*
  * Delegate OBJ capability range
  *
+ * Each delegated capability becomes a child of its source capability in the derivation tree.
+ * A capability previously held in a destination slot is removed and its children move up to its parent.
+ *
  * @param obj   Source OBJ space
  * @param src   Selector base (source)
  * @param dst   Selector base (destination)
@@ -239,19 +350,146 @@ Status Space_obj::delegate (Space_obj const *obj, unsigned long src, unsigned lo
     if (EXPECT_FALSE (s_end > num || d_end > num))
         return Status::BAD_PAR;
 
-    Status sts = Status::SUCCESS;
-
     for (auto s_sel = src, d_sel = dst; s_sel < s_end; s_sel++, d_sel++) {
 
-        Capability cap = obj->lookup (s_sel), old;
+        // Allocate the destination slot and a node only if the source is likely to yield a capability
+        auto const e { (obj->lookup (s_sel).prm() & pmm) != 0 };
+
+        // Get capability slot pointer
+        auto ptr = walk (d_sel, e);
+
+        // Allocation failure
+        if (EXPECT_FALSE (!ptr))
+            return Status::INS_MEM;
+
+        // Skippable hole
+        if (ptr == reinterpret_cast<decltype (ptr)>(~0UL))
+            continue;
+
+        auto nod { e ? new Node (ptr) : nullptr };
+
+        if (EXPECT_FALSE (e && !nod))
+            return Status::INS_MEM;
+
+        Capability old;
+
+        {   Lock_guard <Spinlock> guard (Node::lock);
 
-        auto o = cap.obj();
-        auto p = cap.prm() & pmm;
+            // Reread the source capability now that slots cannot change
+            auto const s { obj->find (s_sel) };
+            auto const c { s ? Capability (*s) : Capability() };
 
-        // FIXME: Inc refcount for new capability object and dec refcount for old capability object
-        if ((sts = update (d_sel, Capability (o, p), old)) != Status::SUCCESS)
-            break;
+            auto const o { c.obj() };
+            auto p { c.prm() & pmm };
+
+            // A source that became non-empty after our lookup is treated as if it was still empty
+            if (!nod || (p && !o->add_ref()))
+                p = 0;
+
+            // Replace old with new capability
+            Capability cap (o, p);
+            ptr->exchange (old, cap);
+
+            auto const prv { Node::ptr (ptr)->load() };
+
+            // Delegation onto the source slot itself retains its position in the derivation tree
+            if (s == ptr && prv) {
+                if (!p) {
+                    prv->unlink();
+                    *Node::ptr (ptr) = nullptr;
+                    delete prv;
+                }
+            }
+
+            else {
+                if (prv) {
+                    prv->unlink();
+                    delete prv;
+                }
+
+                if (p) {
+                    nod->link (Node::ptr (s)->load());
+                    *Node::ptr (ptr) = nod;
+                    nod = nullptr;
+                }
+
+                else
+                    *Node::ptr (ptr) = nullptr;
+            }
+        }
+
+        if (old.obj())
+            old.obj()->del_ref();
+
+        if (nod)
+            delete nod;
     }
 
-    return sts;
+    return Status::SUCCESS;
+}
+
+/*
+ * Revoke OBJ capability range
+ *
+ * Removes all capabilities that were transitively delegated from the capabilities in the range and
+ * optionally the capabilities in the range themselves. Revoked capabilities release their object
+ * reference, so objects become unreachable once their last capability is gone.
+ *
+ * @param sel   Selector base
+ * @param ord   Selector order (2^ord selectors)
+ * @param self  True to also revoke the capabilities in the range, false to only revoke derived capabilities
+ * @return      SUCCESS (successful), BAD_CAP (kernel-owned capabilities) or BAD_PAR (bad parameter)
+ */
+Status Space_obj::revoke (unsigned long sel, unsigned ord, bool self)
+{
+    auto const end = sel + BITN (ord);
+
+    // The capabilities of the kernel space hold the only references to kernel-owned objects
+    if (EXPECT_FALSE (self && this == &nova))
+        return Status::BAD_CAP;
+
+    if (EXPECT_FALSE (end > num))
+        return Status::BAD_PAR;
+
+    for (; sel < end; sel++) {
+
+        auto const ptr { find (sel) };
+
+        // Skip the remainder of a nonexistent leaf Captable
+        if (!ptr) {
+            sel |= Captable::entries - 1;
+            continue;
+        }
+
+        Lock_guard <Spinlock> guard (Node::lock);
+
+        auto const r { Node::ptr (ptr)->load() };
+
+        if (!r)
+            continue;
+
+        // Revoke the subtree below r in post-order without recursion
+        for (auto n { r };;) {
+
+            // Descend into the next child, which has already been detached from its parent
+            if (auto const c { n->child.dequeue_head() }; c) {
+                n = c;
+                continue;
+            }
+
+            if (n == r)
+                break;
+
+            auto const p { n->parent };
+            n->zap();
+            n = p;
+        }
+
+        if (self) {
+            r->unlink();
+            r->zap();
+        }
+    }
+
+    return Status::SUCCESS;
 }
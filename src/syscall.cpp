@@ -25,6 +25,7 @@
 #include "counter.hpp"
 #include "ec_arch.hpp"
 #include "interrupt.hpp"
+#include "lockprof.hpp"
 #include "lowlevel.hpp"
 #include "pt.hpp"
 #include "sm.hpp"
@@ -336,6 +337,51 @@ void Ec::sys_ctrl_pd (Ec *const self)
         self->sys_finish_status (Status::BAD_PAR);
 
     auto const cst { self->get_obj()->lookup (r.src()) };
+
+    if (EXPECT_FALSE (r.revoke())) {
+
+        if (EXPECT_FALSE (!cst.validate (Capability::Perm_sp::TAKE, Kobject::Subtype::OBJ)))
+            self->sys_finish_status (Status::BAD_CAP);
+
+        self->sys_finish_status (static_cast<Space_obj *>(cst.obj())->revoke (r.ssb(), r.ord(), r.self()));
+    }
+
+    if (EXPECT_FALSE (r.dirty())) {
+
+        if (EXPECT_FALSE (!cst.validate (Capability::Perm_sp::ASSIGN, Kobject::Subtype::GST)))
+            self->sys_finish_status (Status::BAD_CAP);
+
+        // The dirty bitmap of the range is returned in the UTCB
+        if (EXPECT_FALSE (BITN (r.ord()) > Utcb::bmp_bits || r.ssb() + BITN (r.ord()) > Space_gst::num))
+            self->sys_finish_status (Status::BAD_PAR);
+
+        auto const bmp { self->utcb->bitmap() };
+
+        for (unsigned i { 0 }; i < (BITN (r.ord()) + 63) / 64; i++)
+            bmp[i] = 0;
+
+        self->sys_finish_status (static_cast<Space_gst *>(cst.obj())->harvest (r.ssb(), r.ord(), bmp));
+    }
+
+    if (EXPECT_FALSE (r.accessed())) {
+
+        auto const gst { cst.validate (Capability::Perm_sp::ASSIGN, Kobject::Subtype::GST) };
+
+        if (EXPECT_FALSE (!gst && !cst.validate (Capability::Perm_sp::TAKE, Kobject::Subtype::HST)))
+            self->sys_finish_status (Status::BAD_CAP);
+
+        // The accessed bitmap of the range is returned in the UTCB
+        if (EXPECT_FALSE (BITN (r.ord()) > Utcb::bmp_bits || r.ssb() + BITN (r.ord()) > (gst ? Space_gst::num : Space_hst::num)))
+            self->sys_finish_status (Status::BAD_PAR);
+
+        auto const bmp { self->utcb->bitmap() };
+
+        for (unsigned i { 0 }; i < (BITN (r.ord()) + 63) / 64; i++)
+            bmp[i] = 0;
+
+        self->sys_finish_status (gst ? static_cast<Space_gst *>(cst.obj())->age (r.ssb(), r.ord(), bmp) : static_cast<Space_hst *>(cst.obj())->age (r.ssb(), r.ord(), bmp));
+    }
+
     auto const cdt { self->get_obj()->lookup (r.dst()) };
 
     Kobject::Subtype st, dt;
@@ -463,7 +509,7 @@ void Ec::sys_ctrl_sm (Ec *const self)
                 Interrupt::deactivate (id);
         }
 
-        sm->dn (self, r.zc(), r.time_ticks());
+        sm->dn (self, r.zc(), r.time_ticks(), r.slack_ticks());
 
     } else if (!sm->up())   // Up
         self->sys_finish_status (Status::OVRFLOW);
@@ -485,6 +531,9 @@ void Ec::sys_ctrl_hw (Ec *const self)
         default:            // Invalid Operation
             self->sys_finish_status (Status::BAD_PAR);
 
+        case 8:             // Lock Profile Dump
+            self->sys_finish_status (Lockprof::dump());
+
         case 7:             // MBA L2 Delay
             self->sys_finish_status (Cos::cfg_mb_thrt (static_cast<uint16>(r.desc()), static_cast<uint16>(r.desc() >> 16)));
 
@@ -530,10 +579,31 @@ void Ec::sys_assign_int (Ec *const self)
 
     assert (static_cast<Sm *>(csm.obj())->get_id() != ~0U);
 
-    uint32 msi_addr;
+    Interrupt::Config const cfg { r.cpu(), r.dev(), r.flg() };
+
+    Ec *vcpu { nullptr };
+
+    // An interrupt that is posted into a vCPU holds a reference to the vCPU
+    if (cfg.pst() && Interrupt::postable (static_cast<Sm *>(csm.obj())->get_id())) {
+
+        auto const cec { self->get_obj()->lookup (r.ec()) };
+
+        if (EXPECT_FALSE (!cec.validate (Capability::Perm_ec::CTRL) || !(vcpu = static_cast<Ec *>(cec.obj()))->is_vcpu() || !vcpu->add_ref()))
+            self->sys_finish_status (Status::BAD_CAP);
+    }
+
+    uint64 msi_addr;
     uint16 msi_data;
 
-    Interrupt::configure (static_cast<Sm *>(csm.obj())->get_id(), Interrupt::Config (r.cpu(), r.dev(), r.flg()), msi_addr, msi_data);
+    auto const s { Interrupt::configure (static_cast<Sm *>(csm.obj())->get_id(), cfg, r.mod(), vcpu, r.vec(), msi_addr, msi_data) };
+
+    if (EXPECT_FALSE (s != Status::SUCCESS)) {
+
+        if (vcpu)
+            vcpu->del_ref();
+
+        self->sys_finish_status (s);
+    }
 
     r.set_msi_addr (msi_addr);
     r.set_msi_data (msi_data);
@@ -560,8 +630,16 @@ void Ec::sys_assign_dev (Ec *const self)
     if (EXPECT_FALSE (!smmu))
         self->sys_finish_status (Status::BAD_DEV);
 
-    if (EXPECT_FALSE (!smmu->configure (static_cast<Space_dma *>(csp.obj()), r.dad())))
+    auto const dma { static_cast<Space_dma *>(csp.obj()) };
+
+    // The SMMU references the DMA space from its device context, which pins the DMA space
+    if (EXPECT_FALSE (!dma->add_ref()))
+        self->sys_finish_status (Status::BAD_CAP);
+
+    if (EXPECT_FALSE (!smmu->configure (dma, r.dad()))) {
+        dma->del_ref();
         self->sys_finish_status (Status::BAD_PAR);
+    }
 
     self->sys_finish_status (Status::SUCCESS);
 }
@@ -22,62 +22,139 @@
 
 Timeout *Timeout::list;
 
-void Timeout::enqueue (uint64 t)
+/*
+ * Meld two heaps
+ *
+ * @param a     Root of the first heap
+ * @param b     Root of the second heap
+ * @return      Root of the melded heap
+ */
+Timeout *Timeout::meld (Timeout *a, Timeout *b)
 {
-    assert (this != list);
-    assert (!prev);
-    assert (!next);
+    if (b->late < a->late) {
+        auto const t { a };
+        a = b;
+        b = t;
+    }
 
-    time = t;
+    // The later root becomes the leftmost child of the earlier root
+    b->prev = a;
+    b->next = a->child;
 
-    Timeout *p = nullptr;
+    if (a->child)
+        a->child->prev = b;
 
-    for (Timeout *n = list; n; p = n, n = n->next)
-        if (n->time >= time)
-            break;
+    a->child = b;
 
-    prev = p;
+    return a;
+}
 
-    if (!p) {
-        next = list;
-        list = this;
-        sync();
-    } else {
-        next = p->next;
-        p->next = this;
+/*
+ * Merge a list of siblings into a single heap using the two-pass method
+ *
+ * @param c     Leftmost sibling
+ * @return      Root of the merged heap
+ */
+Timeout *Timeout::merge (Timeout *c)
+{
+    Timeout *r { nullptr };
+
+    // First pass: Meld pairs from left to right, chaining the results in reverse order
+    while (c) {
+
+        auto a { c };
+        auto const b { c->next };
+
+        c = b ? b->next : nullptr;
+
+        a->prev = a->next = nullptr;
+
+        if (b) {
+            b->prev = b->next = nullptr;
+            a = meld (a, b);
+        }
+
+        a->next = r;
+        r = a;
+    }
+
+    Timeout *h { nullptr };
+
+    // Second pass: Meld the results from right to left
+    while (r) {
+
+        auto const n { r->next };
+
+        r->next = nullptr;
+
+        h = h ? meld (h, r) : r;
+
+        r = n;
     }
 
-    if (next)
-        next->prev = this;
+    return h;
+}
+
+/*
+ * Arm the timeout
+ *
+ * The timeout may fire anywhere between its deadline and its deadline plus slack. The timer
+ * is programmed for the earliest late deadline, and each timer interrupt also fires all
+ * other timeouts whose deadline has passed, so that deadlines within one another's slack
+ * windows are served by a single interrupt.
+ *
+ * @param t     Deadline
+ * @param s     Slack
+ */
+void Timeout::enqueue (uint64 t, uint64 s)
+{
+    assert (this != list);
+    assert (!prev);
+    assert (!next);
+    assert (!child);
+
+    time = t;
+    late = t + s < t ? ~0ULL : t + s;
+
+    if (!list || late < list->late) {
+        list = list ? meld (this, list) : this;
+        sync();
+    } else
+        meld (list, this);
 }
 
 uint64 Timeout::dequeue()
 {
-    if (list == this || prev) {
+    if (list == this) {
+        list = merge (child);
+        sync();
+    }
 
-        if (next)
-            next->prev = prev;
+    else if (prev) {
 
-        if (prev)
+        if (prev->child == this)
+            prev->child = next;
+        else
             prev->next = next;
 
-        else {
-            list = next;
-            sync();
-        }
+        if (next)
+            next->prev = prev;
 
-        prev = next = nullptr;
+        // The children cannot precede the root, so the earliest timeout remains unchanged
+        if (child)
+            meld (list, merge (child));
     }
 
+    prev = next = child = nullptr;
+
     assert (this != list);
-    assert (!prev);
-    assert (!next);
 
     return time;
 }
 
 void Timeout::check()
 {
+    // Stop at the first timeout in order of late deadlines whose deadline has not passed yet
     while (list && list->time <= Timer::time()) {
         Timeout *t = list;
         t->dequeue();
@@ -88,7 +165,7 @@ void Timeout::check()
 void Timeout::sync()
 {
     if (list)
-        Timer::set_dln (list->time);
+        Timer::set_dln (list->late);
     else
         Timer::stop();
 }
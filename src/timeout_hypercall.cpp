@@ -19,7 +19,41 @@
 #include "sm.hpp"
 #include "timeout_hypercall.hpp"
 
+/*
+ * Arm the timeout
+ *
+ * The pending timeout holds a reference to the SM, so that the SM cannot be reclaimed
+ * while the EC is waiting for it.
+ */
+void Timeout_hypercall::enqueue (uint64 t, uint64 l, Sm *s)
+{
+    if (EXPECT_FALSE (!s->add_ref()))
+        return;
+
+    sm = s;
+
+    Timeout::enqueue (t, l);
+}
+
+/*
+ * Disarm the timeout
+ */
+void Timeout_hypercall::dequeue()
+{
+    Timeout::dequeue();
+
+    if (sm) {
+        sm->del_ref();
+        sm = nullptr;
+    }
+}
+
 void Timeout_hypercall::trigger()
 {
-    sm->timeout (ec);
+    auto const s { sm };
+
+    sm = nullptr;
+
+    s->timeout (ec);
+    s->del_ref();
 }
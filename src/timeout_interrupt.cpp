@@ -0,0 +1,99 @@
+/*
+ * Interrupt Moderation Timeout
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "cpu.hpp"
+#include "lock_guard.hpp"
+#include "sm.hpp"
+#include "timeout_interrupt.hpp"
+#include "timer.hpp"
+
+/*
+ * Configure moderation
+ *
+ * Arrivals accounted under the previous configuration are delivered to the previous SM
+ * first. An armed timeout can only be dequeued on the CPU whose timeout heap holds it.
+ * A timeout armed on another CPU stays armed and delivers the arrivals accounted until
+ * it fires, so arrivals are held back for at most one previous delay interval.
+ *
+ * @param s     SM that receives the interrupt
+ * @param m     Minimum delay between deliveries in ticks [63:16] and arrival threshold [15:0]
+ */
+void Timeout_interrupt::configure (Sm *s, uint64 m)
+{
+    Lock_guard <Spinlock> guard (lock);
+
+    if (armed.load() && cpu == Cpu::id) {
+        dequeue();
+        armed.store (false);
+    }
+
+    if (sm)
+        deliver (Timer::time());
+
+    sm = s;
+    mod.store (m >> 16 ? m : 0);
+}
+
+/*
+ * Account an interrupt arrival
+ *
+ * Runs on the CPU the interrupt is routed to, so the timeout is armed in
+ * that CPU's timeout heap.
+ */
+void Timeout_interrupt::arrival()
+{
+    Lock_guard <Spinlock> guard (lock);
+
+    auto const m { mod.load() };
+    auto const n { ++count };
+    auto const t { Timer::time() };
+
+    if ((m & BIT_RANGE (15, 0) && n >= (m & BIT_RANGE (15, 0))) || t - last >= m >> 16)
+        deliver (t);
+
+    else if (!armed.load()) {
+        armed.store (true);
+        cpu = Cpu::id;
+        enqueue (last + (m >> 16));
+    }
+}
+
+/*
+ * Deliver all pending arrivals with a single up operation
+ *
+ * @param t     Current time
+ */
+void Timeout_interrupt::deliver (uint64 t)
+{
+    last = t;
+
+    uint64 o, n { 0 };
+
+    count.exchange (o, n);
+
+    if (o)
+        sm->up (o);
+}
+
+void Timeout_interrupt::trigger()
+{
+    Lock_guard <Spinlock> guard (lock);
+
+    armed.store (false);
+
+    deliver (Timer::time());
+}
@@ -25,6 +25,7 @@
 #include "hip.hpp"
 #include "hpet.hpp"
 #include "ioapic.hpp"
+#include "lapic.hpp"
 #include "pci.hpp"
 #include "smmu.hpp"
 #include "space_dma.hpp"
@@ -85,6 +86,9 @@ void Acpi_table_dmar::Remapping_rmrr::parse() const
 
 void Acpi_table_dmar::parse() const
 {
+    if (flags & Flags::X2APIC_OPT_OUT)
+        Lapic::x2apic = false;
+
     if (EXPECT_FALSE (Cmdline::nosmmu))
         return;
 
@@ -35,6 +35,15 @@ void Acpi_table_madt::Controller_lapic::parse() const
     }
 }
 
+void Acpi_table_madt::Controller_x2apic::parse() const
+{
+    // CPUs with an APIC ID below 255 may be described by both structures
+    if (Cpu::count < NUM_CPU && flags & (Flags::ONLINE_CAPABLE | Flags::ENABLED) && Cpu::find_by_apic_id (id) == ~0U) {
+        Cpu::acpi_id[Cpu::count]   = acpi_uid;
+        Cpu::apic_id[Cpu::count++] = id;
+    }
+}
+
 void Acpi_table_madt::Controller_ioapic::parse() const
 {
     auto ioapic = new Ioapic (phys, id, gsi);
@@ -61,6 +70,7 @@ void Acpi_table_madt::parse() const
         switch (c->type) {
             case Controller::LAPIC:  static_cast<Controller_lapic  const *>(c)->parse(); break;
             case Controller::IOAPIC: static_cast<Controller_ioapic const *>(c)->parse(); break;
+            case Controller::X2APIC: static_cast<Controller_x2apic const *>(c)->parse(); break;
             default: break;
         }
 
@@ -21,6 +21,7 @@
  */
 
 #include "acpi.hpp"
+#include "asid.hpp"
 #include "bits.hpp"
 #include "cache.hpp"
 #include "cmdline.hpp"
@@ -40,6 +41,7 @@
 
 unsigned    Cpu::id;
 unsigned    Cpu::hazard;
+Cpu::State  Cpu::gstate;
 
 Cpu::Vendor Cpu::vendor;
 unsigned    Cpu::platform;
@@ -216,7 +218,7 @@ void Cpu::enumerate_features (uint32 &clk, uint32 &rat, uint32 (&name)[12], unsi
     if (eax & 0x80000000) {
         switch (static_cast<uint8>(eax)) {
             default:
-                cpuid (0x8000000a, Vmcb::svm_version, ebx, ecx, Vmcb::svm_feature);
+                cpuid (0x8000000a, Vmcb::svm_version, Asid::num, ecx, Vmcb::svm_feature);
                 [[fallthrough]];
             case 0x4 ... 0x9:
                 cpuid (0x80000004, name[8], name[9], name[10], name[11]);
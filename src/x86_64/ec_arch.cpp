@@ -21,15 +21,21 @@
 #include "ec_arch.hpp"
 #include "entry.hpp"
 #include "event.hpp"
+#include "exit_policy.hpp"
 #include "fpu.hpp"
 #include "hip.hpp"
+#include "interrupt.hpp"
 #include "multiboot.hpp"
 #include "pd.hpp"
+#include "pi_desc.hpp"
 #include "rcu.hpp"
 #include "sc.hpp"
 #include "space_gst.hpp"
+#include "space_msr.hpp"
+#include "space_pio.hpp"
 #include "stdio.hpp"
 #include "timer.hpp"
+#include "vmcs_cache.hpp"
 #include "vpid.hpp"
 
 // Constructor: Kernel Thread
@@ -57,7 +63,7 @@ Ec_arch::Ec_arch (Space_obj *obj, Space_hst *hst, Space_pio *pio, Fpu *f, Utcb *
 
 // Constructor: Virtual CPU (VMX)
 template <>
-Ec_arch::Ec_arch (Space_obj *obj, Space_hst *hst, Fpu *f, Vmcs *v, unsigned c, unsigned long e, bool t) : Ec (obj, hst, f, v, c, e, t, send_msg<ret_user_vmexit_vmx>)
+Ec_arch::Ec_arch (Space_obj *obj, Space_hst *hst, Fpu *f, Vmcs *v, unsigned c, unsigned long e, bool t, uintptr_t a) : Ec (obj, hst, f, v, c, e, t, send_msg<ret_user_vmexit_vmx>)
 {
     assert (obj && hst && v);
 
@@ -69,11 +75,40 @@ Ec_arch::Ec_arch (Space_obj *obj, Space_hst *hst, Fpu *f, Vmcs *v, unsigned c, u
     // FIXME: Allocation failure
     assert (hst->get_ptab (c));
 
-    auto const cr3 { Kmem::ptr_to_phys (hst->get_ptab (c)) | (Cpu::feature (Cpu::Feature::PCID) ? hst->get_pcid() : 0) };
-    v->init (reinterpret_cast<uintptr_t>(&sys_regs() + 1), cr3, Vpid::alloc (cpu));
+    // The VPID and the PCID of the host CR3 are assigned on the CPU before the first VM entry
+    v->init (reinterpret_cast<uintptr_t>(&sys_regs() + 1), Kmem::ptr_to_phys (hst->get_ptab (c)));
 
     assert (regs.vmcs == Vmcs::current);
 
+    // Map the virtual-APIC page like a UTCB, so that it is reclaimed along with the HST space
+    if (Vmcs::has_tpr() && (regs.vapic = static_cast<uint32 *>(Buddy::alloc (0, Buddy::Fill::BITS0)))) {
+        hst->update (a, Kmem::ptr_to_phys (regs.vapic), 0, Paging::Permissions (Paging::K | Paging::U | Paging::W | Paging::R), Memattr::Cacheability::MEM_WB, Memattr::Shareability::INNER);
+        Vmcs::write (Vmcs::Encoding::APIC_VIRT_ADDR, Kmem::ptr_to_phys (regs.vapic));
+    }
+
+    if (Vmcs::has_vint() && regs.vapic) {
+        Vmcs::write (Vmcs::Encoding::BITMAP_EOI0, 0);
+        Vmcs::write (Vmcs::Encoding::BITMAP_EOI1, 0);
+        Vmcs::write (Vmcs::Encoding::BITMAP_EOI2, 0);
+        Vmcs::write (Vmcs::Encoding::BITMAP_EOI3, 0);
+        Vmcs::write (Vmcs::Encoding::GUEST_INT_STATUS, 0);
+    }
+
+    // An allocation failure of the virtual-APIC page or the posted-interrupt descriptor fails the creation of the vCPU
+    if (Vmcs::has_pi() && regs.vapic && (regs.pid = new Pi_desc (Cpu::apic_id[c]))) {
+        Vmcs::write (Vmcs::Encoding::POSTED_INT_NOTIFICATION, VEC_IPI + Interrupt::Request::PIN);
+        Vmcs::write (Vmcs::Encoding::POSTED_INT_DESC_ADDR, Kmem::ptr_to_phys (regs.pid));
+    }
+
+    // Without the segment cache, all segment state is transferred
+    regs.cache = new Vmcs_cache;
+
+    // The dirty summary requires a page-modification log in every vCPU
+    if (Ept::pml && (regs.pml = static_cast<uint64 *>(Buddy::alloc (0)))) {
+        Vmcs::write (Vmcs::Encoding::PML_ADDRESS, Kmem::ptr_to_phys (regs.pml));
+        Vmcs::write (Vmcs::Encoding::PML_INDEX, Vmcs::pml_entries - 1);
+    }
+
     exc_regs().offset_tsc = 0;
     exc_regs().intcpt_cr0 = 0;
     exc_regs().intcpt_cr4 = 0;
@@ -95,15 +130,14 @@ Ec_arch::Ec_arch (Space_obj *obj, Space_hst *hst, Fpu *f, Vmcs *v, unsigned c, u
 
 // Constructor: Virtual CPU (SVM)
 template <>
-Ec_arch::Ec_arch (Space_obj *obj, Space_hst *hst, Fpu *f, Vmcb *v, unsigned c, unsigned long e, bool t) : Ec (obj, hst, f, v, c, e, t, send_msg<ret_user_vmexit_svm>)
+Ec_arch::Ec_arch (Space_obj *obj, Space_hst *hst, Fpu *f, Vmcb *v, unsigned c, unsigned long e, bool t, uintptr_t) : Ec (obj, hst, f, v, c, e, t, send_msg<ret_user_vmexit_svm>)
 {
     assert (obj && hst && v);
 
     trace (TRACE_CREATE, "EC:%p created (OBJ:%p HST:%p CPU:%u VMCB:%p %c)", static_cast<void *>(this), static_cast<void *>(obj), static_cast<void *>(hst), c, static_cast<void *>(v), subtype == Kobject::Subtype::EC_VCPU_REAL  ? 'R' : 'O');
 
-#if 0   // FIXME
-    regs.rax = Kmem::ptr_to_phys (regs.vmcb = new Vmcb (pd->Space_pio::walk(), pd->npt.init_root (false)));
-#endif
+    // VMLOAD, VMRUN and VMSAVE take the VMCB from RAX, while the guest RAX lives in the VMCB
+    exc_regs().sys.rax = Kmem::ptr_to_phys (v);
 
     exc_regs().offset_tsc = 0;
     exc_regs().intcpt_cr0 = 0;
@@ -118,8 +152,36 @@ Ec_arch::Ec_arch (Space_obj *obj, Space_hst *hst, Fpu *f, Vmcb *v, unsigned c, u
     exc_regs().set_ep (Event::gst_arch + Event::Selector::STARTUP);
 }
 
+// Destructor
+Ec_arch::~Ec_arch()
+{
+    if (is_vcpu()) {
+
+        if (Hip::feature (Hip_arch::Feature::VMX)) {
+            regs.vmcs->clear();
+            delete regs.vmcs;
+            delete regs.pid;
+            delete regs.exits;
+            delete regs.cache;
+
+            if (regs.pml)
+                Buddy::free (regs.pml);
+        } else
+            delete regs.vmcb;
+    }
+
+    if (regs.gst)
+        regs.gst->del_ref();
+
+    if (regs.pio)
+        regs.pio->del_ref();
+
+    if (regs.msr)
+        regs.msr->del_ref();
+}
+
 // Factory: Virtual CPU
-Ec *Ec::create (Status &s, Pd *pd, bool fpu, unsigned c, unsigned long e, bool t)
+Ec *Ec::create (Status &s, Pd *pd, bool fpu, unsigned c, unsigned long e, bool t, uintptr_t a)
 {
     auto const has_vmx { Hip::feature (Hip_arch::Feature::VMX) };
     auto const has_svm { Hip::feature (Hip_arch::Feature::SVM) };
@@ -132,32 +194,43 @@ Ec *Ec::create (Status &s, Pd *pd, bool fpu, unsigned c, unsigned long e, bool t
     auto const obj { pd->get_obj() };
     auto const hst { pd->get_hst() };
 
-    if (EXPECT_FALSE (!obj || !hst)) {
+    if (EXPECT_FALSE (!obj || !hst || !acquire_spaces (obj, hst, nullptr))) {
         s = Status::ABORTED;
         return nullptr;
     }
 
-    // FIXME: Refcount updates
-
     auto const f { fpu ? new (pd->fpu_cache) Fpu : nullptr };
     Ec *ec;
 
     if (has_vmx) {
         auto const v { new Vmcs };
-        if (EXPECT_TRUE ((!fpu || f) && v && (ec = new (cache) Ec_arch (obj, hst, f, v, c, e, t))))
-            return ec;
+        if (EXPECT_TRUE ((!fpu || f) && v && (ec = new (cache) Ec_arch (obj, hst, f, v, c, e, t, a)))) {
+
+            // A vCPU must have all features of the CPU, so that assign_int and the VMM can rely on them
+            if (EXPECT_TRUE ((!Vmcs::has_tpr() || ec->regs.vapic) && (!Vmcs::has_tpr() || !Vmcs::has_pi() || ec->regs.pid) && (!Ept::pml || ec->regs.pml)))
+                return ec;
+
+            // The destructor releases the VMCS, the FPU and the spaces
+            ec->destroy();
+
+            s = Status::INS_MEM;
+
+            return nullptr;
+        }
         delete v;
     }
 
     if (has_svm) {
         auto const v { new Vmcb };
-        if (EXPECT_TRUE ((!fpu || f) && v && (ec = new (cache) Ec_arch (obj, hst, f, v, c, e, t))))
+        if (EXPECT_TRUE ((!fpu || f) && v && (ec = new (cache) Ec_arch (obj, hst, f, v, c, e, t, a))))
             return ec;
         delete v;
     }
 
     Fpu::operator delete (f, pd->fpu_cache);
 
+    release_spaces (obj, hst, nullptr);
+
     s = Status::INS_MEM;
 
     return nullptr;
@@ -224,13 +297,20 @@ void Ec::handle_hazard (unsigned h, cont_t func)
         if (func == Ec_arch::ret_user_vmexit_vmx) {
             regs.vmcs->make_current();
             Vmcs::write (Vmcs::Encoding::TSC_OFFSET, regs.exc.offset_tsc);
-        } else
+        } else {
             regs.vmcb->tsc_offset = regs.exc.offset_tsc;
+            regs.vmcb->modify (Vmcb::CLEAN_I);
+        }
     }
 
     if (EXPECT_FALSE (h & Hazard::FPU))
         Cpu::hazard & Hazard::FPU ? Fpu::disable() : Fpu::enable();
 
+    if (EXPECT_FALSE (h & Hazard::MSR)) {
+        Cpu::hazard &= ~Hazard::MSR;
+        Cpu::State::make_current (Cpu::gstate, Cpu::hstate);    // Restore CPU host state
+    }
+
     if (EXPECT_FALSE (h & Hazard::BOOT_HST)) {
         Cpu::hazard &= ~Hazard::BOOT_HST;
         trace (TRACE_PERF, "TIME: First HEC: %llums", Stc::ticks_to_ms (Timer::time() - *reinterpret_cast<uintptr_t *>(Kmem::sym_to_virt (&__boot_ts))));
@@ -244,7 +324,7 @@ void Ec::handle_hazard (unsigned h, cont_t func)
 
 void Ec_arch::ret_user_hypercall (Ec *const self)
 {
-    auto const h { (Cpu::hazard ^ self->regs.hazard) & (Hazard::ILLEGAL | Hazard::RECALL | Hazard::FPU | Hazard::BOOT_HST | Hazard::RCU | Hazard::SLEEP | Hazard::SCHED) };
+    auto const h { (Cpu::hazard ^ self->regs.hazard) & (Hazard::ILLEGAL | Hazard::RECALL | Hazard::FPU | Hazard::MSR | Hazard::BOOT_HST | Hazard::RCU | Hazard::SLEEP | Hazard::SCHED) };
     if (EXPECT_FALSE (h))
         self->handle_hazard (h, ret_user_hypercall);
 
@@ -257,7 +337,7 @@ void Ec_arch::ret_user_hypercall (Ec *const self)
 
 void Ec_arch::ret_user_exception (Ec *const self)
 {
-    auto const h { (Cpu::hazard ^ self->regs.hazard) & (Hazard::ILLEGAL | Hazard::RECALL | Hazard::FPU | Hazard::BOOT_HST | Hazard::RCU | Hazard::SLEEP | Hazard::SCHED) };
+    auto const h { (Cpu::hazard ^ self->regs.hazard) & (Hazard::ILLEGAL | Hazard::RECALL | Hazard::FPU | Hazard::MSR | Hazard::BOOT_HST | Hazard::RCU | Hazard::SLEEP | Hazard::SCHED) };
     if (EXPECT_FALSE (h))
         self->handle_hazard (h, ret_user_exception);
 
@@ -276,19 +356,46 @@ void Ec_arch::ret_user_vmexit_vmx (Ec *const self)
 
     self->regs.vmcs->make_current();
 
+    // VPIDs and PCIDs are recycled per CPU, so refresh the VMCS if either of them changed
+    if (Vmcs::has_vpid() && EXPECT_FALSE (!self->regs.vpid.get()))
+        Vmcs::write (Vmcs::Encoding::VPID, self->regs.vpid.alloc());
+
+    auto const pcid { self->get_hst()->get_pcid() };
+
+    if (EXPECT_FALSE (self->regs.pcid != pcid))
+        Vmcs::write (Vmcs::Encoding::HOST_CR3, (Vmcs::read<uintptr_t> (Vmcs::Encoding::HOST_CR3) & ~BIT_RANGE (11, 0)) | (self->regs.pcid = pcid));
+
     auto const gst { self->get_gst() };
 
-    if (EXPECT_FALSE (gst->gtlb.tst (Cpu::id))) {
-        gst->gtlb.clr (Cpu::id);
+    if (EXPECT_FALSE (gst->stale()))
         gst->invalidate();
+
+    // Move interrupts that were posted outside guest mode into the virtual IRR and raise RVI
+    if (self->regs.pid && self->regs.pid->enter()) {
+
+        auto const vec { self->regs.pid->harvest (self->regs.vapic) };
+        auto const sts { Vmcs::read<uint16> (Vmcs::Encoding::GUEST_INT_STATUS) };
+
+        if (vec > (sts & BIT_RANGE (7, 0)))
+            Vmcs::write (Vmcs::Encoding::GUEST_INT_STATUS, (sts & ~BIT_RANGE (7, 0)) | vec);
     }
 
     if (EXPECT_FALSE (Cr::get_cr2() != self->exc_regs().cr2))
         Cr::set_cr2 (self->exc_regs().cr2);
 
-    Cpu::State::make_current (Cpu::hstate, self->regs.cpu);     // Restore CPU guest state
+    // After an exit that did not leave the kernel, the MSRs still hold the state of this or another vCPU
+    Cpu::State::make_current (Cpu::hazard & Hazard::MSR ? Cpu::gstate : Cpu::hstate, self->regs.cpu);   // Restore CPU guest state
+    Cpu::gstate  = self->regs.cpu;
+    Cpu::hazard |= Hazard::MSR;
+
     Fpu::State::make_current (Fpu::hstate, self->regs.fpu);     // Restore FPU guest state
 
+    // The guest can change its segment state from now on
+    if (self->regs.cache)
+        self->regs.cache->valid = 0;
+
+    Rcu::eqs_enter();
+
     asm volatile ("lea %0, %%rsp;"
                   EXPAND (LOAD_GPR)
                   "vmresume;"
@@ -306,15 +413,28 @@ void Ec_arch::ret_user_vmexit_svm (Ec *const self)
     if (EXPECT_FALSE (h))
         self->handle_hazard (h, ret_user_vmexit_svm);
 
-    auto const gst { self->get_gst() };
+    auto const vmcb { self->regs.vmcb };
 
-    if (EXPECT_FALSE (gst->gtlb.tst (Cpu::id))) {
-        gst->gtlb.clr (Cpu::id);
-        self->regs.vmcb->tlb_control = 1;
+    // ASIDs are recycled per CPU, so refresh the VMCB if the vCPU has no ASID in the current generation
+    if (EXPECT_FALSE (!self->regs.asid.get())) {
+
+        bool flush { false };
+
+        vmcb->asid = self->regs.asid.alloc (flush);
+        vmcb->modify (Vmcb::CLEAN_ASID);
+
+        if (EXPECT_FALSE (flush))
+            vmcb->flush (Vmcb::TLB_ALL);
     }
 
+    // Other vCPUs of the space on this CPU use other ASIDs, so flushing the translations of the space flushes all ASIDs
+    if (EXPECT_FALSE (self->get_gst()->stale()))
+        vmcb->flush (Vmcb::TLB_ALL);
+
     Fpu::State::make_current (Fpu::hstate, self->regs.fpu);     // Restore FPU guest state
 
+    Rcu::eqs_enter();
+
     asm volatile ("lea %0, %%rsp;"
                   EXPAND (LOAD_GPR)
                   "clgi;"
@@ -51,13 +51,19 @@ void Ec_arch::svm_exception (mword reason)
 
 void Ec_arch::handle_svm()
 {
+    Rcu::eqs_exit();
+
     Ec *const self = current;
 
     Fpu::State::make_current (self->regs.fpu, Fpu::hstate);     // Restore FPU host state
 
-    self->regs.vmcb->tlb_control = 0;
+    auto const vmcb { self->regs.vmcb };
+
+    // VMRUN cached the guest state, unless it failed
+    vmcb->tlb_control = Vmcb::TLB_NONE;
+    vmcb->clean       = (Vmcb::has_clean() && vmcb->exitcode != ~0ULL) * Vmcb::CLEAN_ALL;
 
-    mword reason = static_cast<mword>(self->regs.vmcb->exitcode);
+    mword reason = static_cast<mword>(vmcb->exitcode);
 
     switch (reason) {
         case -1UL:              // Invalid state
@@ -21,8 +21,12 @@
 
 #include "counter.hpp"
 #include "ec_arch.hpp"
+#include "exit_policy.hpp"
 #include "interrupt.hpp"
+#include "pi_desc.hpp"
+#include "space_gst.hpp"
 #include "stdio.hpp"
+#include "timer.hpp"
 #include "vmx.hpp"
 
 void Ec_arch::vmx_exception()
@@ -66,18 +70,209 @@ void Ec_arch::vmx_extint()
     ret_user_vmexit_vmx (this);
 }
 
+/*
+ * Determine if the vCPU has an interrupt pending that ends HLT
+ *
+ * @return      true if an interrupt was posted or RVI has a higher priority class than VPPR
+ */
+bool Ec_arch::vmx_pending() const
+{
+    if (regs.pid && regs.pid->pending())
+        return true;
+
+    if (!regs.vapic || !Vmcs::has_vint())
+        return false;
+
+    auto const rvi  { Vmcs::read<uint16> (Vmcs::Encoding::GUEST_INT_STATUS) & BIT_RANGE (7, 4) };
+    auto const vppr { regs.vapic[0xa0 / sizeof (*regs.vapic)]            & BIT_RANGE (7, 4) };
+
+    return rvi > vppr;
+}
+
+/*
+ * Poll for an interrupt that ends HLT, so that a wakeup soon after HLT avoids the round trip through the VMM
+ *
+ * Polling stops early if the VMM recalls the vCPU or if the CPU must schedule or sleep.
+ * Only interrupts posted into the vCPU end the poll, so the vCPU must have a posted-interrupt descriptor.
+ *
+ * @return      true if an interrupt arrived within the poll window, false otherwise
+ */
+bool Ec_arch::vmx_poll()
+{
+    auto const p { regs.exits };
+    auto const d { Timer::time() + Stc::us_to_ticks (p->poll_window()) };
+
+    // Interrupts posted while polling must not wake the VMM
+    regs.pid->suppress (true);
+
+    bool t { false };
+
+    // Interrupts are enabled while polling, so that the CPU notices scheduling requests
+    while (!vmx_pending() && !(Cpu::hazard & (Hazard::SLEEP | Hazard::SCHED)) && !(regs.hazard & Hazard::RECALL) && !(t = Timer::time() >= d)) {
+        Cpu::preemption_point();
+        pause();
+    }
+
+    // An interrupt posted after the last check ends HLT as well, because its notification was suppressed
+    auto const h { regs.pid->suppress (false) || vmx_pending() };
+
+    // Only timeouts are misses, polls that ended early say nothing about the window
+    if (h || t)
+        p->poll_adapt (h);
+
+    return h;
+}
+
+/*
+ * Complete a VM exit in the kernel if the exit policy of the vCPU covers it
+ *
+ * @param reason    Basic exit reason
+ * @return          true if the exit was completed, false if it must go to the VMM
+ */
+bool Ec_arch::vmx_policy (unsigned reason)
+{
+    auto const p { regs.exits };
+    auto &s { exc_regs().sys };
+
+    auto const rfl { Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_RFLAGS) };
+
+    // Single-stepping requires a #DB after the instruction, which the VMM must inject
+    if (rfl & RFL_TF)
+        return false;
+
+    switch (reason) {
+
+        case Vmcs::VMX_CPUID:
+            if (auto const e { p->enabled (Exit_policy::CPUID) ? p->lookup_cpuid (static_cast<uint32>(s.rax), static_cast<uint32>(s.rcx)) : nullptr }; e) {
+                s.rax = e->eax;
+                s.rbx = e->ebx;
+                s.rcx = e->ecx;
+                s.rdx = e->edx;
+                break;
+            }
+            return false;
+
+        case Vmcs::VMX_RDTSCP: {
+            auto const e { p->enabled (Exit_policy::RDTSC) ? p->lookup_msr (std::to_underlying (Msr::Register::IA32_TSC_AUX), Exit_policy::Msr::R) : nullptr };
+            if (!e)
+                return false;
+            s.rcx = static_cast<uint32>(e->value);
+        }
+            [[fallthrough]];
+
+        case Vmcs::VMX_RDTSC:
+            if (p->enabled (Exit_policy::RDTSC)) {
+                auto const tsc { Timer::time() + exc_regs().offset_tsc };
+                s.rax = static_cast<uint32>(tsc);
+                s.rdx = static_cast<uint32>(tsc >> 32);
+                break;
+            }
+            return false;
+
+        case Vmcs::VMX_XSETBV:
+            if (auto const v { static_cast<uint64>(s.rdx) << 32 | static_cast<uint32>(s.rax) }; p->enabled (Exit_policy::XSETBV) && !static_cast<uint32>(s.rcx) && Fpu::State::constrain_xcr (v) == v) {
+                regs.fpu.xcr = v;
+                break;
+            }
+            return false;
+
+        case Vmcs::VMX_RDMSR:
+            if (auto const e { p->enabled (Exit_policy::MSR) ? p->lookup_msr (static_cast<uint32>(s.rcx), Exit_policy::Msr::R) : nullptr }; e) {
+                s.rax = static_cast<uint32>(e->value);
+                s.rdx = static_cast<uint32>(e->value >> 32);
+                break;
+            }
+            return false;
+
+        case Vmcs::VMX_WRMSR:
+            if (auto const e { p->enabled (Exit_policy::MSR) ? p->lookup_msr (static_cast<uint32>(s.rcx), Exit_policy::Msr::W) : nullptr }; e) {
+                e->value = static_cast<uint64>(s.rdx) << 32 | static_cast<uint32>(s.rax);
+                break;
+            }
+            return false;
+
+        case Vmcs::VMX_HLT:
+            if (p->enabled (Exit_policy::HLT) && rfl & RFL_IF && (vmx_pending() || (p->enabled (Exit_policy::POLL) && regs.pid && vmx_poll())))
+                break;
+            return false;
+
+        default:
+            return false;
+    }
+
+    Vmcs::write (Vmcs::Encoding::GUEST_RIP, Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_RIP) + Vmcs::read<uint32> (Vmcs::Encoding::EXI_INST_LEN));
+
+    // Completing the instruction ends blocking by STI and by MOV SS
+    if (auto const sta { Vmcs::read<uint32> (Vmcs::Encoding::GUEST_INTR_STATE) }; sta & BIT_RANGE (1, 0))
+        Vmcs::write (Vmcs::Encoding::GUEST_INTR_STATE, sta & ~BIT_RANGE (1, 0));
+
+    return true;
+}
+
+/*
+ * Drain the page-modification log into the dirty summary of the guest space
+ */
+void Ec_arch::vmx_pml()
+{
+    auto const idx { Vmcs::read<uint16> (Vmcs::Encoding::PML_INDEX) };
+
+    if (EXPECT_TRUE (idx == Vmcs::pml_entries - 1))
+        return;
+
+    auto const gst { get_gst() };
+
+    // The index wraps around below 0 when the log is full
+    for (unsigned i { idx < Vmcs::pml_entries ? idx + 1U : 0 }; i < Vmcs::pml_entries; i++)
+        gst->mark (regs.pml[i]);
+
+    Vmcs::write (Vmcs::Encoding::PML_INDEX, Vmcs::pml_entries - 1);
+}
+
+/*
+ * Restore write access after a guest write to a page that is write-protected for dirty logging
+ *
+ * @return      true if the guest can retry the write, false if the EPT violation must go to the VMM
+ */
+bool Ec_arch::vmx_unprotect()
+{
+    // An event whose delivery caused the EPT violation would have to be reinjected
+    if (Ept::ad || !(Vmcs::read<uint64> (Vmcs::Encoding::EXI_QUALIFICATION) & BIT (1)) || Vmcs::read<uint32> (Vmcs::Encoding::ORG_EVENT_IDENT) & BIT (31))
+        return false;
+
+    return get_gst()->unprotect (Vmcs::read<uint64> (Vmcs::Encoding::GUEST_PHYSICAL_ADDRESS));
+}
+
+/*
+ * Restore blocking by NMI if the exit occurred during an IRET that unblocked NMIs
+ */
+void Ec_arch::vmx_reblock_nmi() const
+{
+    if (Vmcs::read<uint64> (Vmcs::Encoding::EXI_QUALIFICATION) & BIT (12))
+        Vmcs::write (Vmcs::Encoding::GUEST_INTR_STATE, Vmcs::read<uint32> (Vmcs::Encoding::GUEST_INTR_STATE) | BIT (3));
+}
+
 void Ec_arch::handle_vmx()
 {
+    Rcu::eqs_exit();
+
     Ec *const self { current };
 
+    // Notifications now reach the kernel, which must handle any that were sent to guest mode in vain
+    if (self->regs.pid && EXPECT_FALSE (self->regs.pid->leave()))
+        Interrupt::pin_handler (self);
+
     // IA32_KERNEL_GS_BASE can change without VM exit due to SWAPGS
-    self->regs.cpu.kernel_gs_base = Msr::read (Msr::Register::IA32_KERNEL_GS_BASE);
+    Cpu::gstate.kernel_gs_base = self->regs.cpu.kernel_gs_base = Msr::read (Msr::Register::IA32_KERNEL_GS_BASE);
 
-    Cpu::State::make_current (self->regs.cpu, Cpu::hstate);     // Restore CPU host state
+    // The CPU host state is only needed in host mode, so Hazard::MSR restores it on the way there
     Fpu::State::make_current (self->regs.fpu, Fpu::hstate);     // Restore FPU host state
 
     Cpu::hazard = (Cpu::hazard | Hazard::TR) & ~Hazard::FPU;
 
+    // The log is drained on every exit, so that the IPI of a TLB shootdown drains it as well
+    if (self->regs.pml)
+        static_cast<Ec_arch *>(self)->vmx_pml();
+
     auto reason { Vmcs::read<uint32> (Vmcs::Encoding::EXI_REASON) & BIT_RANGE (7, 0) };
 
     switch (reason) {
@@ -85,6 +280,16 @@ void Ec_arch::handle_vmx()
         case Vmcs::VMX_EXTINT:      static_cast<Ec_arch *>(self)->vmx_extint();
     }
 
+    // Exits for dirty logging do not reach the VMM
+    if (reason == Vmcs::VMX_PML_FULL || (reason == Vmcs::VMX_EPT_VIOLATION && static_cast<Ec_arch *>(self)->vmx_unprotect())) {
+        static_cast<Ec_arch *>(self)->vmx_reblock_nmi();
+        ret_user_vmexit_vmx (self);
+    }
+
+    // Exits covered by the exit policy do not reach the VMM
+    if (self->regs.exits && static_cast<Ec_arch *>(self)->vmx_policy (reason))
+        ret_user_vmexit_vmx (self);
+
     self->exc_regs().set_ep (reason);
 
     send_msg<ret_user_vmexit_vmx> (self);
@@ -92,9 +297,10 @@ void Ec_arch::handle_vmx()
 
 void Ec_arch::failed_vmx()
 {
+    Rcu::eqs_exit();
+
     Ec *const self { current };
 
-    Cpu::State::make_current (self->regs.cpu, Cpu::hstate);     // Restore CPU host state
     Fpu::State::make_current (self->regs.fpu, Fpu::hstate);     // Restore FPU host state
 
     trace (TRACE_ERROR, "VM entry failed with error %#x", Vmcs::read<uint32> (Vmcs::Encoding::VMX_INST_ERROR));
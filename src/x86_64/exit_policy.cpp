@@ -0,0 +1,22 @@
+/*
+ * VM Exit Policy
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+
+#include "exit_policy.hpp"
+
+INIT_PRIORITY (PRIO_SLAB)
+Slab_cache Exit_policy::cache (sizeof (Exit_policy), alignof (Exit_policy));
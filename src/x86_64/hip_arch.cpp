@@ -0,0 +1,100 @@
+/*
+ * Hypervisor Information Page (HIP): Architecture-Specific Part (x86)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "buddy.hpp"
+#include "hip_arch.hpp"
+#include "kmem.hpp"
+#include "mtd_arch.hpp"
+#include "vmx.hpp"
+
+/*
+ * Recommended MTD for a VMX exit portal
+ *
+ * The MTD covers the state a VMM typically needs to handle the exit. Each
+ * item that is not transferred saves VMCS accesses on both the exit and the
+ * reply path. VMMs are free to request more state.
+ *
+ * @param r     Basic exit reason
+ * @return      Recommended MTD
+ */
+static constexpr uint32 recommended_vmx (unsigned r)
+{
+    constexpr uint32 ins { Mtd_arch::GPR_0_7 | Mtd_arch::RIP };
+    constexpr uint32 evt { Mtd_arch::RFLAGS | Mtd_arch::STA | Mtd_arch::INJ };
+    constexpr uint32 emu { Mtd_arch::GPR_0_7 | Mtd_arch::GPR_8_15 | Mtd_arch::RFLAGS | Mtd_arch::RIP | Mtd_arch::STA | Mtd_arch::QUAL | Mtd_arch::INJ |
+                           Mtd_arch::CS_SS | Mtd_arch::DS_ES | Mtd_arch::CR | Mtd_arch::EFER };
+
+    switch (r) {
+
+        case Vmcs::VMX_CPUID:
+        case Vmcs::VMX_RDTSC:
+        case Vmcs::VMX_RDTSCP:
+        case Vmcs::VMX_RDPMC:
+        case Vmcs::VMX_RDMSR:
+        case Vmcs::VMX_WRMSR:
+        case Vmcs::VMX_VMCALL:
+            return ins;
+
+        case Vmcs::VMX_XSETBV:
+            return ins | Mtd_arch::XSAVE;
+
+        case Vmcs::VMX_INTR_WINDOW:
+        case Vmcs::VMX_NMI_WINDOW:
+            return evt;
+
+        case Vmcs::VMX_HLT:
+        case Vmcs::VMX_MWAIT:
+            return evt | Mtd_arch::RIP;
+
+        case Vmcs::VMX_INVD:
+        case Vmcs::VMX_WBINVD:
+        case Vmcs::VMX_MONITOR:
+        case Vmcs::VMX_PAUSE:
+            return Mtd_arch::RIP;
+
+        case Vmcs::VMX_INVLPG:
+            return Mtd_arch::RIP | Mtd_arch::QUAL;
+
+        case Vmcs::VMX_INIT:
+        case Vmcs::VMX_SIPI:
+            return Mtd_arch::STA | Mtd_arch::QUAL;
+
+        case Vmcs::VMX_MTF:
+            return Mtd_arch::RIP | Mtd_arch::STA;
+
+        case Vmcs::VMX_TPR_THRESHOLD:
+            return Mtd_arch::TPR;
+
+        case Vmcs::VMX_IO:
+            return ins | Mtd_arch::RFLAGS | Mtd_arch::STA | Mtd_arch::QUAL;
+
+        case Vmcs::VMX_CR:
+            return Mtd_arch::GPR_0_7 | Mtd_arch::GPR_8_15 | Mtd_arch::RIP | Mtd_arch::STA | Mtd_arch::QUAL | Mtd_arch::CR | Mtd_arch::EFER;
+
+        case Vmcs::VMX_DR:
+            return Mtd_arch::GPR_0_7 | Mtd_arch::GPR_8_15 | Mtd_arch::RIP | Mtd_arch::QUAL | Mtd_arch::DR;
+
+        default:
+            return emu;
+    }
+}
+
+void Hip_arch::build()
+{
+    for (unsigned i { 0 }; i < sizeof (mtd_vmx) / sizeof (*mtd_vmx); i++)
+        mtd_vmx[i] = recommended_vmx (i);
+}
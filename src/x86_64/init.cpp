@@ -26,6 +26,7 @@
 #include "ioapic.hpp"
 #include "interrupt.hpp"
 #include "kmem.hpp"
+#include "lapic.hpp"
 #include "patch.hpp"
 #include "pic.hpp"
 #include "smmu.hpp"
@@ -92,6 +93,8 @@ void init (uintptr_t offset)
 
     Acpi::init();
 
+    Lapic::setup();
+
     Pic::init();
 
     Ioapic::init_all();
@@ -21,15 +21,19 @@
 
 #include "acpi.hpp"
 #include "counter.hpp"
+#include "ec.hpp"
 #include "idt.hpp"
 #include "interrupt.hpp"
 #include "ioapic.hpp"
 #include "lapic.hpp"
+#include "lock_guard.hpp"
+#include "pi_desc.hpp"
 #include "sm.hpp"
 #include "smmu.hpp"
 #include "space_hst.hpp"
 #include "space_obj.hpp"
 #include "stdio.hpp"
+#include "tlb.hpp"
 #include "vectors.hpp"
 
 Interrupt Interrupt::int_table[NUM_GSI];
@@ -58,10 +62,108 @@ void Interrupt::rke_handler()
     if (Acpi::get_transition().state())
         Cpu::hazard |= Hazard::SLEEP;
 
+    Tlb::handle_rke();
+
+    Rcu::update();
+
     if (Space_hst::current->htlb.tst (Cpu::id))
         Cpu::hazard |= Hazard::SCHED;
 }
 
+/*
+ * Add an interrupt to the interrupts posted into a vCPU
+ *
+ * Must be called with pst_lock held.
+ *
+ * @param i     Interrupt
+ * @param vcpu  vCPU
+ */
+void Interrupt::link (Interrupt *i, Ec *vcpu)
+{
+    if (!vcpu->regs.pst) {
+        vcpu->regs.pst_nxt = pst_vcpu[vcpu->cpu];
+        pst_vcpu[vcpu->cpu] = vcpu;
+    }
+
+    i->pst = vcpu->regs.pst;
+    vcpu->regs.pst = i;
+}
+
+/*
+ * Remove an interrupt from the interrupts posted into a vCPU
+ *
+ * Must be called with pst_lock held.
+ *
+ * @param i     Interrupt
+ * @param vcpu  vCPU
+ */
+void Interrupt::unlink (Interrupt *i, Ec *vcpu)
+{
+    for (auto p { &vcpu->regs.pst }; *p; p = &(*p)->pst)
+        if (*p == i) {
+            *p = i->pst;
+            break;
+        }
+
+    i->pst = nullptr;
+
+    if (vcpu->regs.pst)
+        return;
+
+    for (auto p { &pst_vcpu[vcpu->cpu] }; *p; p = &(*p)->regs.pst_nxt)
+        if (*p == vcpu) {
+            *p = vcpu->regs.pst_nxt;
+            break;
+        }
+}
+
+/*
+ * Signal the semaphores of the interrupts that were posted into a vCPU
+ *
+ * Must be called with pst_lock held. A vCPU that polls for interrupts with
+ * notifications suppressed is about to consume them itself.
+ *
+ * @param vcpu  vCPU
+ */
+void Interrupt::signal (Ec const *vcpu)
+{
+    auto const pid { vcpu->regs.pid };
+
+    if (!pid->pending() || pid->suppressed())
+        return;
+
+    for (auto i { vcpu->regs.pst }; i; i = i->pst)
+        if (pid->requested (i->vec))
+            i->sm->up();
+}
+
+/*
+ * Handle a posted-interrupt notification that arrived outside guest mode
+ *
+ * The vCPU that the notification was meant for is not in guest mode and may
+ * be blocked in its VMM, so signal the semaphores of the interrupts that are
+ * pending in the vCPUs on this CPU.
+ */
+void Interrupt::pin_handler()
+{
+    Lock_guard <Spinlock> guard (pst_lock);
+
+    for (auto v { pst_vcpu[Cpu::id] }; v; v = v->regs.pst_nxt)
+        signal (v);
+}
+
+/*
+ * Handle posted-interrupt notifications that a vCPU received in vain while leaving guest mode
+ *
+ * @param vcpu  vCPU
+ */
+void Interrupt::pin_handler (Ec const *vcpu)
+{
+    Lock_guard <Spinlock> guard (pst_lock);
+
+    signal (vcpu);
+}
+
 void Interrupt::handle_ipi (unsigned ipi)
 {
     assert (ipi < NUM_IPI);
@@ -71,6 +173,8 @@ void Interrupt::handle_ipi (unsigned ipi)
     switch (ipi) {
         case Request::RRQ: Scheduler::requeue(); break;
         case Request::RKE: rke_handler(); break;
+        case Request::PIN:
+        case Request::PIW: pin_handler(); break;
     }
 }
 
@@ -94,11 +198,28 @@ void Interrupt::handle_gsi (unsigned gsi)
 
     set_mask (gsi, true);
 
-    int_table[gsi].sm->up();
+    // Post into the vCPU and notify its CPU unless a notification is already outstanding
+    {   Lock_guard <Spinlock> guard (int_table[gsi].lock);
+
+        if (auto const vcpu { int_table[gsi].vcpu.load() }; vcpu) {
+
+            if (auto const nv { vcpu->regs.pid->post (int_table[gsi].vec) }; nv)
+                Lapic::send_cpu (nv, vcpu->cpu);
+
+            return;
+        }
+    }
+
+    if (int_table[gsi].mod.moderated())
+        int_table[gsi].mod.arrival();
+    else
+        int_table[gsi].sm->up();
 }
 
 void Interrupt::handler (unsigned v)
 {
+    Rcu::eqs_exit();
+
     if (v >= VEC_FLT)
         Smmu::interrupt();
 
@@ -114,7 +235,7 @@ void Interrupt::handler (unsigned v)
     Lapic::eoi();
 }
 
-void Interrupt::init (unsigned gsi, uint32 &msi_addr, uint16 &msi_data)
+void Interrupt::init (unsigned gsi, uint64 &msi_addr, uint16 &msi_data)
 {
     Config cfg  = int_table[gsi].config;
     auto ioapic = int_table[gsi].ioapic;
@@ -123,7 +244,11 @@ void Interrupt::init (unsigned gsi, uint32 &msi_addr, uint16 &msi_data)
     auto aid = Cpu::apic_id[cfg.cpu()];
     auto vec = static_cast<uint8>(VEC_GSI + gsi);
 
-    Smmu::set_irt (gsi, rid, aid, vec, cfg.trg());
+    // With posted-interrupt support in the SMMU, interrupts for a vCPU bypass the kernel
+    if (auto const vcpu { int_table[gsi].vcpu.load() }; vcpu && Smmu::pi)
+        Smmu::set_irt (gsi, rid, Kmem::ptr_to_phys (vcpu->regs.pid), int_table[gsi].vec);
+    else
+        Smmu::set_irt (gsi, rid, aid, vec, cfg.trg());
 
     /* MSI Compatibility Format
      * ADDR: 0xfee[31:20] APICID[19:12] ---[11:5] 0[4] RH[3] DM[2] --[1:0]
@@ -157,13 +282,52 @@ void Interrupt::init (unsigned gsi, uint32 &msi_addr, uint16 &msi_data)
     }
 }
 
-void Interrupt::configure (unsigned gsi, Config cfg, uint32 &msi_addr, uint16 &msi_data)
+Status Interrupt::configure (unsigned gsi, Config cfg, uint64 mod, Ec *vcpu, uint16 vec, uint64 &msi_addr, uint16 &msi_data)
 {
-    trace (TRACE_INTR, "INTR: %s: %u cpu=%u %c%c%c", __func__, gsi, cfg.cpu(), cfg.msk() ? 'M' : 'U', cfg.trg() ? 'L' : 'E', cfg.pol() ? 'L' : 'H');
+    // Only edge-triggered interrupts can be posted and only into a vCPU with a posted-interrupt descriptor
+    if (EXPECT_FALSE (vcpu && (cfg.trg() || !vcpu->regs.pid)))
+        return Status::BAD_FTR;
+
+    // Level-triggered pins stay masked until the VMM unmasks them, so they cannot be moderated
+    if (EXPECT_FALSE (cfg.trg() && mod))
+        return Status::BAD_FTR;
+
+    if (EXPECT_FALSE (vec > BIT_RANGE (7, 0)))
+        return Status::BAD_PAR;
+
+    // Without interrupt remapping, IOAPIC and MSI destinations hold an 8-bit APIC ID
+    if (EXPECT_FALSE (!Smmu::ir && Cpu::apic_id[cfg.cpu()] >= BIT (8) - 1))
+        return Status::BAD_CPU;
+
+    trace (TRACE_INTR, "INTR: %s: %u cpu=%u %c%c%c mod=%#llx vcpu=%p vec=%u", __func__, gsi, cfg.cpu(), cfg.msk() ? 'M' : 'U', cfg.trg() ? 'L' : 'E', cfg.pol() ? 'L' : 'H', mod, static_cast<void *>(vcpu), vec);
 
     int_table[gsi].config = cfg;
+    int_table[gsi].mod.configure (int_table[gsi].sm, mod);
+    Ec *old;
+
+    {   Lock_guard <Spinlock> guard (pst_lock);
+
+        // The vector and the vCPU change together, so that the vector is never posted into another vCPU
+        {   Lock_guard <Spinlock> entry (int_table[gsi].lock);
+
+            int_table[gsi].vec = static_cast<uint8>(vec);
+            int_table[gsi].vcpu.exchange (old, vcpu);
+        }
+
+        if (old)
+            unlink (int_table + gsi, old);
+
+        if (vcpu)
+            link (int_table + gsi, vcpu);
+    }
+
+    // Release the reference to the vCPU the interrupt was previously posted into
+    if (old)
+        old->del_ref();
 
     init (gsi, msi_addr, msi_data);
+
+    return Status::SUCCESS;
 }
 
 void Interrupt::send_cpu (Request req, unsigned cpu)
@@ -171,6 +335,11 @@ void Interrupt::send_cpu (Request req, unsigned cpu)
     Lapic::send_cpu (VEC_IPI + req, cpu);
 }
 
+void Interrupt::send_set (Request req, Cpuset const &set)
+{
+    Lapic::send_set (VEC_IPI + req, set);
+}
+
 void Interrupt::send_exc (Request req)
 {
     Lapic::send_exc (VEC_IPI + req);
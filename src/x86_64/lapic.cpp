@@ -31,6 +31,21 @@
 #include "stdio.hpp"
 #include "vectors.hpp"
 
+/*
+ * Select xAPIC or x2APIC mode for all CPUs
+ *
+ * Must be called on the BSP before any interrupt destinations are programmed.
+ */
+void Lapic::setup()
+{
+    // CPU features are not enumerated yet
+    uint32 eax, ebx, ecx, edx;
+    Cpu::cpuid (0x1, eax, ebx, ecx, edx);
+
+    // Firmware may have enabled x2APIC mode already, which can only be left through a reset
+    x2apic = Msr::read (Msr::Register::IA32_APIC_BASE) & BIT (10) || (x2apic && ecx & BIT (21));
+}
+
 void Lapic::init (uint32 clk, uint32 rat)
 {
     auto const apic_base { Msr::read (Msr::Register::IA32_APIC_BASE) };
@@ -43,8 +58,12 @@ void Lapic::init (uint32 clk, uint32 rat)
         Hptp::current().update (MMAP_CPU_APIC, apic_base & ~OFFS_MASK, 0, Paging::Permissions (Paging::G | Paging::W | Paging::R), Memattr::Cacheability::MEM_UC, Memattr::Shareability::NONE);
     }
 
+    // x2APIC mode can only be entered from xAPIC mode
     Msr::write (Msr::Register::IA32_APIC_BASE, apic_base | BIT (11));
 
+    if (x2apic)
+        Msr::write (Msr::Register::IA32_APIC_BASE, apic_base | BIT (11) | BIT (10));
+
     auto const svr { read (Register32::SVR) };
     if (!(svr & BIT (8)))
         write (Register32::SVR, svr | BIT (8));
@@ -108,7 +127,49 @@ void Lapic::init (uint32 clk, uint32 rat)
     // Enforce ordering between the LVT MMIO write that enables TSC deadline mode and later WRMSRs to IA32_TSC_DEADLINE
     Barrier::fmb();
 
-    trace (TRACE_INTR, "APIC: %#010llx ID:%#x VER:%#x SUP:%u LVT:%#x (%s Mode)", apic_base & ~OFFS_MASK, id(), version(), eoi_sup(), lvt_max(), ratio ? "OS" : "DL");
+    trace (TRACE_INTR, "APIC: %#010llx ID:%#x VER:%#x SUP:%u LVT:%#x (%s Mode) %s", apic_base & ~OFFS_MASK, id(), version(), eoi_sup(), lvt_max(), ratio ? "OS" : "DL", x2apic ? "x2APIC" : "xAPIC");
+}
+
+/*
+ * Send an IPI to a set of CPUs
+ *
+ * In x2APIC mode, the logical destination of a CPU is its cluster (APIC ID 31:4) and
+ * a bit in the cluster (APIC ID 3:0). A single IPI in logical destination mode reaches
+ * all CPUs of a cluster in the set. In xAPIC mode, each CPU receives its own IPI.
+ *
+ * @param v     Vector
+ * @param s     Set of CPUs
+ */
+void Lapic::send_set (unsigned v, Cpuset const &s)
+{
+    if (!x2apic) {
+        for (unsigned c { 0 }; c < Cpu::count; c++)
+            if (s.tst (c))
+                send_cpu (v, c);
+        return;
+    }
+
+    Cpuset pending;
+    pending.set (s);
+
+    for (unsigned c { 0 }; c < Cpu::count; c++) {
+
+        if (!pending.tst (c))
+            continue;
+
+        auto const cluster { Cpu::apic_id[c] >> 4 };
+
+        uint32 msk { 0 };
+
+        for (unsigned i { c }; i < Cpu::count; i++) {
+            if (pending.tst (i) && Cpu::apic_id[i] >> 4 == cluster) {
+                msk |= BIT (Cpu::apic_id[i] & BIT_RANGE (3, 0));
+                pending.clr (i);
+            }
+        }
+
+        set_icr (static_cast<uint64>(cluster << 16 | msk) << 32 | BIT (14) | BIT (11) | v);
+    }
 }
 
 void Lapic::therm_handler() {}
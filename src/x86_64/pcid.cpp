@@ -0,0 +1,39 @@
+/*
+ * Process Context Identifier (PCID)
+ *
+ * Copyright (C) 2019-2021 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "cr.hpp"
+#include "pcid.hpp"
+#include "ptab_hpt.hpp"
+
+uint64 Pcid::gen { 0 };
+
+/*
+ * Flush the non-global translations of all PCIDs on the current CPU
+ *
+ * Without INVPCID, toggling CR4.PGE flushes all translations, including global ones.
+ */
+void Pcid::flush()
+{
+    if (Cpu::feature (Cpu::Feature::INVPCID))
+        Hptp::invalidate_pcids();
+
+    else {
+        auto const cr4 { Cr::get_cr4() };
+        Cr::set_cr4 (cr4 & ~CR4_PGE);
+        Cr::set_cr4 (cr4);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * Posted-Interrupt Descriptor (VMX, VT-d)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "bits.hpp"
+#include "interrupt.hpp"
+#include "lapic.hpp"
+#include "pi_desc.hpp"
+#include "vectors.hpp"
+
+INIT_PRIORITY (PRIO_SLAB)
+Slab_cache Pi_desc::cache (sizeof (Pi_desc), alignof (Pi_desc));
+
+/*
+ * Constructor
+ *
+ * @param aid   APIC ID of the CPU the vCPU runs on
+ */
+Pi_desc::Pi_desc (uint32 aid) : ctl (static_cast<uint64>(aid) << (Lapic::x2apic ? 32 : 40) | (VEC_IPI + Interrupt::Request::PIW) << 16) {}
+
+/*
+ * Switch the notification vector
+ *
+ * @param nv    New notification vector
+ * @return      True if an interrupt is pending (ON is set)
+ */
+bool Pi_desc::set_nv (uint8 nv)
+{
+    uint64 o { ctl }, n;
+
+    do n = (o & ~BIT64_RANGE (23, 16)) | static_cast<uint64>(nv) << 16; while (!ctl.compare_exchange (o, n));
+
+    return n & on;
+}
+
+/*
+ * Prepare for VM entry: Notifications are processed by the CPU in guest mode
+ *
+ * @return      True if an interrupt is pending
+ */
+bool Pi_desc::enter()
+{
+    return set_nv (VEC_IPI + Interrupt::Request::PIN);
+}
+
+/*
+ * Finish VM exit: Notifications are delivered to the kernel as wakeup
+ *
+ * @return      True if an interrupt is pending
+ */
+bool Pi_desc::leave()
+{
+    return set_nv (VEC_IPI + Interrupt::Request::PIW);
+}
+
+/*
+ * Move posted interrupts into the virtual IRR
+ *
+ * @param vapic Virtual-APIC page
+ * @return      Highest vector that was moved or 0 if none
+ */
+unsigned Pi_desc::harvest (uint32 *vapic)
+{
+    unsigned v { 0 };
+
+    // The PIR may hold interrupts that the SMMU posted without setting ON
+    if (!ctl.test_and_clr (on) && !posted())
+        return v;
+
+    for (unsigned i { 0 }; i < sizeof (pir) / sizeof (*pir); i++) {
+
+        uint64 o, n { 0 };
+
+        pir[i].exchange (o, n);
+
+        if (!o)
+            continue;
+
+        // IRR[255:0] occupies bits 31:0 of 8 consecutive 16-byte registers at offset 0x200
+        vapic[(0x200 + 0x20 * i) / sizeof (*vapic)]        |= static_cast<uint32>(o);
+        vapic[(0x200 + 0x20 * i + 0x10) / sizeof (*vapic)] |= static_cast<uint32>(o >> 32);
+
+        v = i * 64 + bit_scan_reverse (o);
+    }
+
+    return v;
+}
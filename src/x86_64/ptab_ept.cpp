@@ -0,0 +1,91 @@
+/*
+ * Extended Page Table (EPT)
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "ptab_ept.hpp"
+
+/*
+ * Dirty logging tracks guest writes in leaf PTEs, either with the dirty flag (Ept::ad)
+ * or by write-protecting clean pages and restoring write access upon the first write.
+ *
+ * With page-modification logging (Ept::pml), every dirty flag that the CPU sets is
+ * also logged and the log marks the table PTEs along the path to the dirty leaf PTE.
+ * Harvesting then skips page tables without dirty leaf PTEs below.
+ *
+ * Working-set estimation samples and clears the accessed flags (Ept::ad). The CPU sets
+ * the accessed flag of every PTE it uses during a walk, so sampling skips page tables
+ * that no walk has used since their accessed flag was cleared.
+ */
+
+/*
+ * Restore write access to a page that was write-protected for dirty logging
+ *
+ * @param v     Guest-physical address of the page
+ * @return      true if the page is writable, false otherwise
+ */
+bool Eptp::unprotect (uint64 v)
+{
+    auto tbl { slots (static_cast<Ept>(root)) };
+
+    for (auto l { lev - 1 };; l--) {
+
+        auto const ptr { tbl + (v >> (l * bpl + PAGE_BITS)) % BIT (bpl) };
+
+        Ept pte { *ptr };
+
+        if (pte.is_table (l)) {
+            tbl = slots (pte);
+            continue;
+        }
+
+        for (Ept tmp; !pte.is_empty() && pte.is_protected(); )
+            if (ptr->compare_exchange (pte, tmp = pte.unprotect()))
+                return true;
+
+        // A write fault on another CPU may have restored write access already
+        return !pte.is_empty() && !pte.is_table (l) && pte.is_dirty (false);
+    }
+}
+
+/*
+ * Mark the table PTEs along the path to a logged leaf PTE
+ *
+ * The marks are set bottom-up, so that harvesting, which clears them top-down, cannot miss a mark.
+ *
+ * @param v     Guest-physical address that was logged
+ */
+void Eptp::mark (uint64 v)
+{
+    PTE *path[lev - 1];
+
+    unsigned n { 0 };
+
+    for (auto tbl { slots (static_cast<Ept>(root)) }; n < lev - 1; n++) {
+
+        auto const ptr { tbl + (v >> ((lev - 1 - n) * bpl + PAGE_BITS)) % BIT (bpl) };
+
+        Ept pte { *ptr };
+
+        if (!pte.is_table (lev - 1 - n))
+            break;
+
+        path[n] = ptr;
+        tbl = slots (pte);
+    }
+
+    while (n--)
+        summarize (path[n], lev - 1 - n);
+}
@@ -26,19 +26,26 @@ void Cpu_regs::svm_set_cpu_pri (uint32 val) const
 {
     unsigned const msk = !!msk_cr0<Vmcb>() << 0 | !!msk_cr4<Vmcb>() << 4;
 
-    vmcb->npt_control  = 1;
     vmcb->intercept_cr = (msk << 16) | msk;
 
     vmcb->intercept_cpu[0] = val | Vmcb::force_ctrl0;
+
+    vmcb->modify (Vmcb::CLEAN_I);
 }
 
 void Cpu_regs::svm_set_cpu_sec (uint32 val) const
 {
     vmcb->intercept_cpu[1] = val | Vmcb::force_ctrl1;
+
+    vmcb->modify (Vmcb::CLEAN_I);
 }
 
 void Cpu_regs::vmx_set_cpu_pri (uint32 val) const
 {
+    // TPR shadowing requires a virtual-APIC page
+    if (!vapic)
+        val &= ~Vmcs::CPU_TPR_SHADOW;
+
     // Force CR8 load/store exiting if not using TPR shadowing
     if (!(val & Vmcs::CPU_TPR_SHADOW))
         val |= Vmcs::CPU_CR8_LOAD | Vmcs::CPU_CR8_STORE;
@@ -48,6 +55,17 @@ void Cpu_regs::vmx_set_cpu_pri (uint32 val) const
 
 void Cpu_regs::vmx_set_cpu_sec (uint32 val) const
 {
+    // APIC virtualization requires a virtual-APIC page
+    if (!vapic)
+        val &= ~(Vmcs::CPU_VIRT_INTR | Vmcs::CPU_APIC_REGS);
+
+    // Posted-interrupt processing accompanies virtual-interrupt delivery
+    if (pid)
+        Vmcs::set_pin (val & Vmcs::CPU_VIRT_INTR ? Vmcs::PIN_POSTED_INTR : 0);
+
+    // Page-modification logging is controlled by the kernel
+    val = pml ? val | Vmcs::CPU_PML : val & ~Vmcs::CPU_PML;
+
     Vmcs::write (Vmcs::Encoding::CPU_CONTROLS_SEC, (val | Vmcs::cpu_sec_set) & Vmcs::cpu_sec_clr);
 }
 
@@ -21,6 +21,7 @@
  */
 
 #include "bits.hpp"
+#include "lapic.hpp"
 #include "smmu.hpp"
 #include "space_dma.hpp"
 #include "space_hst.hpp"
@@ -47,10 +48,13 @@ Smmu::Smmu (Paddr p) : List (list), phys_base (p), mmio_base (mmap), invq (stati
 
     ir &= has_ir();
 
+    // True if all SMMUs support posted interrupts
+    pi &= has_pi();
+
     // DPT maximum leaf page size: 2 + { 1 (1GB), 0 (2MB), -1 (4KB) }
     Dptp::set_leaf_max (2 + bit_scan_reverse (cap >> 34 & BIT_RANGE (1, 0)));
 
-    trace (TRACE_SMMU, "SMMU: %#010lx CAP:%#018llx ECAP:%#018llx C:%u I:%u", phys_base, cap, ecap, has_co(), has_ir());
+    trace (TRACE_SMMU, "SMMU: %#010lx CAP:%#018llx ECAP:%#018llx C:%u I:%u P:%u", phys_base, cap, ecap, has_co(), has_ir(), has_pi());
 }
 
 void Smmu::init()
@@ -66,7 +70,8 @@ void Smmu::init()
     }
 
     if (ir) {
-        write (Register64::IRTA, Kmem::ptr_to_phys (irt) | 7);
+        // In x2APIC mode, IRT entries use 32-bit destination IDs (EIME)
+        write (Register64::IRTA, Kmem::ptr_to_phys (irt) | (Lapic::x2apic ? BIT (11) : 0) | 7);
         command (Cmd::IRTP);
         if (!(cap & BIT64 (62)))
             invalidate_iec();
@@ -0,0 +1,144 @@
+/*
+ * Guest Memory Space
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "arch.hpp"
+#include "ptab_hpt.hpp"
+#include "space_gst.hpp"
+#include "string.hpp"
+
+/*
+ * Read guest-physical memory
+ *
+ * @param v     Guest-physical address
+ * @param d     Destination buffer
+ * @param n     Number of bytes, which must not cross a page boundary
+ * @param c     Walk cursor
+ * @return      true if the memory is readable or executable RAM, false otherwise
+ */
+bool Space_gst::read (uint64 v, void *d, unsigned n, Cursor &c) const
+{
+    uint64 p; unsigned o; Memattr::Cacheability ca; Memattr::Shareability sh;
+
+    auto const pm { npt() ? nptp.lookup (v, p, o, ca, sh, &c.npt) : eptp.lookup (v, p, o, ca, sh, &c.ept) };
+
+    // The temporary mapping is cacheable, so it must not alias device memory
+    if (!(pm & (Paging::XS | Paging::XU | Paging::R)) || ca != Memattr::Cacheability::MEM_WB)
+        return false;
+
+    memcpy (d, Hptp::map (p), n);
+
+    return true;
+}
+
+/*
+ * Translate a guest-linear address through the guest page tables
+ *
+ * Access rights are not checked, because the VMM emulates the access and checks them itself.
+ *
+ * @param g     Guest paging state
+ * @param a     Guest-linear address, replaced with the guest-physical address
+ * @param c     Walk cursor
+ * @return      true if the address is mapped, false otherwise
+ */
+bool Space_gst::translate (Paging_state const &g, uint64 &a, Cursor &c) const
+{
+    if (!(g.cr0 & CR0_PG))
+        return true;
+
+    // Legacy paging: Two levels of 4-byte entries, 4M pages with PSE
+    if (!(g.cr4 & CR4_PAE)) {
+
+        for (uint32 e, t { static_cast<uint32>(g.cr3) & BIT_RANGE (31, 12) }, l { 2 }; l--; t = e & BIT_RANGE (31, 12)) {
+
+            if (!read (t + (a >> (12 + 10 * l) & BIT_RANGE (9, 0)) * sizeof (e), &e, sizeof (e), c) || !(e & BIT (0)))
+                return false;
+
+            if (!l || (g.cr4 & CR4_PSE && e & BIT (7))) {
+
+                // PSE-36: Bits 20:13 of a 4M PDE hold physical address bits 39:32
+                a = (e & BIT_RANGE (31, 12 + 10 * l)) | (a & BIT_RANGE (11 + 10 * l, 0)) | (static_cast<uint64>(e & BIT_RANGE (20, 13)) << 19) * l;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    auto const lm { !!(g.efer & EFER_LMA) };
+
+    uint64 t { g.cr3 & BIT64_RANGE (51, 12) };
+
+    // PAE paging starts with one of four PDPTEs, which the CPU may have loaded at CR3 load time
+    if (!lm) {
+
+        uint64 e;
+
+        if (g.pdpte)
+            e = g.pdpte[a >> 30 & BIT_RANGE (1, 0)];
+
+        else if (!read ((g.cr3 & BIT_RANGE (31, 5)) + (a >> 30 & BIT_RANGE (1, 0)) * sizeof (e), &e, sizeof (e), c))
+            return false;
+
+        if (!(e & BIT (0)))
+            return false;
+
+        t = e & BIT64_RANGE (51, 12);
+    }
+
+    // PAE and 4/5-level paging: Levels of 8-byte entries, 2M and 1G pages
+    for (uint64 e, l { lm ? g.cr4 & CR4_LA57 ? 5U : 4U : 2U }; l--; t = e & BIT64_RANGE (51, 12)) {
+
+        if (!read (t + (a >> (12 + 9 * l) & BIT_RANGE (8, 0)) * sizeof (e), &e, sizeof (e), c) || !(e & BIT (0)))
+            return false;
+
+        if (!l || (l < 3 && e & BIT (7))) {
+            a = (e & BIT64_RANGE (51, 12 + 9 * l)) | (a & BIT64_RANGE (11 + 9 * l, 0));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Fetch guest memory at a guest-linear address
+ *
+ * @param g     Guest paging state
+ * @param a     Guest-linear address
+ * @param d     Destination buffer
+ * @param n     Number of bytes
+ * @return      Number of bytes fetched, which is less than n if the range is not fully mapped
+ */
+unsigned Space_gst::fetch (Paging_state const &g, uint64 a, uint8 *d, unsigned n) const
+{
+    Cursor c;
+
+    unsigned i { 0 };
+
+    // The range may straddle a page boundary, so every page is translated separately
+    for (unsigned k; i < n; i += k) {
+
+        auto v { a + i };
+
+        k = min (n - i, static_cast<unsigned>(PAGE_SIZE - (v & OFFS_MASK)));
+
+        if (!translate (g, v, c) || !read (v, d + i, k, c))
+            break;
+    }
+
+    return i;
+}
@@ -20,6 +20,7 @@
  */
 
 #include "space_hst.hpp"
+#include "pd.hpp"
 #include "space_obj.hpp"
 
 INIT_PRIORITY (PRIO_SPACE_MEM)
@@ -43,6 +44,46 @@ Space_hst::Space_hst() : Space_mem (Kobject::Subtype::HST, nullptr)
     user_access (e, (num << PAGE_BITS) - e, true);
 }
 
+/*
+ * Destructor
+ */
+Space_hst::~Space_hst()
+{
+    for (unsigned cpu = 0; cpu < Cpu::count; cpu++)
+        loc[cpu].root_fini (MMAP_SPC, Hptp::lev - 2);
+
+    hptp.root_fini();
+}
+
+/*
+ * Reclaim the space after the last reference is gone
+ *
+ * A CPU that still has the space loaded must first switch away from it and then pass through
+ * another quiescent state before the page tables can be freed.
+ */
+void Space_hst::free (Rcu_elem *e)
+{
+    auto const hst { static_cast<Space_hst *>(e) };
+
+    bool busy { false };
+
+    for (unsigned cpu = 0; cpu < Cpu::count; cpu++) {
+
+        if (!hst->cpus.tst (cpu))
+            continue;
+
+        if (*Kmem::loc_to_glob (&current, cpu) != hst)
+            hst->cpus.clr (cpu);
+
+        busy = true;
+    }
+
+    if (busy)
+        Rcu::call (hst);
+    else
+        hst->get_pd()->reclaim (hst);
+}
+
 void Space_hst::init (unsigned cpu)
 {
     if (!cpus.tas (cpu)) {
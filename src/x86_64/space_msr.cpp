@@ -28,7 +28,7 @@ ALIGNED (Kobject::alignment) Space_msr Space_msr::nova;
 /*
  * Constructor (NOVA MSR Space)
  */
-Space_msr::Space_msr() : Space (Kobject::Subtype::MSR, nullptr), bmp (new Bitmap_msr)
+Space_msr::Space_msr() : Space (Kobject::Subtype::MSR, nullptr, free), bmp (new Bitmap_msr)
 {
     Space_obj::nova.insert (Space_obj::Selector::NOVA_MSR, Capability (this, std::to_underlying (Capability::Perm_sp::TAKE)));
 
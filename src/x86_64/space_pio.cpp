@@ -28,7 +28,7 @@ ALIGNED (Kobject::alignment) Space_pio Space_pio::nova;
 /*
  * Constructor (NOVA PIO Space)
  */
-Space_pio::Space_pio() : Space (Kobject::Subtype::PIO, nullptr), bmp (new Bitmap_pio), hst (nullptr)
+Space_pio::Space_pio() : Space (Kobject::Subtype::PIO, nullptr, free), bmp (new Bitmap_pio), hst (nullptr)
 {
     Space_obj::nova.insert (Space_obj::Selector::NOVA_PIO, Capability (this, std::to_underlying (Capability::Perm_sp::TAKE)));
 
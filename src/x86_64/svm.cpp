@@ -19,23 +19,34 @@
  * GNU General Public License version 2 for more details.
  */
 
+#include "acpi.hpp"
 #include "arch.hpp"
+#include "asid.hpp"
 #include "cmdline.hpp"
 #include "cpu.hpp"
 #include "hip.hpp"
 #include "msr.hpp"
+#include "ptab_npt.hpp"
 #include "stdio.hpp"
 #include "svm.hpp"
 
 Paddr       Vmcb::root;
-unsigned    Vmcb::asid_ctr;
+Paddr       Vmcb::hsave;
 uint32      Vmcb::svm_version;
 uint32      Vmcb::svm_feature;
 
-Vmcb::Vmcb (mword bmp, mword nptp) : base_io (bmp), asid (++asid_ctr), int_control (1ul << 24), npt_cr3 (nptp), efer (EFER_SVME), g_pat (0x7040600070406ull)
+/*
+ * Constructor (Guest VMCB)
+ *
+ * The ASID, the nested page table and the permission maps are assigned before the first VMRUN.
+ * All clean bits are initially clear, so the first VMRUN loads the entire VMCB.
+ */
+Vmcb::Vmcb()
 {
-    base_msr = Kmem::ptr_to_phys (Buddy::alloc (1, Buddy::Fill::BITS1));
-    assert (base_msr);
+    int_control = BIT (24);             // Virtual interrupt masking
+    npt_control = 1;
+    efer        = EFER_SVME;
+    g_pat       = 0x7040600070406ull;
 }
 
 void Vmcb::init()
@@ -43,10 +54,42 @@ void Vmcb::init()
     if (!Cpu::feature (Cpu::Feature::SVM))
         return;
 
+    if (!Acpi::resume) {
+
+        // NPT is mandatory and ASID 0 belongs to the host
+        if (!has_npt() || Asid::num < 2)
+            return;
+
+        // NPT maximum leaf page size: 3 (1GB), 2 (2MB)
+        Nptp::set_leaf_max (Cpu::feature (Cpu::Feature::GB_PAGES) ? 3 : 2);
+
+        // The host save area is owned by the CPU, the root VMCB holds the host state that VMLOAD restores after VMRUN
+        auto const h { Buddy::alloc (0, Buddy::Fill::BITS0) };
+        auto const r { Buddy::alloc (0, Buddy::Fill::BITS0) };
+
+        if (!h || !r) {
+
+            if (h)
+                Buddy::free (h);
+            if (r)
+                Buddy::free (r);
+
+            return;
+        }
+
+        hsave = Kmem::ptr_to_phys (h);
+        root  = Kmem::ptr_to_phys (r);
+
+        Hip::set_feature (Hip_arch::Feature::SVM);
+    }
+
+    if (!root)
+        return;
+
     Msr::write (Msr::Register::IA32_EFER, Msr::read (Msr::Register::IA32_EFER) | EFER_SVME);
-    Msr::write (Msr::Register::AMD_SVM_HSAVE_PA, root = Kmem::ptr_to_phys (new Vmcb));
+    Msr::write (Msr::Register::AMD_SVM_HSAVE_PA, hsave);
 
-    trace (TRACE_VIRT, "VMCB: %#010lx REV:%#x NPT:%u", root, svm_version, has_npt());
+    asm volatile ("vmsave" : : "a" (root) : "memory");
 
-    Hip::set_feature (Hip_arch::Feature::SVM);
+    trace (TRACE_VIRT, "VMCB: %#010lx REV:%#x NPT:%u ASID:%u CLEAN:%u FLUSH:%u", root, svm_version, has_npt(), Asid::num, has_clean(), has_flush_asid());
 }
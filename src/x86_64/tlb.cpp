@@ -19,16 +19,40 @@
  * GNU General Public License version 2 for more details.
  */
 
-#include "counter.hpp"
 #include "ec.hpp"
+#include "initprio.hpp"
 #include "interrupt.hpp"
 #include "lowlevel.hpp"
 #include "space_gst.hpp"
 #include "space_hst.hpp"
 #include "tlb.hpp"
 
+INIT_PRIORITY (PRIO_LOCAL) Tlb::Request Tlb::request;
+
+/*
+ * Send RKE to all CPUs with a pending request and wait until they all have processed it
+ *
+ * The IPIs are sent back to back, so the targets process the request in parallel.
+ */
+void Tlb::broadcast()
+{
+    Interrupt::send_set (Interrupt::Request::RKE, request.cpus);
+
+    while (!request.cpus.empty())
+        pause();
+}
+
+/*
+ * Flush the translations of a space on all CPUs
+ *
+ * CPUs that currently run the space reschedule before returning to it, which flushes the space.
+ *
+ * @param s     Host or guest space
+ */
 void Tlb::shootdown (Space *s)
 {
+    request.hst = nullptr;
+
     Cpu::preemption_enable();
 
     for (unsigned cpu { 0 }; cpu < Cpu::count; cpu++) {
@@ -43,13 +67,108 @@ void Tlb::shootdown (Space *s)
             continue;
         }
 
-        auto const cnt { Counter::req[Interrupt::Request::RKE].get (cpu) };
+        request.cpus.set (cpu);
+    }
+
+    broadcast();
+
+    Cpu::preemption_disable();
+}
+
+/*
+ * Invalidate the translations of a host space in the specified range on all CPUs
+ *
+ * CPUs that currently run the space invalidate the range page by page. All other CPUs
+ * flush the entire PCID of the space when they switch to it next.
+ *
+ * @param hst   Host space
+ * @param addr  Base address of the range
+ * @param size  Size of the range
+ */
+void Tlb::shootdown (Space_hst *hst, uint64 addr, uint64 size)
+{
+    request.hst  = hst;
+    request.addr = addr;
+    request.size = size;
+
+    Cpu::preemption_enable();
+
+    for (unsigned cpu { 0 }; cpu < Cpu::count; cpu++) {
+
+        // A CPU on which the space was never active since its last flush has no translations to invalidate
+        if (!hst->active.tst (cpu))
+            continue;
+
+        // A CPU that does not run the space flushes it upon switching to it, unless it switched in the meantime
+        if (Ec::remote_current (cpu)->get_hst() != hst) {
 
-        Interrupt::send_cpu (Interrupt::Request::RKE, cpu);
+            hst->htlb.set (cpu);
 
-        while (Counter::req[Interrupt::Request::RKE].get (cpu) == cnt)
-            pause();
+            if (Ec::remote_current (cpu)->get_hst() != hst)
+                continue;
+        }
+
+        if (Cpu::id == cpu) {
+            invalidate (hst, addr, size);
+            continue;
+        }
+
+        request.cpus.set (cpu);
     }
 
+    broadcast();
+
     Cpu::preemption_disable();
 }
+
+/*
+ * Invalidate the translations of a host space in the specified range on the current CPU
+ *
+ * @param hst   Host space
+ * @param addr  Base address of the range
+ * @param size  Size of the range
+ */
+void Tlb::invalidate (Space_hst *hst, uint64 addr, uint64 size)
+{
+    // INVLPG invalidates the translations of the current PCID
+    if (Space_hst::current == hst)
+        for (auto a { addr }; a < addr + size; a += PAGE_SIZE)
+            Hptp::invalidate (static_cast<uintptr_t>(a));
+
+    // Without PCIDs, switching to the space flushes its translations anyway
+    else if (Cpu::feature (Cpu::Feature::PCID)) {
+
+        auto const pcid { hst->get_pcid() };
+
+        // Without a PCID in the current generation, the space has no translations on this CPU
+        if (!pcid)
+            return;
+
+        if (Cpu::feature (Cpu::Feature::INVPCID))
+            for (auto a { addr }; a < addr + size; a += PAGE_SIZE)
+                Hptp::invalidate (pcid, static_cast<uintptr_t>(a));
+        else
+            hst->htlb.set (Cpu::id);
+    }
+}
+
+/*
+ * Process the shootdown requests of all CPUs that are pending for the current CPU
+ *
+ * Flush requests only need to be acknowledged, because the caller reschedules upon a pending flush.
+ */
+void Tlb::handle_rke()
+{
+    for (unsigned cpu { 0 }; cpu < Cpu::count; cpu++) {
+
+        auto &req { *Kmem::loc_to_glob (&request, cpu) };
+
+        if (!req.cpus.tst (Cpu::id))
+            continue;
+
+        if (req.hst)
+            invalidate (req.hst, req.addr, req.size);
+
+        req.cpus.clr (Cpu::id);
+    }
+}
@@ -27,6 +27,7 @@
 #include "space_obj.hpp"
 #include "space_pio.hpp"
 #include "svm.hpp"
+#include "vmcs_cache.hpp"
 #include "vmx.hpp"
 #include "vpid.hpp"
 
@@ -121,7 +122,10 @@ void Utcb_arch::load_vmx (Mtd_arch const m, Cpu_regs const &c)
         qual[2] = Vmcs::read<uint64>    (Vmcs::Encoding::GUEST_PHYSICAL_ADDRESS);
     }
 
-    // CTRL and TPR state is write-only
+    // CTRL state and TPR threshold are write-only
+
+    if ((m & Mtd_arch::Item::TPR) && c.vapic && Vmcs::has_vint())
+        intr_status = Vmcs::read<uint16> (Vmcs::Encoding::GUEST_INT_STATUS);
 
     if (m & Mtd_arch::Item::INJ) {
         if (c.exc.ep() == 33 || c.exc.ep() == Event::gst_arch + Event::Selector::RECALL) {
@@ -135,33 +139,39 @@ void Utcb_arch::load_vmx (Mtd_arch const m, Cpu_regs const &c)
         }
     }
 
-    if (m & Mtd_arch::Item::CS_SS) {
+    // Segment state that is still cached need not be read from the VMCS
+    auto const seg { m & ~(c.cache ? c.cache->copy (m, *this) : 0U) };
+
+    if (seg & Mtd_arch::Item::CS_SS) {
         cs.set_vmx (Vmcs::read<uint16> (Vmcs::Encoding::GUEST_SEL_CS), Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_CS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_CS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_AR_CS));
         ss.set_vmx (Vmcs::read<uint16> (Vmcs::Encoding::GUEST_SEL_SS), Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_SS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_SS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_AR_SS));
     }
 
-    if (m & Mtd_arch::Item::DS_ES) {
+    if (seg & Mtd_arch::Item::DS_ES) {
         ds.set_vmx (Vmcs::read<uint16> (Vmcs::Encoding::GUEST_SEL_DS), Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_DS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_DS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_AR_DS));
         es.set_vmx (Vmcs::read<uint16> (Vmcs::Encoding::GUEST_SEL_ES), Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_ES), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_ES), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_AR_ES));
     }
 
-    if (m & Mtd_arch::Item::FS_GS) {
+    if (seg & Mtd_arch::Item::FS_GS) {
         fs.set_vmx (Vmcs::read<uint16> (Vmcs::Encoding::GUEST_SEL_FS), Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_FS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_FS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_AR_FS));
         gs.set_vmx (Vmcs::read<uint16> (Vmcs::Encoding::GUEST_SEL_GS), Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_GS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_GS), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_AR_GS));
     }
 
-    if (m & Mtd_arch::Item::TR)
+    if (seg & Mtd_arch::Item::TR)
         tr.set_vmx (Vmcs::read<uint16> (Vmcs::Encoding::GUEST_SEL_TR), Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_TR), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_TR), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_AR_TR));
 
-    if (m & Mtd_arch::Item::LDTR)
+    if (seg & Mtd_arch::Item::LDTR)
         ld.set_vmx (Vmcs::read<uint16> (Vmcs::Encoding::GUEST_SEL_LDTR), Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_LDTR), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_LDTR), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_AR_LDTR));
 
-    if (m & Mtd_arch::Item::GDTR)
+    if (seg & Mtd_arch::Item::GDTR)
         gd.set_vmx (0, Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_GDTR), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_GDTR), 0);
 
-    if (m & Mtd_arch::Item::IDTR)
+    if (seg & Mtd_arch::Item::IDTR)
         id.set_vmx (0, Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_IDTR), Vmcs::read<uint32> (Vmcs::Encoding::GUEST_LIMIT_IDTR), 0);
 
+    if (c.cache)
+        c.cache->fill (m, *this);
+
     if (m & Mtd_arch::Item::PDPTE) {
         pdpte[0] = Vmcs::read<uint64> (Vmcs::Encoding::GUEST_PDPTE0);
         pdpte[1] = Vmcs::read<uint64> (Vmcs::Encoding::GUEST_PDPTE1);
@@ -204,6 +214,35 @@ void Utcb_arch::load_vmx (Mtd_arch const m, Cpu_regs const &c)
 
     if (m & Mtd_arch::Item::KERNEL_GS_BASE)
         kernel_gs_base = c.cpu.kernel_gs_base;
+
+    // The exit policy reads back with the values of shadowed MSRs
+    if (m & Mtd_arch::Item::EXIT && c.exits)
+        exits = *c.exits;
+
+    // Instruction bytes at RIP, so that the VMM need not walk the guest page tables to emulate an access
+    if (m & Mtd_arch::Item::INSN) {
+
+        Space_gst const *const gst { c.gst };
+
+        auto const gefer { Vmcs::read<uint64>    (Vmcs::Encoding::GUEST_EFER) };
+        auto const grip  { Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_RIP) };
+        auto const gcr4  { c.vmx_get_gst_cr4() };
+
+        // The CS base is ignored in 64-bit mode
+        auto const la { gefer & EFER_LMA && Vmcs::read<uint32> (Vmcs::Encoding::GUEST_AR_CS) & BIT (13) ? grip : static_cast<uint32>(Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_BASE_CS) + grip) };
+
+        // With EPT, PAE paging uses the PDPTEs in the VMCS rather than those in memory
+        uint64 pdp[4] { 0, 0, 0, 0 };
+
+        if (gcr4 & CR4_PAE && !(gefer & EFER_LMA)) {
+            pdp[0] = Vmcs::read<uint64> (Vmcs::Encoding::GUEST_PDPTE0);
+            pdp[1] = Vmcs::read<uint64> (Vmcs::Encoding::GUEST_PDPTE1);
+            pdp[2] = Vmcs::read<uint64> (Vmcs::Encoding::GUEST_PDPTE2);
+            pdp[3] = Vmcs::read<uint64> (Vmcs::Encoding::GUEST_PDPTE3);
+        }
+
+        insn.len = gst ? gst->fetch ({ c.vmx_get_gst_cr0(), Vmcs::read<uintptr_t> (Vmcs::Encoding::GUEST_CR3), gcr4, gefer, pdp }, la, insn.val, sizeof (insn.val)) : 0;
+    }
 }
 
 bool Utcb_arch::save_vmx (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) const
@@ -255,8 +294,11 @@ bool Utcb_arch::save_vmx (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         Vmcs::write (Vmcs::Encoding::PF_ERROR_MATCH, pfe_match);
     }
 
-    if (m & Mtd_arch::Item::TPR)
+    if (m & Mtd_arch::Item::TPR) {
         Vmcs::write (Vmcs::Encoding::TPR_THRESHOLD, tpr_threshold);
+        if (c.vapic && Vmcs::has_vint())
+            Vmcs::write (Vmcs::Encoding::GUEST_INT_STATUS, static_cast<uint16>(intr_status));
+    }
 
     if (m & Mtd_arch::Item::INJ) {
 
@@ -278,7 +320,10 @@ bool Utcb_arch::save_vmx (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         Vmcs::write (Vmcs::Encoding::INJ_EVENT_ERROR, intr_errc);
     }
 
-    if (m & Mtd_arch::Item::CS_SS) {
+    // Segment state that the VMCS already holds need not be written
+    auto const seg { m & ~(c.cache ? c.cache->same (m, *this) : 0U) };
+
+    if (seg & Mtd_arch::Item::CS_SS) {
         Vmcs::write (Vmcs::Encoding::GUEST_SEL_CS,   cs.sel);
         Vmcs::write (Vmcs::Encoding::GUEST_BASE_CS,  cs.base);
         Vmcs::write (Vmcs::Encoding::GUEST_LIMIT_CS, cs.limit);
@@ -289,7 +334,7 @@ bool Utcb_arch::save_vmx (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         Vmcs::write (Vmcs::Encoding::GUEST_AR_SS,   (ss.ar << 4 & 0x1f000) | (ss.ar & 0xff));
     }
 
-    if (m & Mtd_arch::Item::DS_ES) {
+    if (seg & Mtd_arch::Item::DS_ES) {
         Vmcs::write (Vmcs::Encoding::GUEST_SEL_DS,   ds.sel);
         Vmcs::write (Vmcs::Encoding::GUEST_BASE_DS,  ds.base);
         Vmcs::write (Vmcs::Encoding::GUEST_LIMIT_DS, ds.limit);
@@ -300,7 +345,7 @@ bool Utcb_arch::save_vmx (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         Vmcs::write (Vmcs::Encoding::GUEST_AR_ES,   (es.ar << 4 & 0x1f000) | (es.ar & 0xff));
     }
 
-    if (m & Mtd_arch::Item::FS_GS) {
+    if (seg & Mtd_arch::Item::FS_GS) {
         Vmcs::write (Vmcs::Encoding::GUEST_SEL_FS,   fs.sel);
         Vmcs::write (Vmcs::Encoding::GUEST_BASE_FS,  fs.base);
         Vmcs::write (Vmcs::Encoding::GUEST_LIMIT_FS, fs.limit);
@@ -311,30 +356,33 @@ bool Utcb_arch::save_vmx (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         Vmcs::write (Vmcs::Encoding::GUEST_AR_GS,   (gs.ar << 4 & 0x1f000) | (gs.ar & 0xff));
     }
 
-    if (m & Mtd_arch::Item::TR) {
+    if (seg & Mtd_arch::Item::TR) {
         Vmcs::write (Vmcs::Encoding::GUEST_SEL_TR,   tr.sel);
         Vmcs::write (Vmcs::Encoding::GUEST_BASE_TR,  tr.base);
         Vmcs::write (Vmcs::Encoding::GUEST_LIMIT_TR, tr.limit);
         Vmcs::write (Vmcs::Encoding::GUEST_AR_TR,   (tr.ar << 4 & 0x1f000) | (tr.ar & 0xff));
     }
 
-    if (m & Mtd_arch::Item::LDTR) {
+    if (seg & Mtd_arch::Item::LDTR) {
         Vmcs::write (Vmcs::Encoding::GUEST_SEL_LDTR,   ld.sel);
         Vmcs::write (Vmcs::Encoding::GUEST_BASE_LDTR,  ld.base);
         Vmcs::write (Vmcs::Encoding::GUEST_LIMIT_LDTR, ld.limit);
         Vmcs::write (Vmcs::Encoding::GUEST_AR_LDTR,   (ld.ar << 4 & 0x1f000) | (ld.ar & 0xff));
     }
 
-    if (m & Mtd_arch::Item::GDTR) {
+    if (seg & Mtd_arch::Item::GDTR) {
         Vmcs::write (Vmcs::Encoding::GUEST_BASE_GDTR,  gd.base);
         Vmcs::write (Vmcs::Encoding::GUEST_LIMIT_GDTR, gd.limit);
     }
 
-    if (m & Mtd_arch::Item::IDTR) {
+    if (seg & Mtd_arch::Item::IDTR) {
         Vmcs::write (Vmcs::Encoding::GUEST_BASE_IDTR,  id.base);
         Vmcs::write (Vmcs::Encoding::GUEST_LIMIT_IDTR, id.limit);
     }
 
+    if (c.cache)
+        c.cache->valid &= ~seg;
+
     if (m & Mtd_arch::Item::PDPTE) {
         Vmcs::write (Vmcs::Encoding::GUEST_PDPTE0, pdpte[0]);
         Vmcs::write (Vmcs::Encoding::GUEST_PDPTE1, pdpte[1]);
@@ -389,6 +437,18 @@ bool Utcb_arch::save_vmx (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
     if (m & Mtd_arch::Item::KERNEL_GS_BASE)
         c.cpu.kernel_gs_base = Cpu::State::constrain_canon (kernel_gs_base);
 
+    if (m & Mtd_arch::Item::EXIT) {
+
+        if (EXPECT_FALSE (!c.exits && !(c.exits = new Exit_policy)))
+            return false;
+
+        *c.exits = exits;
+
+        // Only posted interrupts can end a poll, so vCPUs without them do not poll
+        if (!c.pid)
+            c.exits->disable (Exit_policy::POLL);
+    }
+
     if (m & Mtd_arch::Item::TLB) {
 
         auto vpid = Vmcs::vpid();
@@ -402,7 +462,7 @@ bool Utcb_arch::save_vmx (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         if (EXPECT_FALSE (!assign_spaces (c, obj)))
             return false;
 
-        Vmcs::write (Vmcs::Encoding::EPTP,        c.gst->get_phys() | (Eptp::lev - 1) << 3 | CA_TYPE_MEM_WB);
+        Vmcs::write (Vmcs::Encoding::EPTP,        c.gst->get_phys() | Ept::ad << 6 | (Eptp::lev - 1) << 3 | CA_TYPE_MEM_WB);
         Vmcs::write (Vmcs::Encoding::BITMAP_IO_A, c.pio->get_phys());
         Vmcs::write (Vmcs::Encoding::BITMAP_IO_B, c.pio->get_phys() + PAGE_SIZE);
         Vmcs::write (Vmcs::Encoding::BITMAP_MSR,  c.msr->get_phys());
@@ -520,6 +580,18 @@ void Utcb_arch::load_svm (Mtd_arch const m, Cpu_regs const &c)
 
     if (m & Mtd_arch::Item::KERNEL_GS_BASE)
         kernel_gs_base = v->kernel_gs_base;
+
+    // Instruction bytes at RIP, so that the VMM need not walk the guest page tables to emulate an access
+    if (m & Mtd_arch::Item::INSN) {
+
+        Space_gst const *const gst { c.gst };
+
+        // The CS base is ignored in 64-bit mode
+        auto const la { v->efer & EFER_LMA && v->cs.ar & BIT (9) ? v->rip : static_cast<uint32>(v->cs.base + v->rip) };
+
+        // With nested paging, PAE paging reads the PDPTEs from memory on each walk
+        insn.len = gst ? gst->fetch ({ v->cr0, v->cr3, v->cr4, v->efer, nullptr }, la, insn.val, sizeof (insn.val)) : 0;
+    }
 }
 
 bool Utcb_arch::save_svm (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) const
@@ -573,16 +645,20 @@ bool Utcb_arch::save_svm (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         }
 
         v->inj_control = static_cast<uint64>(intr_errc) << 32 | (intr_info & ~0x3000);
+
+        v->modify (Vmcb::Clean (Vmcb::CLEAN_I | Vmcb::CLEAN_TPR));
     }
 
     if (m & Mtd_arch::Item::CS_SS) {
         v->cs = cs;
         v->ss = ss;
+        v->modify (Vmcb::CLEAN_SEG);
     }
 
     if (m & Mtd_arch::Item::DS_ES) {
         v->ds = ds;
         v->es = es;
+        v->modify (Vmcb::CLEAN_SEG);
     }
 
     if (m & Mtd_arch::Item::FS_GS) {
@@ -596,11 +672,15 @@ bool Utcb_arch::save_svm (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
     if (m & Mtd_arch::Item::LDTR)
         v->ldtr = ld;
 
-    if (m & Mtd_arch::Item::GDTR)
+    if (m & Mtd_arch::Item::GDTR) {
         v->gdtr = gd;
+        v->modify (Vmcb::CLEAN_DT);
+    }
 
-    if (m & Mtd_arch::Item::IDTR)
+    if (m & Mtd_arch::Item::IDTR) {
         v->idtr = id;
+        v->modify (Vmcb::CLEAN_DT);
+    }
 
     // PDPTE registers are not used
 
@@ -609,10 +689,13 @@ bool Utcb_arch::save_svm (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         v->cr2 = cr2;
         v->cr3 = cr3;
         v->cr4 = cr4;
+        v->modify (Vmcb::Clean (Vmcb::CLEAN_CR | Vmcb::CLEAN_CR2));
     }
 
-    if (m & Mtd_arch::Item::DR)
+    if (m & Mtd_arch::Item::DR) {
         v->dr7 = dr7;
+        v->modify (Vmcb::CLEAN_DR);
+    }
 
     if (m & Mtd_arch::Item::XSAVE) {
         c.fpu.xcr = Fpu::State::constrain_xcr (xcr0);
@@ -631,18 +714,23 @@ bool Utcb_arch::save_svm (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         v->sysenter_eip = sysenter_eip;
     }
 
-    if (m & Mtd_arch::Item::PAT)
+    if (m & Mtd_arch::Item::PAT) {
         v->g_pat = pat;
+        v->modify (Vmcb::CLEAN_NP);
+    }
 
-    if (m & Mtd_arch::Item::EFER)
-        v->efer = efer;
+    if (m & Mtd_arch::Item::EFER) {
+        v->efer = efer | EFER_SVME;
+        v->modify (Vmcb::CLEAN_CR);
+    }
 
     if (m & Mtd_arch::Item::KERNEL_GS_BASE)
         v->kernel_gs_base = Cpu::State::constrain_canon (kernel_gs_base);
 
+    // The exit policy is not used
+
     if (m & Mtd_arch::Item::TLB)
-        if (v->asid)
-            v->tlb_control = 3;
+        v->flush_asid();
 
     if (m & Mtd_arch::Item::SPACES) {
 
@@ -652,6 +740,10 @@ bool Utcb_arch::save_svm (Mtd_arch const m, Cpu_regs &c, Space_obj const *obj) c
         v->npt_cr3  = c.gst->get_phys();
         v->base_io  = c.pio->get_phys();
         v->base_msr = c.msr->get_phys();
+
+        // Translations of the ASID may stem from the previous nested page table
+        v->modify (Vmcb::Clean (Vmcb::CLEAN_IOPM | Vmcb::CLEAN_NP));
+        v->flush_asid();
     }
 
     return true;
@@ -676,12 +768,38 @@ bool Utcb_arch::assign_spaces (Cpu_regs &c, Space_obj const *obj) const
     if (EXPECT_FALSE (gst->get_pd() != own || pio->get_pd() != own || msr->get_pd() != own))
         return false;
 
-    // FIXME: Refcount updates
+    // Acquire references to the new spaces before releasing those to the old spaces
+    if (EXPECT_FALSE (!gst->add_ref()))
+        return false;
+
+    if (EXPECT_FALSE (!pio->add_ref())) {
+        gst->del_ref();
+        return false;
+    }
+
+    if (EXPECT_FALSE (!msr->add_ref())) {
+        pio->del_ref();
+        gst->del_ref();
+        return false;
+    }
+
+    auto const ogst { c.gst.load() };
+    auto const opio { c.pio };
+    auto const omsr { c.msr };
 
     c.gst = gst;
     c.pio = pio;
     c.msr = msr;
 
+    if (ogst)
+        ogst->del_ref();
+
+    if (opio)
+        opio->del_ref();
+
+    if (omsr)
+        omsr->del_ref();
+
     c.hazard.clr (Hazard::ILLEGAL);
 
     return true;
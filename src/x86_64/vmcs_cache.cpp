@@ -0,0 +1,22 @@
+/*
+ * VMCS Segment Cache
+ *
+ * Copyright (C) 2019-2022 Udo Steinberg, BedRock Systems, Inc.
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+
+#include "vmcs_cache.hpp"
+
+INIT_PRIORITY (PRIO_SLAB)
+Slab_cache Vmcs_cache::cache (sizeof (Vmcs_cache), alignof (Vmcs_cache));
@@ -40,6 +40,7 @@ Vmcs *      Vmcs::current     { nullptr };
 uint64      Vmcs::basic       { 0 };
 uint64      Vmcs::ept_vpid    { 0 };
 uint32      Vmcs::pin         { 0 };
+uint32      Vmcs::pin_clr     { 0 };
 uint32      Vmcs::ent         { 0 };
 uint32      Vmcs::exi_pri     { 0 };
 uint64      Vmcs::exi_sec     { 0 };
@@ -49,7 +50,7 @@ uint64      Vmcs::cpu_ter_clr { 0 }, Vmcs::cpu_ter_set { 0 };
 uintptr_t   Vmcs::fix_cr0_clr { 0 }, Vmcs::fix_cr0_set { 0 };
 uintptr_t   Vmcs::fix_cr4_clr { 0 }, Vmcs::fix_cr4_set { 0 };
 
-void Vmcs::init (uintptr_t rsp, uintptr_t cr3, uint16 vpid)
+void Vmcs::init (uintptr_t rsp, uintptr_t cr3)
 {
     // Set VMCS launch state to "clear" and initialize implementation-specific VMCS state.
     clear();
@@ -61,7 +62,7 @@ void Vmcs::init (uintptr_t rsp, uintptr_t cr3, uint16 vpid)
     write (Encoding::CR3_TARGET_COUNT, 0);
 
     write (Encoding::VMCS_LINK_PTR, ~0ULL);
-    write (Encoding::VPID, vpid);
+    write (Encoding::VPID, 0);                  // Assigned before the first VM entry
 
     write (Encoding::HOST_SEL_CS, SEL_KERN_CODE);
     write (Encoding::HOST_SEL_SS, SEL_KERN_DATA);
@@ -123,7 +124,7 @@ void Vmcs::init()
         // Pin-Based Controls
         constexpr auto hyp_pin { Pin::PIN_VIRT_NMI | Pin::PIN_NMI | Pin::PIN_EXTINT };
         auto vmx_pin { Msr::read (ctrl ? Msr::Register::IA32_VMX_TRUE_PIN : Msr::Register::IA32_VMX_CTRL_PIN) };
-        pin = (hyp_pin | static_cast<uint32>(vmx_pin)) & static_cast<uint32>(vmx_pin >> 32);
+        pin = (hyp_pin | static_cast<uint32>(vmx_pin)) & (pin_clr = static_cast<uint32>(vmx_pin >> 32));
 
         // VM-Entry Controls
         constexpr auto hyp_ent { Ent::ENT_LOAD_CET | Ent::ENT_LOAD_EFER | Ent::ENT_LOAD_PAT };
@@ -180,6 +181,12 @@ void Vmcs::init()
         if (!has_mbec())
             Ept::mbec = false;
 
+        // Dirty logging uses EPT A/D flags and PML if available and write protection otherwise
+        if (!has_ept_ad())
+            Ept::ad = false;
+        if (!has_pml())
+            Ept::pml = false;
+
         // EPT maximum leaf page size: 2 + { 1 (1GB), 0 (2MB), -1 (4KB) }
         Eptp::set_leaf_max (2 + bit_scan_reverse (ept_vpid >> 16 & BIT_RANGE (1, 0)));
 
@@ -202,7 +209,7 @@ void Vmcs::init()
 
     vmxon();
 
-    trace (TRACE_VIRT, "VMCS: %#010lx REV:%#x VPID:%u MBEC:%u", Kmem::ptr_to_phys (root), root->rev, has_vpid(), has_mbec());
+    trace (TRACE_VIRT, "VMCS: %#010lx REV:%#x VPID:%u MBEC:%u PML:%u", Kmem::ptr_to_phys (root), root->rev, has_vpid(), has_mbec(), has_pml());
 }
 
 void Vmcs::fini()
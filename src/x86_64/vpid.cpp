@@ -20,4 +20,4 @@
 
 #include "vpid.hpp"
 
-Atomic<uint16> Vpid::allocator { 0 };
+uint64 Vpid::gen { 0 };